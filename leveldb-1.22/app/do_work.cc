@@ -1,14 +1,23 @@
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <iostream>
 #include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "helpers/io_uring/io_uring_env.h"
 #include "stats.h"
+#include "trace.h"
+#include "ycsb.h"
 #include <cstring>
 #include "cxxopts.hpp"
 #include <unistd.h>
 #include <fstream>
 #include <cmath>
+#include <memory>
 #include <random>
+#include <thread>
+#include <x86intrin.h>
 
 #ifdef JL_LIBCFS
 #include "fsapi.h"
@@ -21,28 +30,22 @@ using namespace std;
 int num_pairs_base = 1000;
 int mix_base = 20;
 
-class DBOperation {
-public:
-    uint8_t op;
-    uint8_t sub_field;
-    string target;
-
-    DBOperation(uint32_t opcode, string&& key, uint32_t sub = 0) : op(opcode), sub_field(sub), target(key) {}
+// What one worker thread measured; merged by main() after all threads finish.
+struct WorkerResult {
+    uint64_t finished = 0;
+    uint64_t max_lag = 0;  // Open-loop mode: most ticks an operation started late
+    uint64_t max_outstanding = 0;  // Open-loop mode: most requests arrived but not finished
 };
 
-string FormatString(const string& original, int size) {
-    if (original.length() < size) {
-        return std::move(string(size - original.length(), '0') + original);
-    } else {
-        return std::move(original.substr(original.length() - size));
-    }
-} 
-
 
 int main(int argc, char *argv[]) {
-    int key_size, value_size, n, db_offset;
-    string input_filename;
-    bool print_single_timing, evict, fresh_write, pause, debug;
+    int key_size, value_size, n, db_offset, readahead_blocks, multiget_batch, num_threads, core_base, queue_depth;
+    int background_compactions, subcompactions, cache_shard_bits, bloom_bits;
+    size_t cache_size, index_partition_size;
+    uint64_t target_ops;
+    string input_filename, latency_dump, workload, distribution, scan_length_distribution;
+    YcsbSpec spec;
+    bool print_single_timing, evict, fresh_write, pause, debug, pipelined_write, concurrent_memtable_write, memtable_huge_pages, clock_cache, cache_stats, blocked_bloom, whole_table_filter, block_key_prefixes, direct_reads, io_uring;
 #ifdef JL_LIBCFS
     string db_location_base = "";
 #else
@@ -53,33 +56,100 @@ int main(int argc, char *argv[]) {
     commandline_options.add_options()
             ("k,key_size", "the size of key", cxxopts::value<int>(key_size)->default_value("16"))
             ("v,value_size", "the size of value", cxxopts::value<int>(value_size)->default_value("64"))
-            ("single_timing", "print the time of every single get", cxxopts::value<bool>(print_single_timing)->default_value("false"))
-            ("f,input_file", "the filename of input file", cxxopts::value<string>(input_filename)->default_value(""))
+            ("single_timing", "print the latency of every single operation", cxxopts::value<bool>(print_single_timing)->default_value("false"))
+            ("f,input_file", "the trace to replay, in text or binary (see trace_convert) form", cxxopts::value<string>(input_filename)->default_value(""))
             ("w,write", "writedb", cxxopts::value<bool>(fresh_write)->default_value("false"))
             ("e,uncache", "evict cache", cxxopts::value<bool>(evict)->default_value("false"))
             ("p,pause", "pause between operation", cxxopts::value<bool>(pause)->default_value("false"))
             ("g,debug", "print debug info", cxxopts::value<bool>(debug)->default_value("false"))
             ("n,num_operation", "number of operations", cxxopts::value<int>(n)->default_value("10000000"))
-            ("d, db_loc_offset", "db location offset", cxxopts::value<int>(db_offset)->default_value("0"));
+            ("d, db_loc_offset", "db location offset", cxxopts::value<int>(db_offset)->default_value("0"))
+            ("r,readahead", "number of data blocks to read ahead in scans", cxxopts::value<int>(readahead_blocks)->default_value("0"))
+            ("multiget_batch", "batched-read mode: look up this many consecutive reads with one MultiGet", cxxopts::value<int>(multiget_batch)->default_value("1"))
+            ("compactions", "maximum number of compactions running at once", cxxopts::value<int>(background_compactions)->default_value("1"))
+            ("subcompactions", "maximum number of threads a single compaction is split across", cxxopts::value<int>(subcompactions)->default_value("1"))
+            ("pipelined_write", "let the next write group append to the log while the previous one fills the memtable", cxxopts::value<bool>(pipelined_write)->default_value("false"))
+            ("concurrent_memtable_write", "let the writers of a group fill the memtable in parallel (implies pipelined_write)", cxxopts::value<bool>(concurrent_memtable_write)->default_value("false"))
+            ("memtable_huge_pages", "allocate memtables from recycled huge-page regions", cxxopts::value<bool>(memtable_huge_pages)->default_value("false"))
+            ("clock_cache", "use the lock-free CLOCK cache for the block and table caches", cxxopts::value<bool>(clock_cache)->default_value("false"))
+            ("cache_size", "block cache capacity in bytes", cxxopts::value<size_t>(cache_size)->default_value("8388608"))
+            ("cache_shard_bits", "split the block cache into 2^cache_shard_bits shards", cxxopts::value<int>(cache_shard_bits)->default_value("4"))
+            ("cache_stats", "print the per-shard block cache statistics after the run", cxxopts::value<bool>(cache_stats)->default_value("false"))
+            ("bloom_bits", "bits per key of the table bloom filters, 0 for none", cxxopts::value<int>(bloom_bits)->default_value("0"))
+            ("blocked_bloom", "use cache-line-blocked bloom filters (needs bloom_bits)", cxxopts::value<bool>(blocked_bloom)->default_value("false"))
+            ("whole_table_filter", "build one bloom filter per table instead of one per 2KB of data", cxxopts::value<bool>(whole_table_filter)->default_value("false"))
+            ("index_partition_size", "split table indexes into blocks of this many bytes, read through the block cache; 0 to keep them whole", cxxopts::value<size_t>(index_partition_size)->default_value("0"))
+            ("block_key_prefixes", "store restart key prefixes in table blocks for SIMD seeks", cxxopts::value<bool>(block_key_prefixes)->default_value("false"))
+            ("direct_reads", "read table files with O_DIRECT, bypassing the page cache (not under uFS)", cxxopts::value<bool>(direct_reads)->default_value("false"))
+            ("io_uring", "do the file I/O through per-thread io_uring rings (not under uFS)", cxxopts::value<bool>(io_uring)->default_value("false"))
+            ("t,threads", "number of worker threads", cxxopts::value<int>(num_threads)->default_value("1"))
+            ("c,core_base", "pin worker thread i to core core_base + i (1-based), 0 to keep the affinity inherited from the main thread", cxxopts::value<int>(core_base)->default_value("0"))
+            ("o,target_ops", "open-loop mode: total operations per second to issue, 0 for closed loop", cxxopts::value<uint64_t>(target_ops)->default_value("0"))
+            ("q,queue_depth", "open-loop mode: requests a thread may have arrived but unfinished before it stops holding reads back for a MultiGet batch; none is dropped", cxxopts::value<int>(queue_depth)->default_value("64"))
+            ("latency_dump", "write the latency histograms to this file", cxxopts::value<string>(latency_dump)->default_value(""))
+            ("y,workload", "generate YCSB workload a-f, or load, instead of replaying a trace", cxxopts::value<string>(workload)->default_value(""))
+            ("record_count", "YCSB: number of records in the database", cxxopts::value<uint64_t>(spec.record_count)->default_value("1000000"))
+            ("read_ratio", "YCSB: override the share of reads", cxxopts::value<double>())
+            ("update_ratio", "YCSB: override the share of updates", cxxopts::value<double>())
+            ("scan_ratio", "YCSB: override the share of scans", cxxopts::value<double>())
+            ("insert_ratio", "YCSB: override the share of inserts", cxxopts::value<double>())
+            ("rmw_ratio", "YCSB: override the share of read-modify-writes", cxxopts::value<double>())
+            ("distribution", "YCSB: override the key distribution: uniform, zipfian or latest", cxxopts::value<string>(distribution)->default_value(""))
+            ("theta", "YCSB: zipfian constant, in (0, 1)", cxxopts::value<double>())
+            ("max_scan_length", "YCSB: maximum scan length", cxxopts::value<uint32_t>())
+            ("scan_length_distribution", "YCSB: uniform or zipfian", cxxopts::value<string>(scan_length_distribution)->default_value(""));
     
     auto result = commandline_options.parse(argc, argv);
+    if (num_threads < 1 || queue_depth < 1) {
+        throw std::runtime_error("threads and queue_depth must be positive");
+    }
 
     string db_location = db_location_base + to_string(db_offset);
 
-    vector<DBOperation> ops;
-    {
-        ifstream input(input_filename);
-        if (!input) exit(-11);
-        uint32_t op;
-        string key;
-        int count = 0;
-        while (input >> op >> key) {
-            string formatted_key = FormatString(key, key_size);
-            uint32_t sub = 0;
-            if (op == 2) input >> sub;
-            ops.emplace_back(op, std::move(formatted_key), sub);
-            if (++count >= n) break;
+    // Either a trace to replay, or a workload whose operations every thread
+    // generates on the fly.
+    Trace ops;
+    std::unique_ptr<YcsbWorkload> generated;
+    if (workload.empty()) {
+        string error;
+        if (!ops.Open(input_filename, key_size, n, &error)) {
+            cerr << error << endl;
+            exit(-11);
+        }
+        if (ops.IsBinary() && result.count("key_size") && static_cast<uint32_t>(key_size) != ops.KeySize()) {
+            cerr << input_filename << " is a binary trace with " << ops.KeySize() << "-byte keys; -k does not apply" << endl;
+            exit(-11);
+        }
+    } else {
+        if (!YcsbWorkload::Preset(workload, &spec)) {
+            throw std::runtime_error("unknown workload " + workload);
+        }
+        auto parse_distribution = [](const string& name) {
+            if (name == "uniform") return KeyDistribution::Uniform;
+            if (name == "zipfian") return KeyDistribution::Zipfian;
+            if (name == "latest") return KeyDistribution::Latest;
+            throw std::runtime_error("unknown distribution " + name);
+        };
+        if (result.count("read_ratio")) spec.read_ratio = result["read_ratio"].as<double>();
+        if (result.count("update_ratio")) spec.update_ratio = result["update_ratio"].as<double>();
+        if (result.count("scan_ratio")) spec.scan_ratio = result["scan_ratio"].as<double>();
+        if (result.count("insert_ratio")) spec.insert_ratio = result["insert_ratio"].as<double>();
+        if (result.count("rmw_ratio")) spec.rmw_ratio = result["rmw_ratio"].as<double>();
+        if (!distribution.empty()) spec.distribution = parse_distribution(distribution);
+        if (result.count("theta")) spec.theta = result["theta"].as<double>();
+        if (result.count("max_scan_length")) spec.max_scan_length = result["max_scan_length"].as<uint32_t>();
+        if (!scan_length_distribution.empty()) {
+            spec.scan_length_distribution = parse_distribution(scan_length_distribution);
+            if (spec.scan_length_distribution == KeyDistribution::Latest) {
+                throw std::runtime_error("scan lengths cannot follow the latest distribution");
+            }
         }
+        if (spec.record_count == 0 || spec.max_scan_length == 0 || spec.theta <= 0 || spec.theta >= 1 ||
+            spec.read_ratio + spec.update_ratio + spec.scan_ratio + spec.insert_ratio + spec.rmw_ratio <= 0) {
+            throw std::runtime_error("invalid YCSB workload parameters");
+        }
+        cerr << "Precomputing workload " << workload << " over " << spec.record_count << " records" << endl;
+        generated.reset(new YcsbWorkload(spec));
     }
 
     adgMod::Stats* instance = adgMod::Stats::GetInstance();
@@ -97,7 +167,31 @@ int main(int argc, char *argv[]) {
     }
 
     Options options;
+    options.max_background_compactions = background_compactions;
+    options.max_subcompactions = subcompactions;
+    options.enable_pipelined_write = pipelined_write || concurrent_memtable_write;
+    options.allow_concurrent_memtable_write = concurrent_memtable_write;
+    options.memtable_huge_pages = memtable_huge_pages;
+    options.use_clock_cache = clock_cache;
+    options.block_cache = clock_cache ? NewClockCache(cache_size, cache_shard_bits, options.block_size)
+                                      : NewLRUCache(cache_size, cache_shard_bits);
+    if (bloom_bits > 0) {
+        options.filter_policy = blocked_bloom ? NewBlockedBloomFilterPolicy(bloom_bits) : NewBloomFilterPolicy(bloom_bits);
+    }
+    options.whole_table_filter = whole_table_filter;
+    options.index_partition_size = index_partition_size;
+    options.block_key_prefixes = block_key_prefixes;
+    std::unique_ptr<Env> io_uring_env;
+    if (io_uring) {
+        io_uring_env.reset(NewIoUringEnv(Env::Default()));
+        if (io_uring_env == nullptr) {
+            throw std::runtime_error("io_uring is not available");
+        }
+        options.env = io_uring_env.get();
+    }
+    options.env->SetUseDirectReads(direct_reads);
     ReadOptions read_options;
+    read_options.readahead_blocks = readahead_blocks;
     WriteOptions write_options;
     Status status;
     DB* db;
@@ -112,49 +206,214 @@ int main(int argc, char *argv[]) {
 #endif
 
     cerr << "Starting up" << endl;
+    cerr << "Timer: " << (Timer::UsesTsc() ? "invariant TSC" : "CLOCK_MONOTONIC_RAW") << " at "
+         << Timer::TicksPerSecond() << " ticks/s" << endl;
     status = DB::Open(options, db_location, &db);
     if (!status.ok()) {
         throw std::runtime_error("open Failed");
     }
-    Iterator* db_iter = db->NewIterator(read_options);
 
-    cerr << "Start running " << n << " operations at " << db_location << " op_file_size " << ops.size() << endl;
-    instance->StartTimer(0);
-    string value;
-    for (int i = 0; i < n; ++i) {
-        DBOperation& op = ops[i % ops.size()];
-        // op.op = 1;
-        if (op.op == 0) {
-            status = db->Get(read_options, op.target, &value);
-        } else if (op.op == 1) {
-            value = values.substr(0, value_size);
-            status = db->Put(write_options, op.target, value);
-        } else if (op.op == 2) {
-            db_iter->Seek(op.target);
-            for (int r = 0; r < op.sub_field; ++r) {
-                if (!db_iter->Valid()) break;
-                value = db_iter->value().ToString();
-                db_iter->Next();
-            }
-        } else {
-            assert(false && "Unknown OpCode");
+    // Every thread replays its own contiguous slice of the trace, so that the
+    // keys a scan or a hot range touches stay on one thread. In open-loop mode
+    // requests arrive at fixed intervals whether or not the thread keeps up.
+    // None is skipped, and latency is measured from the intended arrival, so
+    // the time a request spends waiting behind slow ones counts. Once
+    // queue_depth requests are outstanding, reads are no longer held back to
+    // fill a MultiGet batch.
+    vector<WorkerResult> results(num_threads);
+    auto worker = [&](int tid, bool spawned) {
+#ifdef JL_LIBCFS
+        if (spawned) fs_init_thread_local_mem();
+#endif
+        if (core_base > 0) pin_to_cpu_core(core_base + tid);
+
+        WorkerResult& res = results[tid];
+        size_t begin = ops.size() * tid / num_threads;
+        size_t slice = ops.size() * (tid + 1) / num_threads - begin;
+        uint64_t count = n / num_threads + (tid < n % num_threads ? 1 : 0);
+        if (!generated && slice == 0) return;
+        std::unique_ptr<YcsbGenerator> generator;
+        if (generated) generator.reset(new YcsbGenerator(generated.get(), db_offset * 1000 + tid));
+        string key_buffer(key_size, '0');
+        uint64_t interval = 0;
+        if (target_ops > 0) {
+            interval = Timer::TicksPerSecond() * num_threads / target_ops;
+            if (interval == 0) interval = 1;
         }
-        assert(status.ok() && "Operation not OK");
-        if (debug) {
-            if (status.ok()) {
-                printf("operation %d finished %d, %s\n", i, op.op, op.target.c_str());
+
+        string value;
+        Status status;
+        // Batched-read mode: reads queue up here, with the time each was
+        // issued, until there are multiget_batch of them to look up together.
+        vector<string> batch_keys;
+        vector<uint64_t> batch_issue;
+        vector<string> batch_values;
+        auto flush_reads = [&]() {
+            if (batch_keys.empty()) return;
+            vector<Slice> batch(batch_keys.begin(), batch_keys.end());
+            vector<Status> statuses = db->MultiGet(read_options, batch, &batch_values);
+            uint64_t done = Timer::Now();
+            for (size_t b = 0; b < statuses.size(); ++b) {
+                instance->RecordLatency(0, done - batch_issue[b]);
+                res.finished++;
+                assert((statuses[b].ok() || (generator && statuses[b].IsNotFound())) && "Operation not OK");
+                if (debug && !statuses[b].ok() && !statuses[b].IsNotFound()) {
+                    printf("thread %d read failed %s\n", tid, batch_keys[b].c_str());
+                    throw std::runtime_error("operation failed");
+                }
+            }
+            batch_keys.clear();
+            batch_issue.clear();
+        };
+        instance->StartTimer(1);
+        uint64_t start = Timer::Now();
+        for (uint64_t i = 0; i < count; ++i) {
+            uint64_t issue = Timer::Now();
+            uint64_t outstanding = 0;  // Arrived but unfinished, this request included
+            if (interval > 0) {
+                uint64_t arrival = start + i * interval;
+                while (issue < arrival) {
+                    // Leave the core to other threads unless the arrival is close.
+                    if (arrival - issue > 10 * Timer::TicksPerMicro()) {
+                        std::this_thread::yield();
+                    } else {
+                        _mm_pause();
+                    }
+                    issue = Timer::Now();
+                }
+                res.max_lag = std::max(res.max_lag, issue - arrival);
+                // Requests 0..i-1 are finished or waiting in the batch.
+                uint64_t arrived = std::min(count, (issue - start) / interval + 1);
+                outstanding = arrived - i + batch_keys.size();
+                res.max_outstanding = std::max(res.max_outstanding, outstanding);
+                issue = arrival;
+            }
+
+            Slice target;
+            uint32_t op, sub_field;
+            if (generator) {
+                YcsbOperation next = generator->Next();
+                op = next.op;
+                sub_field = next.scan_length;
+                FormatKey(next.key, &key_buffer[0], key_size);
+                target = key_buffer;
+            } else {
+                const TraceRecord& record = ops[begin + i % slice];
+                op = record.op;
+                sub_field = record.sub_field;
+                target = ops.Key(record);
+            }
+            if (op == 0 && multiget_batch > 1) {
+                batch_keys.emplace_back(target.data(), target.size());
+                batch_issue.push_back(issue);
+                if (batch_keys.size() == static_cast<size_t>(multiget_batch) ||
+                    outstanding >= static_cast<uint64_t>(queue_depth)) {
+                    flush_reads();
+                }
+                continue;
+            }
+            // Reads queued before any other operation finish before it starts.
+            flush_reads();
+            if (op == 0) {
+                status = db->Get(read_options, target, &value);
+            } else if (op == 1) {
+                value = values.substr(0, value_size);
+                status = db->Put(write_options, target, value);
+            } else if (op == 2) {
+                // A fresh iterator per scan, as YCSB does, so that scans see
+                // the keys written since the last one and no snapshot is held
+                // between operations.
+                Iterator* db_iter = db->NewIterator(read_options);
+                db_iter->Seek(target);
+                for (uint32_t r = 0; r < sub_field; ++r) {
+                    if (!db_iter->Valid()) break;
+                    value = db_iter->value().ToString();
+                    db_iter->Next();
+                }
+                status = db_iter->status();
+                delete db_iter;
+            } else if (op == 3) {
+                status = db->Get(read_options, target, &value);
+                if (status.ok() || status.IsNotFound()) {
+                    value = values.substr(0, value_size);
+                    status = db->Put(write_options, target, value);
+                }
             } else {
-                printf("operation %d failed %d, %s\n", i, op.op, op.target.c_str());
-                throw std::runtime_error("operation failed");
+                assert(false && "Unknown OpCode");
+            }
+            uint64_t latency = Timer::Now() - issue;
+            instance->RecordLatency(op, latency);
+            res.finished++;
+            if (print_single_timing) {
+                printf("thread %d operation %lu type %d latency %.2f us\n", tid, i, op,
+                       Timer::ToNanos(latency) / 1000.0);
+            }
+            // Generated reads may miss, as in YCSB.
+            if (generator && status.IsNotFound()) status = Status::OK();
+            assert(status.ok() && "Operation not OK");
+            if (debug) {
+                if (status.ok()) {
+                    printf("thread %d operation %lu finished %d, %s\n", tid, i, op, target.ToString().c_str());
+                } else {
+                    printf("thread %d operation %lu failed %d, %s\n", tid, i, op, target.ToString().c_str());
+                    throw std::runtime_error("operation failed");
+                }
             }
         }
+        flush_reads();
+        instance->PauseTimer(1);
+    };
+
+    cerr << "Start running " << n << " operations on " << num_threads << " threads at " << db_location << (generated ? " generating workload " + workload : " op_file_size " + to_string(ops.size())) << endl;
+    instance->StartTimer(0);
+    if (num_threads == 1) {
+        worker(0, false);
+    } else {
+        vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t) {
+            threads.emplace_back(worker, t, true);
+        }
+        for (std::thread& t : threads) t.join();
     }
     instance->PauseTimer(0);
 
     instance->ReportTime();
 
+    instance->ReportLatency();
+    if (!latency_dump.empty() && !instance->DumpLatency(latency_dump)) {
+        cerr << "cannot write latency histograms to " << latency_dump << endl;
+    }
+
+    uint64_t finished = 0, max_lag = 0, max_outstanding = 0;
+    for (WorkerResult& res : results) {
+        finished += res.finished;
+        max_lag = std::max(max_lag, res.max_lag);
+        max_outstanding = std::max(max_outstanding, res.max_outstanding);
+    }
+    LatencyHistogram latencies = instance->MergedLatency(Stats::num_latency_types);
+    auto percentile = [&latencies](double p) {
+        return Timer::ToNanos(latencies.Percentile(p)) / 1000.0;
+    };
+    double seconds = instance->ReportTime(0) / 1e6;
+    printf("Threads %d finished %lu in %.3f s, throughput %.1f ops/s\n",
+           num_threads, finished, seconds, seconds > 0 ? finished / seconds : 0.0);
+    if (target_ops > 0) {
+        printf("Open loop: target %lu ops/s, fell behind schedule by up to %.2f us, up to %lu requests outstanding\n",
+               target_ops, Timer::ToNanos(max_lag) / 1000.0, max_outstanding);
+    }
+    printf("Latency (us) p50 %.2f p99 %.2f p999 %.2f\n", percentile(0.5), percentile(0.99), percentile(0.999));
+    if (cache_stats) {
+        string cache_stats_str;
+        if (db->GetProperty("leveldb.block-cache-stats", &cache_stats_str)) {
+            printf("%s", cache_stats_str.c_str());
+        }
+    }
+    fflush(stdout);
+
     sleep(5);
     delete db;
+    delete options.block_cache;
+    delete options.filter_policy;
 
 #ifdef JL_LIBCFS
     if (db_offset == 1) {
@@ -0,0 +1,89 @@
+//
+// Log-linear latency histogram, in the spirit of HdrHistogram.
+//
+
+#include "latency_histogram.h"
+#include <cstring>
+#include "util/coding.h"
+
+
+namespace adgMod {
+
+    void WriteFixed64(FILE* file, uint64_t value) {
+        char buf[sizeof(value)];
+        leveldb::EncodeFixed64(buf, value);
+        fwrite(buf, sizeof(buf), 1, file);
+    }
+
+    LatencyHistogram::LatencyHistogram() {
+        Reset();
+    }
+
+    void LatencyHistogram::Merge(const LatencyHistogram& other) {
+        for (int i = 0; i < num_buckets; ++i) counts[i] += other.counts[i];
+        total_count += other.total_count;
+        if (other.min_value < min_value) min_value = other.min_value;
+        if (other.max_value > max_value) max_value = other.max_value;
+    }
+
+    void LatencyHistogram::Reset() {
+        memset(counts, 0, sizeof(counts));
+        total_count = 0;
+        min_value = UINT64_MAX;
+        max_value = 0;
+    }
+
+    double LatencyHistogram::Mean() const {
+        if (total_count == 0) return 0;
+        double sum = 0;
+        for (int i = 0; i < num_buckets; ++i) {
+            if (counts[i] == 0) continue;
+            // The middle of the bucket.
+            sum += (LowerBound(i) + (UpperBound(i) - LowerBound(i)) / 2.0) * counts[i];
+        }
+        return sum / total_count;
+    }
+
+    uint64_t LatencyHistogram::Percentile(double p) const {
+        if (total_count == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(p * total_count);
+        if (rank < 1) rank = 1;
+        if (rank > total_count) rank = total_count;
+        uint64_t seen = 0;
+        for (int i = 0; i < num_buckets; ++i) {
+            seen += counts[i];
+            if (seen >= rank) {
+                uint64_t value = UpperBound(i);
+                return value < max_value ? value : max_value;
+            }
+        }
+        return max_value;
+    }
+
+    void LatencyHistogram::Dump(FILE* file) const {
+        uint64_t non_empty = 0;
+        for (int i = 0; i < num_buckets; ++i) {
+            if (counts[i] != 0) non_empty++;
+        }
+        WriteFixed64(file, non_empty);
+        for (int i = 0; i < num_buckets; ++i) {
+            if (counts[i] == 0) continue;
+            WriteFixed64(file, LowerBound(i));
+            WriteFixed64(file, counts[i]);
+        }
+    }
+
+    uint64_t LatencyHistogram::LowerBound(int bucket) {
+        if (bucket < sub_bucket_count) return bucket;
+        int shift = (bucket >> sub_bucket_bits) - 1;
+        uint64_t sub = (bucket & (sub_bucket_count - 1)) + sub_bucket_count;
+        return sub << shift;
+    }
+
+    uint64_t LatencyHistogram::UpperBound(int bucket) {
+        if (bucket < sub_bucket_count) return bucket;
+        int shift = (bucket >> sub_bucket_bits) - 1;
+        return LowerBound(bucket) + ((uint64_t{1} << shift) - 1);
+    }
+
+}
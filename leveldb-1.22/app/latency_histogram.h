@@ -0,0 +1,71 @@
+//
+// Log-linear latency histogram, in the spirit of HdrHistogram.
+//
+
+#ifndef LEVELDB_LATENCY_HISTOGRAM_H
+#define LEVELDB_LATENCY_HISTOGRAM_H
+
+
+#include <cstdint>
+#include <cstdio>
+
+
+namespace adgMod {
+
+    // Writes "value" to "file" as 8 little-endian bytes, whatever the host.
+    void WriteFixed64(FILE* file, uint64_t value);
+
+    // Values below 2^sub_bucket_bits get a bucket each; above that, every
+    // power of two is split into 2^sub_bucket_bits equal buckets, so any value
+    // is known to within 1/2^sub_bucket_bits (about 1.6%) of itself.
+    // Recording is a count leading zeros and an increment, cheap enough for
+    // microsecond operations. Not thread-safe: keep one per thread and Merge().
+    class LatencyHistogram {
+    public:
+        static const int sub_bucket_bits = 6;
+        static const int sub_bucket_count = 1 << sub_bucket_bits;
+        static const int num_buckets = (64 - sub_bucket_bits + 1) * sub_bucket_count;
+
+        LatencyHistogram();
+
+        void Record(uint64_t value) {
+            counts[BucketOf(value)]++;
+            total_count++;
+            if (value < min_value) min_value = value;
+            if (value > max_value) max_value = value;
+        }
+
+        void Merge(const LatencyHistogram& other);
+        void Reset();
+
+        uint64_t Count() const { return total_count; }
+        uint64_t Min() const { return total_count == 0 ? 0 : min_value; }
+        uint64_t Max() const { return max_value; }
+        double Mean() const;
+        // Smallest recorded value v such that a fraction "p" of the values
+        // are <= v, to within the bucket precision.
+        uint64_t Percentile(double p) const;
+
+        // Appends the non-empty buckets as (lower bound, count) pairs of
+        // little-endian uint64_t, preceded by their number.
+        void Dump(FILE* file) const;
+
+        static int BucketOf(uint64_t value) {
+            if (value < sub_bucket_count) return static_cast<int>(value);
+            int shift = 63 - __builtin_clzll(value) - sub_bucket_bits;
+            return ((shift + 1) << sub_bucket_bits) + static_cast<int>((value >> shift) - sub_bucket_count);
+        }
+        static uint64_t LowerBound(int bucket);
+        static uint64_t UpperBound(int bucket);
+
+    private:
+        uint64_t counts[num_buckets];
+        uint64_t total_count;
+        uint64_t min_value;
+        uint64_t max_value;
+    };
+
+}
+
+
+#endif //LEVELDB_LATENCY_HISTOGRAM_H
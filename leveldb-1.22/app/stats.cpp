@@ -6,7 +6,6 @@
 #include "stats.h"
 #include <cmath>
 #include <iostream>
-#include <x86intrin.h>
 
 using std::stoull;
 
@@ -14,40 +13,107 @@ namespace adgMod {
 
     Stats* Stats::singleton = nullptr;
 
-    Stats::Stats() : timers(20, Timer{}), initial_time(__rdtsc()) {}
+    static const int num_timers = 20;
+
+    const char* const Stats::latency_type_names[Stats::num_latency_types] = {"Get", "Put", "Scan", "RMW"};
+
+    Stats::Stats() : initial_time(Timer::Now()) {}
 
     Stats* Stats::GetInstance() {
         if (!singleton) singleton = new Stats();
         return singleton;
     }
 
+    Stats::ThreadStats& Stats::Local() {
+        thread_local ThreadStats* local = nullptr;
+        if (!local) {
+            local = new ThreadStats{std::vector<Timer>(num_timers, Timer{})};
+            std::lock_guard<std::mutex> guard(mutex);
+            threads.push_back(local);
+        }
+        return *local;
+    }
+
     void Stats::StartTimer(uint32_t id) {
-        Timer& timer = timers[id];
+        Timer& timer = Local().timers[id];
         timer.Start();
     }
 
     std::pair<uint64_t, uint64_t> Stats::PauseTimer(uint32_t id, bool record) {
-        Timer& timer = timers[id];
+        Timer& timer = Local().timers[id];
         return timer.Pause(record);
     }
 
     void Stats::ResetTimer(uint32_t id) {
-        Timer& timer = timers[id];
+        Timer& timer = Local().timers[id];
         timer.Reset();
     }
 
     uint64_t Stats::ReportTime(uint32_t id) {
-        Timer& timer = timers[id];
-        return timer.Time();
+        std::lock_guard<std::mutex> guard(mutex);
+        uint64_t total = 0;
+        for (ThreadStats* thread : threads) {
+            total += thread->timers[id].Time();
+        }
+        return total;
     }
 
     void Stats::ReportTime() {
-        for (int i = 0; i < timers.size(); ++i) {
-            printf("Timer %u: %lu\n", i, timers[i].Time());
+        std::lock_guard<std::mutex> guard(mutex);
+        for (int i = 0; i < num_timers; ++i) {
+            uint64_t total = 0;
+            for (ThreadStats* thread : threads) {
+                total += thread->timers[i].Time();
+            }
+            printf("Timer %u: %lu\n", i, total);
+            if (threads.size() > 1 && total > 0) {
+                for (size_t t = 0; t < threads.size(); ++t) {
+                    printf("  thread %lu: %lu\n", t, threads[t]->timers[i].Time());
+                }
+            }
         }
         fflush(stdout);
     }
 
+    LatencyHistogram Stats::MergedLatency(uint32_t type) {
+        std::lock_guard<std::mutex> guard(mutex);
+        LatencyHistogram merged;
+        for (ThreadStats* thread : threads) {
+            for (uint32_t t = 0; t < num_latency_types; ++t) {
+                if (t == type || type == num_latency_types) merged.Merge(thread->latencies[t]);
+            }
+        }
+        return merged;
+    }
+
+    void Stats::ReportLatency() {
+        for (uint32_t type = 0; type <= num_latency_types; ++type) {
+            LatencyHistogram merged = MergedLatency(type);
+            if (merged.Count() == 0) continue;
+            double f = Timer::TicksPerMicro();
+            printf("Latency %s (us): count %lu mean %.2f min %.2f p50 %.2f p90 %.2f p99 %.2f p999 %.2f max %.2f\n",
+                   type == num_latency_types ? "All" : latency_type_names[type], merged.Count(), merged.Mean() / f,
+                   merged.Min() / f, merged.Percentile(0.5) / f, merged.Percentile(0.9) / f,
+                   merged.Percentile(0.99) / f, merged.Percentile(0.999) / f, merged.Max() / f);
+        }
+        fflush(stdout);
+    }
+
+    bool Stats::DumpLatency(const std::string& filename) {
+        FILE* file = fopen(filename.c_str(), "wb");
+        if (!file) return false;
+        fwrite("ADGLAT01", 8, 1, file);
+        WriteFixed64(file, Timer::TicksPerSecond());
+        WriteFixed64(file, LatencyHistogram::sub_bucket_bits);
+        WriteFixed64(file, num_latency_types);
+        for (uint64_t type = 0; type < num_latency_types; ++type) {
+            WriteFixed64(file, type);
+            MergedLatency(type).Dump(file);
+        }
+        bool ok = !ferror(file);
+        return fclose(file) == 0 && ok;
+    }
+
 
 
 
@@ -56,15 +122,17 @@ namespace adgMod {
 
 
     uint64_t Stats::GetTime() {
-        unsigned int dummy = 0;
-        uint64_t time_elapse = __rdtscp(&dummy) - initial_time;
-        return time_elapse / Timer::reference_frequency;
+        return Timer::ToMicros(Timer::Now() - initial_time);
     }
 
 
     void Stats::ResetAll() {
-        for (Timer& t: timers) t.Reset();
-        initial_time = __rdtsc();
+        std::lock_guard<std::mutex> guard(mutex);
+        for (ThreadStats* thread : threads) {
+            for (Timer& t: thread->timers) t.Reset();
+            for (LatencyHistogram& h: thread->latencies) h.Reset();
+        }
+        initial_time = Timer::Now();
     }
 
     Stats::~Stats() {
@@ -6,10 +6,14 @@
 #define LEVELDB_STATS_H
 
 
+#include <cassert>
 #include <cstdint>
 #include <map>
+#include <mutex>
+#include <string>
 #include <vector>
 #include <cstring>
+#include "latency_histogram.h"
 #include "timer.h"
 
 
@@ -17,11 +21,25 @@ namespace adgMod {
 
     class Timer;
     class Stats {
+    public:
+        // Operation types for RecordLatency(), numbered like the trace opcodes
+        // (Get, Put, Scan), plus read-modify-write for generated workloads.
+        static const uint32_t num_latency_types = 4;
+        static const char* const latency_type_names[num_latency_types];
+
     private:
         static Stats* singleton;
         Stats();
 
-        std::vector<Timer> timers;
+        // Every thread gets its own timers and histograms, created on first
+        // use and never freed, so that they can still be reported after it exits.
+        struct ThreadStats {
+            std::vector<Timer> timers;
+            LatencyHistogram latencies[num_latency_types];
+        };
+        std::mutex mutex;
+        std::vector<ThreadStats*> threads;
+        ThreadStats& Local();
     public:
         uint64_t initial_time;
 
@@ -29,10 +47,29 @@ namespace adgMod {
         void StartTimer(uint32_t id);
         std::pair<uint64_t, uint64_t> PauseTimer(uint32_t id, bool record = false);
         void ResetTimer(uint32_t id);
+        // Sum of timer "id" over all threads.
         uint64_t ReportTime(uint32_t id);
         void ReportTime();
 
+        // Records that an operation of "type" took "ticks" Timer ticks.
+        void RecordLatency(uint32_t type, uint64_t ticks) {
+            assert(type < num_latency_types);
+            Local().latencies[type].Record(ticks);
+        }
+        // Histogram of "type" over all threads; num_latency_types merges
+        // every type.
+        LatencyHistogram MergedLatency(uint32_t type);
+        // Prints count, mean and percentiles, in microseconds, per type.
+        void ReportLatency();
+        // Writes the merged histograms to "filename" for offline plotting:
+        // the magic "ADGLAT01", then uint64_t Timer ticks per second,
+        // sub_bucket_bits and number of types, then per type its number
+        // followed by LatencyHistogram::Dump(). All integers are little-endian
+        // uint64_t. Returns false on I/O errors.
+        bool DumpLatency(const std::string& filename);
+
         uint64_t GetTime();
+        // Not safe to call while other threads are timing.
         void ResetAll();
         ~Stats();
     };
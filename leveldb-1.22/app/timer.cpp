@@ -5,32 +5,84 @@
 #include "timer.h"
 #include "stats.h"
 #include <cassert>
-#include <x86intrin.h>
+#include <cpuid.h>
 
 
 namespace adgMod {
 
+    static uint64_t MonotonicRawNanos() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+
+    // Only an invariant TSC ticks at a constant rate across P-, C- and
+    // T-states, and is synchronized between cores.
+    static bool HasInvariantTsc() {
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) return false;
+        return (edx & (1u << 8)) != 0;
+    }
+
+    // CPUID leaf 0x15 gives the TSC frequency as a ratio of the crystal clock,
+    // when the CPU enumerates the crystal frequency. Returns 0 otherwise.
+    static uint64_t TscFrequencyFromCpuid() {
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(0x15, &eax, &ebx, &ecx, &edx)) return 0;
+        if (eax == 0 || ebx == 0 || ecx == 0) return 0;
+        return static_cast<uint64_t>(ecx) * ebx / eax;
+    }
+
+    // Counts TSC cycles over about 20ms of CLOCK_MONOTONIC_RAW.
+    static uint64_t MeasureTscFrequency() {
+        unsigned int dummy = 0;
+        uint64_t ns_start = MonotonicRawNanos();
+        uint64_t tsc_start = __rdtscp(&dummy);
+        uint64_t ns_end, tsc_end;
+        do {
+            ns_end = MonotonicRawNanos();
+            tsc_end = __rdtscp(&dummy);
+        } while (ns_end - ns_start < 20000000);
+        return static_cast<uint64_t>((static_cast<unsigned __int128>(tsc_end - tsc_start) * 1000000000) / (ns_end - ns_start));
+    }
+
+    Timer::Calibration Timer::Calibrate() {
+        Calibration result;
+        result.use_tsc = HasInvariantTsc();
+        result.ticks_per_second = 1000000000;
+        if (result.use_tsc) {
+            uint64_t frequency = TscFrequencyFromCpuid();
+            if (frequency == 0) frequency = MeasureTscFrequency();
+            if (frequency == 0) {
+                result.use_tsc = false;
+            } else {
+                result.ticks_per_second = frequency;
+            }
+        }
+        result.micros_factor = (static_cast<unsigned __int128>(1000000) << conversion_shift) / result.ticks_per_second;
+        result.nanos_factor = (static_cast<unsigned __int128>(1000000000) << conversion_shift) / result.ticks_per_second;
+        return result;
+    }
+
     Timer::Timer() : time_accumulated(0), started(false) {}
 
     void Timer::Start() {
         assert(!started);
-        unsigned int dummy = 0;
-        time_started = __rdtscp(&dummy);
+        time_started = Now();
         started = true;
     }
 
     std::pair<uint64_t, uint64_t> Timer::Pause(bool record) {
         assert(started);
-        unsigned int dummy = 0;
-        uint64_t time_elapse = __rdtscp(&dummy) - time_started;
-        time_accumulated += time_elapse / reference_frequency;
+        uint64_t time_elapse = Now() - time_started;
+        time_accumulated += time_elapse;
 
         if (record) {
             Stats* instance = Stats::GetInstance();
             uint64_t start_absolute = time_started - instance->initial_time;
             uint64_t end_absolute = start_absolute + time_elapse;
             started = false;
-            return {start_absolute / reference_frequency, end_absolute / reference_frequency};
+            return {ToMicros(start_absolute), ToMicros(end_absolute)};
         } else {
             started = false;
             return {0, 0};
@@ -44,6 +96,6 @@ namespace adgMod {
 
     uint64_t Timer::Time() {
         //assert(!started);
-        return time_accumulated;
+        return ToMicros(time_accumulated);
     }
 }
\ No newline at end of file
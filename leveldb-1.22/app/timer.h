@@ -10,20 +10,60 @@
 #include <ctime>
 #include <utility>
 #include <vector>
+#include <x86intrin.h>
 
 namespace adgMod {
 
     class Timer {
         uint64_t time_started;
-        uint64_t time_accumulated;
+        uint64_t time_accumulated;  // in ticks
         bool started;
 
+        // Measured on first use, which may busy-wait for about 20ms; see
+        // timer.cpp.
+        struct Calibration {
+            bool use_tsc;
+            uint64_t ticks_per_second;
+            // Fixed-point factors: x ticks are (x * factor) >> conversion_shift
+            // microseconds or nanoseconds.
+            uint64_t micros_factor;
+            uint64_t nanos_factor;
+        };
+        static const int conversion_shift = 32;
+        static Calibration Calibrate();
+        static const Calibration& GetCalibration() {
+            static const Calibration calibration = Calibrate();
+            return calibration;
+        }
+
+        static uint64_t Convert(uint64_t ticks, uint64_t factor) {
+            return static_cast<uint64_t>((static_cast<unsigned __int128>(ticks) * factor) >> conversion_shift);
+        }
+
     public:
-        static const uint64_t reference_frequency = 2900;
-        
+        // The current time in ticks. Ticks are TSC cycles when the CPU has an
+        // invariant TSC, and CLOCK_MONOTONIC_RAW nanoseconds otherwise.
+        static uint64_t Now() {
+            if (GetCalibration().use_tsc) {
+                unsigned int dummy = 0;
+                return __rdtscp(&dummy);
+            }
+            timespec ts;
+            clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+            return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+        }
+        static uint64_t ToMicros(uint64_t ticks) { return Convert(ticks, GetCalibration().micros_factor); }
+        static uint64_t ToNanos(uint64_t ticks) { return Convert(ticks, GetCalibration().nanos_factor); }
+        static uint64_t TicksPerSecond() { return GetCalibration().ticks_per_second; }
+        static double TicksPerMicro() { return GetCalibration().ticks_per_second / 1e6; }
+        static bool UsesTsc() { return GetCalibration().use_tsc; }
+
         void Start();
+        // Returns the start and end of the interval, in microseconds since
+        // Stats::initial_time, if "record" is set.
         std::pair<uint64_t, uint64_t> Pause(bool record = false);
         void Reset();
+        // Accumulated time in microseconds.
         uint64_t Time();
 
         Timer();
@@ -0,0 +1,175 @@
+//
+// Operation traces for do_work, in text or binary form.
+//
+
+#include "trace.h"
+#include "stats.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+
+namespace adgMod {
+
+    static const char trace_magic[8] = {'A', 'D', 'G', 'T', 'R', 'C', '0', '1'};
+
+    std::string FormatString(const std::string& original, int size) {
+        if (original.length() < size) {
+            return std::string(size - original.length(), '0') + original;
+        } else {
+            return original.substr(original.length() - size);
+        }
+    }
+
+    Trace::Trace() : records(nullptr), num_records(0), keys(nullptr), key_size(0),
+                     mapping(nullptr), mapping_size(0) {}
+
+    Trace::~Trace() {
+        if (mapping) munmap(mapping, mapping_size);
+    }
+
+    bool Trace::Open(const std::string& filename, int key_size, uint64_t max_records, std::string* error) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            *error = filename + ": " + strerror(errno);
+            return false;
+        }
+        char magic[sizeof(trace_magic)];
+        bool binary = pread(fd, magic, sizeof(magic), 0) == sizeof(magic) &&
+                      memcmp(magic, trace_magic, sizeof(magic)) == 0;
+        bool ok = binary ? OpenBinary(fd, max_records, error)
+                         : OpenText(filename, key_size, max_records, error);
+        close(fd);
+        return ok;
+    }
+
+    bool Trace::OpenBinary(int fd, uint64_t max_records, std::string* error) {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            *error = strerror(errno);
+            return false;
+        }
+        size_t file_size = st.st_size;
+        if (file_size < sizeof(TraceHeader)) {
+            *error = "truncated trace header";
+            return false;
+        }
+        // Shared, so that every process replaying the trace uses the same
+        // page cache pages.
+        void* base = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+            *error = std::string("mmap: ") + strerror(errno);
+            return false;
+        }
+        mapping = base;
+        mapping_size = file_size;
+
+        const TraceHeader* header = static_cast<const TraceHeader*>(base);
+        size_t body_size = file_size - sizeof(TraceHeader);
+        if (header->key_size == 0 || header->num_records > body_size / sizeof(TraceRecord)) {
+            *error = "truncated or corrupted trace";
+            return false;
+        }
+        uint64_t records_size = header->num_records * sizeof(TraceRecord);
+        uint64_t arena_size = header->arena_size;
+        if (arena_size > body_size - records_size) {
+            *error = "truncated or corrupted trace";
+            return false;
+        }
+        const TraceRecord* loaded = reinterpret_cast<const TraceRecord*>(static_cast<const char*>(base) + sizeof(TraceHeader));
+        uint64_t num_loaded = header->num_records < max_records ? header->num_records : max_records;
+        // Every key must lie within the arena, so that Key() stays inside
+        // the mapping, and every op must be one the replay can record.
+        for (uint64_t i = 0; i < num_loaded; i++) {
+            if (loaded[i].key_offset > arena_size || arena_size - loaded[i].key_offset < header->key_size) {
+                *error = "record " + std::to_string(i) + " has a key outside the key arena";
+                return false;
+            }
+            if (loaded[i].op >= Stats::num_latency_types) {
+                *error = "record " + std::to_string(i) + " has unknown op " + std::to_string(loaded[i].op);
+                return false;
+            }
+        }
+        records = loaded;
+        num_records = num_loaded;
+        keys = static_cast<const char*>(base) + sizeof(TraceHeader) + records_size;
+        key_size = header->key_size;
+        return true;
+    }
+
+    bool Trace::OpenText(const std::string& filename, int key_size, uint64_t max_records, std::string* error) {
+        if (key_size <= 0) {
+            *error = "key size must be positive";
+            return false;
+        }
+        std::ifstream input(filename);
+        if (!input) {
+            *error = filename + ": cannot open";
+            return false;
+        }
+        uint32_t op;
+        std::string key;
+        while (parsed_records.size() < max_records && input >> op >> key) {
+            if (op >= Stats::num_latency_types) {
+                *error = "record " + std::to_string(parsed_records.size()) + " has unknown op " + std::to_string(op);
+                return false;
+            }
+            TraceRecord record;
+            memset(&record, 0, sizeof(record));
+            record.op = op;
+            if (op == 2) input >> record.sub_field;
+            record.key_offset = parsed_keys.size();
+            parsed_keys.append(FormatString(key, key_size));
+            parsed_records.push_back(record);
+        }
+        records = parsed_records.data();
+        num_records = parsed_records.size();
+        keys = parsed_keys.data();
+        this->key_size = key_size;
+        return true;
+    }
+
+    bool Trace::WriteBinary(const std::string& filename, std::string* error) const {
+        std::vector<TraceRecord> out_records(records, records + num_records);
+        std::string arena;
+        std::unordered_map<std::string, uint64_t> offsets;
+        for (TraceRecord& record : out_records) {
+            std::string key = Key(record).ToString();
+            auto it = offsets.find(key);
+            if (it == offsets.end()) {
+                it = offsets.emplace(key, arena.size()).first;
+                arena.append(key);
+            }
+            record.key_offset = it->second;
+        }
+
+        TraceHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, trace_magic, sizeof(trace_magic));
+        header.key_size = key_size;
+        header.num_records = out_records.size();
+        header.arena_size = arena.size();
+
+        FILE* file = fopen(filename.c_str(), "wb");
+        if (!file) {
+            *error = filename + ": " + strerror(errno);
+            return false;
+        }
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(out_records.data(), sizeof(TraceRecord), out_records.size(), file);
+        fwrite(arena.data(), 1, arena.size(), file);
+        bool ok = !ferror(file);
+        if (fclose(file) != 0 || !ok) {
+            *error = filename + ": write failed";
+            return false;
+        }
+        return true;
+    }
+
+}
@@ -0,0 +1,93 @@
+//
+// Operation traces for do_work, in text or binary form.
+//
+
+#ifndef LEVELDB_TRACE_H
+#define LEVELDB_TRACE_H
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "leveldb/slice.h"
+
+
+namespace adgMod {
+
+    // A binary trace file is a TraceHeader, then num_records TraceRecords,
+    // then a key arena of arena_size bytes holding keys of key_size bytes
+    // each. Records point into the arena, so repeated keys are stored once.
+    // All integers are little-endian.
+    struct TraceHeader {
+        char magic[8];  // "ADGTRC01"
+        uint32_t key_size;
+        uint32_t reserved;
+        uint64_t num_records;
+        uint64_t arena_size;
+    };
+
+    struct TraceRecord {
+        uint8_t op;  // 0 Get, 1 Put, 2 Scan, 3 read-modify-write
+        uint8_t reserved[3];
+        uint32_t sub_field;  // Number of entries to scan
+        uint64_t key_offset;  // Into the key arena
+    };
+
+    static_assert(sizeof(TraceHeader) == 32, "unexpected TraceHeader layout");
+    static_assert(sizeof(TraceRecord) == 16, "unexpected TraceRecord layout");
+
+    // Pads "original" with leading zeros, or keeps its last "size" characters.
+    std::string FormatString(const std::string& original, int size);
+
+    // A read-only, random-access view of a trace.
+    //
+    // Binary traces are mmap()ed and used in place, so loading one costs no
+    // parsing, and co-located processes replaying the same trace share its
+    // pages. Text traces ("op key [scan length]" per line) are parsed into
+    // the same layout in memory, with keys padded to the requested size.
+    class Trace {
+    public:
+        Trace();
+        ~Trace();
+
+        Trace(const Trace&) = delete;
+        Trace& operator=(const Trace&) = delete;
+
+        // Loads at most "max_records" operations from "filename". "key_size"
+        // applies to text traces; binary traces carry their own. Returns false
+        // and fills in "error" if the file cannot be read, if it has an op
+        // outside [0, Stats::num_latency_types), or if a binary trace is
+        // truncated or has records whose keys lie outside its arena.
+        bool Open(const std::string& filename, int key_size, uint64_t max_records, std::string* error);
+
+        // Writes the trace in binary form, storing every distinct key once.
+        bool WriteBinary(const std::string& filename, std::string* error) const;
+
+        uint64_t size() const { return num_records; }
+        uint32_t KeySize() const { return key_size; }
+        // True for binary traces, whose key size is fixed by the file.
+        bool IsBinary() const { return mapping != nullptr; }
+        const TraceRecord& operator[](uint64_t i) const { return records[i]; }
+        leveldb::Slice Key(const TraceRecord& record) const {
+            return leveldb::Slice(keys + record.key_offset, key_size);
+        }
+
+    private:
+        bool OpenBinary(int fd, uint64_t max_records, std::string* error);
+        bool OpenText(const std::string& filename, int key_size, uint64_t max_records, std::string* error);
+
+        const TraceRecord* records;
+        uint64_t num_records;
+        const char* keys;
+        uint32_t key_size;
+
+        void* mapping;  // nullptr unless a binary trace is mapped
+        size_t mapping_size;
+        std::vector<TraceRecord> parsed_records;  // Text traces only
+        std::string parsed_keys;
+    };
+
+}
+
+
+#endif //LEVELDB_TRACE_H
@@ -0,0 +1,46 @@
+//
+// Converts a text trace for do_work into the binary trace format.
+//
+
+#include <iostream>
+#include "cxxopts.hpp"
+#include "trace.h"
+
+using namespace adgMod;
+using namespace std;
+
+int main(int argc, char *argv[]) {
+    int key_size;
+    uint64_t n;
+    string input_filename, output_filename;
+
+    cxxopts::Options commandline_options("trace_convert", "Convert a text trace into the binary trace format.");
+    commandline_options.add_options()
+            ("k,key_size", "the size of key", cxxopts::value<int>(key_size)->default_value("16"))
+            ("n,num_operation", "maximum number of operations to convert", cxxopts::value<uint64_t>(n)->default_value("18446744073709551615"))
+            ("f,input_file", "the text trace to read", cxxopts::value<string>(input_filename))
+            ("o,output_file", "the binary trace to write", cxxopts::value<string>(output_filename));
+
+    auto result = commandline_options.parse(argc, argv);
+    if (input_filename.empty() || output_filename.empty()) {
+        cerr << commandline_options.help() << endl;
+        return 1;
+    }
+
+    Trace trace;
+    string error;
+    if (!trace.Open(input_filename, key_size, n, &error)) {
+        cerr << error << endl;
+        return 1;
+    }
+    if (trace.IsBinary() && result.count("key_size") && static_cast<uint32_t>(key_size) != trace.KeySize()) {
+        cerr << input_filename << " is a binary trace with " << trace.KeySize() << "-byte keys; -k does not apply" << endl;
+        return 1;
+    }
+    if (!trace.WriteBinary(output_filename, &error)) {
+        cerr << error << endl;
+        return 1;
+    }
+    cerr << "Converted " << trace.size() << " operations to " << output_filename << endl;
+    return 0;
+}
@@ -0,0 +1,160 @@
+//
+// YCSB workload generator for do_work.
+//
+
+#include "ycsb.h"
+#include <cassert>
+#include <cmath>
+
+
+namespace adgMod {
+
+    FastRandom::FastRandom(uint64_t seed) {
+        // splitmix64, so that nearby seeds give unrelated sequences; the
+        // state of xorshift must not be 0.
+        uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        state = (z ^ (z >> 31)) | 1;
+    }
+
+    static double Zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; ++i) sum += 1 / std::pow(static_cast<double>(i), theta);
+        return sum;
+    }
+
+    ZipfianDistribution::ZipfianDistribution(uint64_t num_items, double theta)
+            : num_items(num_items), theta(theta), zetan(Zeta(num_items, theta)),
+              alpha(1 / (1 - theta)), half_pow_theta(std::pow(0.5, theta)) {
+        assert(num_items > 0 && theta > 0 && theta < 1);
+        eta = (1 - std::pow(2.0 / num_items, 1 - theta)) / (1 - Zeta(2, theta) / zetan);
+    }
+
+    uint64_t ZipfianDistribution::Next(FastRandom* rnd) const {
+        double u = rnd->NextDouble();
+        double uz = u * zetan;
+        if (uz < 1) return 0;
+        if (uz < 1 + half_pow_theta) return num_items > 1 ? 1 : 0;
+        uint64_t rank = static_cast<uint64_t>(num_items * std::pow(eta * u - eta + 1, alpha));
+        return rank < num_items ? rank : num_items - 1;
+    }
+
+    // 64-bit FNV-1a over the bytes of "value", which YCSB uses to scatter the
+    // popular zipfian ranks over the key space.
+    static uint64_t FnvHash(uint64_t value) {
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (int i = 0; i < 8; ++i) {
+            hash ^= value & 0xff;
+            hash *= 0x100000001B3ull;
+            value >>= 8;
+        }
+        return hash;
+    }
+
+    YcsbWorkload::YcsbWorkload(const YcsbSpec& spec)
+            : spec(spec),
+              // Only pay for the zeta sums of the distributions in use.
+              key_zipfian(spec.distribution == KeyDistribution::Uniform ? 1 : spec.record_count, spec.theta),
+              scan_zipfian(spec.scan_length_distribution == KeyDistribution::Zipfian ? spec.max_scan_length : 1,
+                           spec.theta),
+              next_insert(spec.load ? 0 : spec.record_count) {
+        double total = spec.read_ratio + spec.update_ratio + spec.scan_ratio + spec.insert_ratio + spec.rmw_ratio;
+        double weights[4] = {spec.read_ratio, spec.update_ratio, spec.scan_ratio, spec.insert_ratio};
+        double sum = 0;
+        for (int i = 0; i < 4; ++i) {
+            sum += weights[i];
+            cumulative[i] = sum / total;
+        }
+    }
+
+    bool YcsbWorkload::Preset(const std::string& name, YcsbSpec* spec) {
+        YcsbSpec preset;
+        preset.record_count = spec->record_count;
+        preset.read_ratio = 0;
+        if (name == "a") {
+            preset.read_ratio = 0.5;
+            preset.update_ratio = 0.5;
+        } else if (name == "b") {
+            preset.read_ratio = 0.95;
+            preset.update_ratio = 0.05;
+        } else if (name == "c") {
+            preset.read_ratio = 1;
+        } else if (name == "d") {
+            preset.read_ratio = 0.95;
+            preset.insert_ratio = 0.05;
+            preset.distribution = KeyDistribution::Latest;
+        } else if (name == "e") {
+            preset.scan_ratio = 0.95;
+            preset.insert_ratio = 0.05;
+        } else if (name == "f") {
+            preset.read_ratio = 0.5;
+            preset.rmw_ratio = 0.5;
+        } else if (name == "load") {
+            preset.insert_ratio = 1;
+            preset.distribution = KeyDistribution::Uniform;
+            preset.load = true;
+        } else {
+            return false;
+        }
+        *spec = preset;
+        return true;
+    }
+
+    YcsbGenerator::YcsbGenerator(YcsbWorkload* workload, uint64_t seed) : workload(workload), rnd(seed) {}
+
+    uint64_t YcsbGenerator::NextKey() {
+        const YcsbSpec& spec = workload->spec;
+        switch (spec.distribution) {
+            case KeyDistribution::Uniform:
+                return rnd.Uniform(spec.record_count);
+            case KeyDistribution::Zipfian:
+                return FnvHash(workload->key_zipfian.Next(&rnd)) % spec.record_count;
+            case KeyDistribution::Latest: {
+                // The popularity of the last records ranks by recency; the
+                // zipfian constants are those of the initial record count.
+                uint64_t newest = workload->next_insert.load(std::memory_order_relaxed);
+                uint64_t rank = workload->key_zipfian.Next(&rnd);
+                return rank < newest ? newest - 1 - rank : 0;
+            }
+        }
+        return 0;
+    }
+
+    YcsbOperation YcsbGenerator::Next() {
+        const YcsbSpec& spec = workload->spec;
+        YcsbOperation op;
+        op.scan_length = 0;
+        double choice = rnd.NextDouble();
+        if (choice < workload->cumulative[0]) {
+            op.op = 0;
+            op.key = NextKey();
+        } else if (choice < workload->cumulative[1]) {
+            op.op = 1;
+            op.key = NextKey();
+        } else if (choice < workload->cumulative[2]) {
+            op.op = 2;
+            op.key = NextKey();
+            if (spec.scan_length_distribution == KeyDistribution::Zipfian) {
+                op.scan_length = workload->scan_zipfian.Next(&rnd) + 1;
+            } else {
+                op.scan_length = rnd.Uniform(spec.max_scan_length) + 1;
+            }
+        } else if (choice < workload->cumulative[3]) {
+            op.op = 1;
+            op.key = workload->next_insert.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            op.op = 3;
+            op.key = NextKey();
+        }
+        return op;
+    }
+
+    void FormatKey(uint64_t key, char* out, int size) {
+        for (int i = size - 1; i >= 0; --i) {
+            out[i] = '0' + key % 10;
+            key /= 10;
+        }
+    }
+
+}
@@ -0,0 +1,128 @@
+//
+// YCSB workload generator for do_work.
+//
+
+#ifndef LEVELDB_YCSB_H
+#define LEVELDB_YCSB_H
+
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+
+namespace adgMod {
+
+    // Small, fast PRNG (xorshift64*); one per thread.
+    class FastRandom {
+        uint64_t state;
+
+    public:
+        explicit FastRandom(uint64_t seed);
+
+        uint64_t Next() {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            return state * 0x2545F4914F6CDD1Dull;
+        }
+        // Uniform in [0, 1).
+        double NextDouble() { return (Next() >> 11) * (1.0 / (1ull << 53)); }
+        // Uniform in [0, n).
+        uint64_t Uniform(uint64_t n) { return static_cast<uint64_t>((static_cast<unsigned __int128>(Next()) * n) >> 64); }
+    };
+
+    // Zipfian ranks in [0, num_items) following Gray et al., "Quickly
+    // Generating Billion-Record Synthetic Databases", as YCSB does. The
+    // constants are computed once, in O(num_items), by the constructor.
+    class ZipfianDistribution {
+        uint64_t num_items;
+        double theta;
+        double zetan;
+        double alpha;
+        double eta;
+        double half_pow_theta;
+
+    public:
+        // REQUIRES: num_items > 0, 0 < theta < 1
+        ZipfianDistribution(uint64_t num_items, double theta);
+
+        // Rank 0 is the most popular.
+        uint64_t Next(FastRandom* rnd) const;
+    };
+
+    enum class KeyDistribution { Uniform, Zipfian, Latest };
+
+    // Everything that describes a workload; see YcsbWorkload::Preset().
+    struct YcsbSpec {
+        uint64_t record_count = 1000000;
+        // Relative weights of the operation types; they need not sum to 1.
+        double read_ratio = 1;
+        double update_ratio = 0;
+        double scan_ratio = 0;
+        double insert_ratio = 0;
+        double rmw_ratio = 0;
+        KeyDistribution distribution = KeyDistribution::Zipfian;
+        double theta = 0.99;
+        uint32_t max_scan_length = 100;
+        KeyDistribution scan_length_distribution = KeyDistribution::Uniform;
+        // Inserts start at key 0 instead of after the records (the load phase).
+        bool load = false;
+    };
+
+    // One generated operation. "op" uses the trace opcodes (0 Get, 1 Put,
+    // 2 Scan) plus 3 for read-modify-write.
+    struct YcsbOperation {
+        uint32_t op;
+        uint32_t scan_length;
+        uint64_t key;
+    };
+
+    // The state shared by all threads generating one workload.
+    class YcsbWorkload {
+    public:
+        explicit YcsbWorkload(const YcsbSpec& spec);
+
+        YcsbWorkload(const YcsbWorkload&) = delete;
+        YcsbWorkload& operator=(const YcsbWorkload&) = delete;
+
+        // Fills "spec" with the standard YCSB core workload "name" ("a" to
+        // "f", or "load" for the insert-only load phase), leaving the record
+        // count alone. Returns false for unknown names.
+        static bool Preset(const std::string& name, YcsbSpec* spec);
+
+        const YcsbSpec& Spec() const { return spec; }
+
+    private:
+        friend class YcsbGenerator;
+
+        const YcsbSpec spec;
+        double cumulative[4];  // Read, update, scan and insert thresholds
+        ZipfianDistribution key_zipfian;
+        ZipfianDistribution scan_zipfian;
+        // The next key to insert; all keys below it exist (or are being
+        // inserted).
+        std::atomic<uint64_t> next_insert;
+    };
+
+    // Produces the operations of one thread, lazily. Not thread-safe.
+    class YcsbGenerator {
+        YcsbWorkload* workload;
+        FastRandom rnd;
+
+        uint64_t NextKey();
+
+    public:
+        YcsbGenerator(YcsbWorkload* workload, uint64_t seed);
+
+        YcsbOperation Next();
+    };
+
+    // Writes "key" as "size" decimal digits, zero-padded (or truncated to the
+    // last "size" digits), the same way text trace keys are formatted.
+    void FormatKey(uint64_t key, char* out, int size);
+
+}
+
+
+#endif //LEVELDB_YCSB_H
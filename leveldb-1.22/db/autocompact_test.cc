@@ -5,6 +5,7 @@
 #include "db/db_impl.h"
 #include "leveldb/cache.h"
 #include "leveldb/db.h"
+#include "util/random.h"
 #include "util/testharness.h"
 #include "util/testutil.h"
 
@@ -41,7 +42,27 @@ class AutoCompactTest {
     return size;
   }
 
+  // Compact the whole key space and return the number of compactions since
+  // the last open that were split into key ranges.
+  int CompactAll() {
+    db_->CompactRange(nullptr, nullptr);
+    return reinterpret_cast<DBImpl*>(db_)->TEST_SplitCompactions();
+  }
+
   void DoReads(int n);
+  // Returns the most compactions that ran at the same time while writing.
+  int DoOverwrites(const Options& options, int value_size = 100,
+                   int bands = 1);
+
+  void Reopen(const Options& options) {
+    delete db_;
+    db_ = nullptr;
+    options_.max_background_compactions = options.max_background_compactions;
+    options_.max_subcompactions = options.max_subcompactions;
+    options_.write_buffer_size = options.write_buffer_size;
+    options_.max_file_size = options.max_file_size;
+    ASSERT_OK(DB::Open(options_, dbname_, &db_));
+  }
 
  private:
   std::string dbname_;
@@ -107,6 +128,73 @@ TEST(AutoCompactTest, ReadAll) { DoReads(kCount); }
 
 TEST(AutoCompactTest, ReadHalf) { DoReads(kCount / 2); }
 
+// Overwrite and delete a small key space many times, so that many
+// compactions are needed, and check the result. The keys are written in
+// |bands| contiguous ranges, one after the other, so that compactions of the
+// ranges already written can run alongside those of the range being written.
+int AutoCompactTest::DoOverwrites(const Options& options, int value_size,
+                                  int bands) {
+  Reopen(options);
+
+  const int kKeys = 20000;
+  const int band_keys = kKeys / bands;
+  Random rnd(301);
+  std::vector<std::string> values(kKeys);
+  for (int band = 0; band < bands; band++) {
+    for (int round = 0; round < 5; round++) {
+      for (int i = band * band_keys; i < (band + 1) * band_keys; i++) {
+        if (round == 4 && i % 7 == 0) {
+          values[i].clear();
+          ASSERT_OK(db_->Delete(WriteOptions(), Key(i)));
+        } else {
+          test::RandomString(&rnd, value_size, &values[i]);
+          ASSERT_OK(db_->Put(WriteOptions(), Key(i), values[i]));
+        }
+      }
+    }
+  }
+
+  DBImpl* dbi = reinterpret_cast<DBImpl*>(db_);
+  ASSERT_OK(dbi->TEST_CompactMemTable());
+  const int max_running = dbi->TEST_MaxRunningCompactions();
+  for (int pass = 0; pass < 2; pass++) {
+    std::string value;
+    for (int i = 0; i < kKeys; i++) {
+      Status s = db_->Get(ReadOptions(), Key(i), &value);
+      if (values[i].empty()) {
+        ASSERT_TRUE(s.IsNotFound());
+      } else {
+        ASSERT_OK(s);
+        ASSERT_EQ(values[i], value);
+      }
+    }
+    // Everything survives a reopen, i.e. all edits made it to the MANIFEST.
+    Reopen(options);
+  }
+  return max_running;
+}
+
+TEST(AutoCompactTest, ParallelCompactions) {
+  Options options;
+  options.max_background_compactions = 4;
+  options.write_buffer_size = 64 << 10;
+  // Enough data for level 1 to outgrow its limit, so that level-1
+  // compactions of earlier bands overlap level-0 ones of later bands.
+  ASSERT_GE(DoOverwrites(options, 1000, 10), 2);
+}
+
+TEST(AutoCompactTest, Subcompactions) {
+  Options options;
+  options.max_subcompactions = 4;
+  options.write_buffer_size = 1 << 20;
+  options.max_file_size = 1 << 20;
+  DoOverwrites(options);
+
+  // The whole key space is several output files wide, so compacting it
+  // must split at least one compaction into key ranges.
+  ASSERT_GT(CompactAll(), 0);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
@@ -9,8 +9,11 @@
 
 #include <algorithm>
 #include <atomic>
+#include <deque>
+#include <functional>
 #include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "db/builder.h"
@@ -32,6 +35,7 @@
 #include "table/block.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
+#include "util/arena.h"
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -46,15 +50,30 @@ const int kNumNonTableCacheFiles = 10;
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   explicit Writer(port::Mutex* mu)
-      : batch(nullptr), sync(false), done(false), cv(mu) {}
+      : batch(nullptr), sync(false), done(false), group(nullptr), cv(mu) {}
 
   Status status;
   WriteBatch* batch;
   bool sync;
   bool done;
+  WriteGroup* group;  // Set once PipelinedWrite() has logged the batch
   port::CondVar cv;
 };
 
+// A group of writers whose merged batch is in the log, waiting in
+// PipelinedWrite() for its turn to be applied to the memtable.
+struct DBImpl::WriteGroup {
+  std::vector<Writer*> writers;  // The leader first
+  WriteBatch* batch;
+  SequenceNumber last_sequence;  // Of the last entry in batch
+  MemTable* mem;
+  Status status;
+  // With allow_concurrent_memtable_write, set when the followers may
+  // insert their own batches, and the number of writers still inserting.
+  bool inserting;
+  int pending_inserts;
+};
+
 struct DBImpl::CompactionState {
   // Files produced by compaction
   struct Output {
@@ -67,6 +86,8 @@ struct DBImpl::CompactionState {
 
   explicit CompactionState(Compaction* c)
       : compaction(c),
+        begin(nullptr),
+        end(nullptr),
         smallest_snapshot(0),
         outfile(nullptr),
         builder(nullptr),
@@ -74,6 +95,12 @@ struct DBImpl::CompactionState {
 
   Compaction* const compaction;
 
+  // The user keys to compact: those after *begin up to and including *end.
+  // nullptr means unbounded; only key ranges of split compactions have
+  // bounds.
+  const std::string* begin;
+  const std::string* end;
+
   // Sequence numbers < smallest_snapshot are not significant since we
   // will never have to service a snapshot below smallest_snapshot.
   // Therefore if we have seen a sequence number S <= smallest_snapshot,
@@ -89,6 +116,89 @@ struct DBImpl::CompactionState {
   uint64_t total_bytes;
 };
 
+namespace {
+
+// Runs the key ranges of split compactions.  Threads are started on demand
+// and never exit, so that each sets up its uFS memory only once.
+class SubcompactionRunner {
+ public:
+  static SubcompactionRunner* Default() {
+    static SubcompactionRunner* runner = new SubcompactionRunner;
+    return runner;
+  }
+
+  // Runs all of "work", (*work)[0] on the calling thread, and returns once
+  // every item has finished.
+  void Run(std::vector<std::function<void()>>* work) {
+    port::Mutex done_mu;
+    port::CondVar done_cv(&done_mu);
+    int remaining = static_cast<int>(work->size()) - 1;
+
+    mu_.Lock();
+    for (size_t i = 1; i < work->size(); i++) {
+      queue_.push_back(Task{&(*work)[i], &done_mu, &done_cv, &remaining});
+    }
+    while (idle_threads_ < static_cast<int>(queue_.size())) {
+      std::thread(&SubcompactionRunner::ThreadMain, this).detach();
+      idle_threads_++;
+    }
+    cv_.SignalAll();
+    mu_.Unlock();
+
+    (*work)[0]();
+
+    MutexLock l(&done_mu);
+    while (remaining > 0) {
+      done_cv.Wait();
+    }
+  }
+
+ private:
+  struct Task {
+    std::function<void()>* function;
+    port::Mutex* done_mu;
+    port::CondVar* done_cv;
+    int* remaining;  // Guarded by *done_mu
+  };
+
+  SubcompactionRunner() : cv_(&mu_), idle_threads_(0) {}
+
+  void ThreadMain() {
+#ifdef JL_LIBCFS
+    // Output tables are written from this thread's uFS shared memory.
+    fs_init_thread_local_mem();
+#endif
+    mu_.Lock();
+    while (true) {
+      while (queue_.empty()) {
+        cv_.Wait();
+      }
+      Task task = queue_.front();
+      queue_.pop_front();
+      idle_threads_--;
+      mu_.Unlock();
+
+      (*task.function)();
+
+      task.done_mu->Lock();
+      if (--*task.remaining == 0) {
+        task.done_cv->Signal();
+      }
+      task.done_mu->Unlock();
+
+      mu_.Lock();
+      idle_threads_++;
+    }
+  }
+
+  port::Mutex mu_;
+  port::CondVar cv_;
+  std::deque<Task> queue_;
+  int idle_threads_;  // Threads started and not running a task
+};
+
+}  // anonymous namespace
+
 // Fix user-supplied options to be reasonable
 template <class T, class V>
 static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
@@ -106,6 +216,8 @@ Options SanitizeOptions(const std::string& dbname,
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.max_background_compactions, 1, 64);
+  ClipToRange(&result.max_subcompactions, 1, 64);
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -117,7 +229,9 @@ Options SanitizeOptions(const std::string& dbname,
     }
   }
   if (result.block_cache == nullptr) {
-    result.block_cache = NewLRUCache(8 << 20);
+    result.block_cache = result.use_clock_cache
+                             ? NewClockCache(8 << 20, 4, result.block_size)
+                             : NewLRUCache(8 << 20);
   }
   return result;
 }
@@ -137,6 +251,10 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
       table_cache_(new TableCache(dbname_, options_, TableCacheSize(options_))),
+      memtable_regions_(options_.memtable_huge_pages
+                            ? new ArenaRegionPool(options_.write_buffer_size +
+                                                  options_.write_buffer_size / 8)
+                            : nullptr),
       db_lock_(nullptr),
       shutting_down_(false),
       background_work_finished_signal_(&mutex_),
@@ -148,16 +266,25 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       log_(nullptr),
       seed_(0),
       tmp_batch_(new WriteBatch),
-      background_compaction_scheduled_(false),
+      background_compactions_scheduled_(0),
+      running_compactions_(0),
+      max_running_compactions_(0),
+      background_flush_scheduled_(false),
+      flushing_memtable_(false),
+      logging_version_edit_(false),
       manual_compaction_(nullptr),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
-                               &internal_comparator_)) {}
+                               &internal_comparator_)),
+      split_compactions_(0) {
+  env_->SetBackgroundThreads(options_.max_background_compactions);
+}
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish.
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
-  while (background_compaction_scheduled_) {
+  while (background_compactions_scheduled_ > 0 ||
+         background_flush_scheduled_) {
     background_work_finished_signal_.Wait();
   }
   mutex_.Unlock();
@@ -180,6 +307,7 @@ DBImpl::~DBImpl() {
   delete log_;
   delete logfile_;
   delete table_cache_;
+  delete memtable_regions_;
 
   if (owns_info_log_) {
     delete options_.info_log;
@@ -192,7 +320,8 @@ DBImpl::~DBImpl() {
 void DBImpl::PartialDelete() {
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
-  while (background_compaction_scheduled_) {
+  while (background_compactions_scheduled_ > 0 ||
+         background_flush_scheduled_) {
     background_work_finished_signal_.Wait();
   }
   mutex_.Unlock();
@@ -456,7 +585,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     WriteBatchInternal::SetContents(&batch, record);
 
     if (mem == nullptr) {
-      mem = new MemTable(internal_comparator_);
+      mem = new MemTable(internal_comparator_, memtable_regions_);
       mem->Ref();
     }
     status = WriteBatchInternal::InsertInto(&batch, mem);
@@ -506,7 +635,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
         mem = nullptr;
       } else {
         // mem can be nullptr if lognum exists but was empty.
-        mem_ = new MemTable(internal_comparator_);
+        mem_ = new MemTable(internal_comparator_, memtable_regions_);
         mem_->Ref();
       }
     }
@@ -525,7 +654,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
 }
 
 Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+                                Version* base, uint64_t* pending_number) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
@@ -546,7 +675,11 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long)meta.number, (unsigned long long)meta.file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta.number);
+  if (pending_number != nullptr) {
+    *pending_number = meta.number;
+  } else {
+    pending_outputs_.erase(meta.number);
+  }
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -572,11 +705,15 @@ void DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
   assert(imm_ != nullptr);
 
+  assert(!flushing_memtable_);
+  flushing_memtable_ = true;
+
   // Save the contents of the memtable as a new Table
   VersionEdit edit;
   Version* base = versions_->current();
   base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  uint64_t file_number;
+  Status s = WriteLevel0Table(imm_, &edit, base, &file_number);
   base->Unref();
 
   if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
@@ -587,20 +724,35 @@ void DBImpl::CompactMemTable() {
   if (s.ok()) {
     edit.SetPrevLogNumber(0);
     edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
-    s = versions_->LogAndApply(&edit, &mutex_);
+    s = LogAndApply(&edit);
   }
 
+  pending_outputs_.erase(file_number);
+  flushing_memtable_ = false;
   if (s.ok()) {
     // Commit to the new state
     imm_->Unref();
     imm_ = nullptr;
     has_imm_.store(false, std::memory_order_release);
     DeleteObsoleteFiles();
-  } else {
+  } else if (!shutting_down_.load(std::memory_order_acquire)) {
+    // A flush cut short by ~DBImpl is not an error: imm_ is still in the log.
     RecordBackgroundError(s);
   }
 }
 
+Status DBImpl::LogAndApply(VersionEdit* edit) {
+  mutex_.AssertHeld();
+  while (logging_version_edit_) {
+    background_work_finished_signal_.Wait();
+  }
+  logging_version_edit_ = true;
+  Status s = versions_->LogAndApply(edit, &mutex_);
+  logging_version_edit_ = false;
+  background_work_finished_signal_.SignalAll();
+  return s;
+}
+
 void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
   int max_level_with_files = 1;
   {
@@ -688,17 +840,31 @@ void DBImpl::RecordBackgroundError(const Status& s) {
 
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (background_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.load(std::memory_order_acquire)) {
+  if (shutting_down_.load(std::memory_order_acquire)) {
     // DB is being deleted; no more background compactions
+    return;
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
+    return;
+  }
+
+  // Memtable flushes get a lane of their own, so that writers are not
+  // stalled behind long-running compactions.
+  if (imm_ != nullptr && !background_flush_scheduled_) {
+    background_flush_scheduled_ = true;
+    env_->ScheduleFlush(&DBImpl::BGFlushWork, this);
+  }
+
+  // Compactions are added one at a time; a compaction that finds work
+  // schedules the next one (see BackgroundCompaction()).
+  if (background_compactions_scheduled_ >=
+      options_.max_background_compactions) {
+    // Already scheduled
+  } else if (manual_compaction_ == nullptr &&
              !versions_->NeedsCompaction()) {
     // No work to be done
   } else {
-    background_compaction_scheduled_ = true;
+    background_compactions_scheduled_++;
     env_->Schedule(&DBImpl::BGWork, this);
   }
 }
@@ -707,31 +873,63 @@ void DBImpl::BGWork(void* db) {
   reinterpret_cast<DBImpl*>(db)->BackgroundCall();
 }
 
+void DBImpl::BGFlushWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(background_compaction_scheduled_);
+  assert(background_compactions_scheduled_ > 0);
+  bool made_progress = false;
   if (shutting_down_.load(std::memory_order_acquire)) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
     // No more background work after a background error.
   } else {
-    BackgroundCompaction();
+    made_progress = BackgroundCompaction();
   }
 
-  background_compaction_scheduled_ = false;
+  background_compactions_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
-  // so reschedule another compaction if needed.
-  MaybeScheduleCompaction();
+  // so reschedule another compaction if needed.  A compaction that found
+  // nothing to do leaves that to the ones still running.
+  if (made_progress) {
+    MaybeScheduleCompaction();
+  }
+  background_work_finished_signal_.SignalAll();
+}
+
+void DBImpl::BackgroundFlushCall() {
+  MutexLock l(&mutex_);
+  assert(background_flush_scheduled_);
+  bool flushed = false;
+  if (shutting_down_.load(std::memory_order_acquire)) {
+    // No more background work when shutting down.
+  } else if (!bg_error_.ok()) {
+    // No more background work after a background error.
+  } else if (imm_ != nullptr && !flushing_memtable_) {
+    CompactMemTable();
+    flushed = true;
+  }
+
+  background_flush_scheduled_ = false;
+
+  // The new level-0 file may call for a compaction.  If a compaction
+  // was flushing imm_ itself, it takes care of that when it finishes.
+  if (flushed) {
+    MaybeScheduleCompaction();
+  }
   background_work_finished_signal_.SignalAll();
 }
 
-void DBImpl::BackgroundCompaction() {
+bool DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
-  if (imm_ != nullptr) {
-    CompactMemTable();
-    return;
+  if (manual_compaction_ != nullptr && running_compactions_ > 0) {
+    // Manual compactions pick their inputs regardless of other
+    // compactions, so wait for those to finish.
+    return false;
   }
 
   Compaction* c;
@@ -753,6 +951,17 @@ void DBImpl::BackgroundCompaction() {
     c = versions_->PickCompaction();
   }
 
+  if (c != nullptr) {
+    c->MarkInputsBeingCompacted(true);
+    running_compactions_++;
+    max_running_compactions_ =
+        std::max(max_running_compactions_, running_compactions_);
+    // Let another compaction run alongside this one.
+    MaybeScheduleCompaction();
+  } else if (!is_manual) {
+    return false;
+  }
+
   Status status;
   if (c == nullptr) {
     // Nothing to do
@@ -763,25 +972,33 @@ void DBImpl::BackgroundCompaction() {
     c->edit()->DeleteFile(c->level(), f->number);
     c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
                        f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_);
+    status = LogAndApply(c->edit());
     if (!status.ok()) {
       RecordBackgroundError(status);
+    } else if (c->level() + 1 > config::kMaxPinnedLevel) {
+      table_cache_->Unpin(f->number);
     }
     VersionSet::LevelSummaryStorage tmp;
     Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
         static_cast<unsigned long long>(f->number), c->level() + 1,
         static_cast<unsigned long long>(f->file_size),
         status.ToString().c_str(), versions_->LevelSummary(&tmp));
+    c->MarkInputsBeingCompacted(false);
   } else {
     CompactionState* compact = new CompactionState(c);
     status = DoCompactionWork(compact);
-    if (!status.ok()) {
+    if (!status.ok() && !shutting_down_.load(std::memory_order_acquire)) {
       RecordBackgroundError(status);
     }
     CleanupCompaction(compact);
+    // Before ReleaseInputs(), which may free the inputs' FileMetaData.
+    c->MarkInputsBeingCompacted(false);
     c->ReleaseInputs();
     DeleteObsoleteFiles();
   }
+  if (c != nullptr) {
+    running_compactions_--;
+  }
   delete c;
 
   if (status.ok()) {
@@ -805,6 +1022,7 @@ void DBImpl::BackgroundCompaction() {
     }
     manual_compaction_ = nullptr;
   }
+  return true;
 }
 
 void DBImpl::CleanupCompaction(CompactionState* compact) {
@@ -913,7 +1131,7 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
     compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
                                          out.smallest, out.largest);
   }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  return LogAndApply(compact->compaction->edit());
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
@@ -934,11 +1152,104 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
   }
 
+  // Large compactions are split into key ranges that are merged in
+  // parallel; their outputs are installed together.
+  std::vector<std::string> boundaries;
+  compact->compaction->SplitKeyRanges(options_.max_subcompactions,
+                                      &boundaries);
+  std::vector<CompactionState*> ranges;
+  if (!boundaries.empty()) {
+    for (size_t i = 0; i <= boundaries.size(); i++) {
+      CompactionState* range =
+          new CompactionState(compact->compaction->CloneForKeyRange());
+      range->smallest_snapshot = compact->smallest_snapshot;
+      range->begin = (i == 0) ? nullptr : &boundaries[i - 1];
+      range->end = (i == boundaries.size()) ? nullptr : &boundaries[i];
+      ranges.push_back(range);
+    }
+    Log(options_.info_log, "Splitting compaction into %d key ranges",
+        static_cast<int>(ranges.size()));
+    split_compactions_++;
+  }
+
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
+  Status status;
+  if (ranges.empty()) {
+    status = DoCompactionRange(compact, &imm_micros);
+  } else {
+    std::vector<Status> statuses(ranges.size());
+    std::vector<std::function<void()>> work;
+    for (size_t i = 0; i < ranges.size(); i++) {
+      // Only the calling thread stops to flush the immutable memtable.
+      int64_t* range_imm_micros = (i == 0) ? &imm_micros : nullptr;
+      work.push_back([this, &ranges, &statuses, i, range_imm_micros]() {
+        statuses[i] = DoCompactionRange(ranges[i], range_imm_micros);
+      });
+    }
+    SubcompactionRunner::Default()->Run(&work);
+
+    // Key ranges are disjoint and in order, so their outputs are too.
+    for (size_t i = 0; i < ranges.size(); i++) {
+      if (status.ok()) {
+        status = statuses[i];
+      }
+      compact->outputs.insert(compact->outputs.end(),
+                              ranges[i]->outputs.begin(),
+                              ranges[i]->outputs.end());
+      compact->total_bytes += ranges[i]->total_bytes;
+      ranges[i]->outputs.clear();
+    }
+  }
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros - imm_micros;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+
+  mutex_.Lock();
+  stats_[compact->compaction->level() + 1].Add(stats);
+  for (size_t i = 0; i < ranges.size(); i++) {
+    Compaction* c = ranges[i]->compaction;
+    CleanupCompaction(ranges[i]);
+    delete c;
+  }
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  // With several compactions in flight, ~DBImpl usually interrupts one;
+  // that leaves the inputs in place and is not an error.
+  if (!status.ok() && !shutting_down_.load(std::memory_order_acquire)) {
+    RecordBackgroundError(status);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
+  return status;
+}
+
+Status DBImpl::DoCompactionRange(CompactionState* compact,
+                                 int64_t* imm_micros) {
+  const Comparator* const ucmp = user_comparator();
   Iterator* input = versions_->MakeInputIterator(compact->compaction);
-  input->SeekToFirst();
+  if (compact->begin == nullptr) {
+    input->SeekToFirst();
+  } else {
+    input->Seek(
+        InternalKey(*compact->begin, 0, static_cast<ValueType>(0)).Encode());
+    // Any remaining entries of *begin belong to the previous range.
+    while (input->Valid() && input->key().size() >= 8 &&
+           ucmp->Compare(ExtractUserKey(input->key()), *compact->begin) <= 0) {
+      input->Next();
+    }
+  }
   Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
@@ -946,19 +1257,24 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
   for (; input->Valid() && !shutting_down_.load(std::memory_order_acquire);) {
     // Prioritize immutable compaction work
-    if (has_imm_.load(std::memory_order_relaxed)) {
+    if (imm_micros != nullptr && has_imm_.load(std::memory_order_relaxed)) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != nullptr) {
+      if (imm_ != nullptr && !flushing_memtable_) {
         CompactMemTable();
         // Wake up MakeRoomForWrite() if necessary.
         background_work_finished_signal_.SignalAll();
       }
       mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
+      *imm_micros += (env_->NowMicros() - imm_start);
     }
 
     Slice key = input->key();
+    if (compact->end != nullptr && key.size() >= 8 &&
+        ucmp->Compare(ExtractUserKey(key), *compact->end) > 0) {
+      // The rest belongs to the next range.
+      break;
+    }
     if (compact->compaction->ShouldStopBefore(key) &&
         compact->builder != nullptr) {
       status = FinishCompactionOutputFile(compact, input);
@@ -976,8 +1292,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       last_sequence_for_key = kMaxSequenceNumber;
     } else {
       if (!has_current_user_key ||
-          user_comparator()->Compare(ikey.user_key, Slice(current_user_key)) !=
-              0) {
+          ucmp->Compare(ikey.user_key, Slice(current_user_key)) != 0) {
         // First occurrence of this user key
         current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
         has_current_user_key = true;
@@ -1052,29 +1367,6 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   }
   delete input;
   input = nullptr;
-
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
-  }
-
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
-
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
-  }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
-  }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
   return status;
 }
 
@@ -1140,6 +1432,16 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
   return versions_->MaxNextLevelOverlappingBytes();
 }
 
+int DBImpl::TEST_SplitCompactions() {
+  MutexLock l(&mutex_);
+  return split_compactions_;
+}
+
+int DBImpl::TEST_MaxRunningCompactions() {
+  MutexLock l(&mutex_);
+  return max_running_compactions_;
+}
+
 Status DBImpl::Get(const ReadOptions& options, const Slice& key,
                    std::string* value) {
   Status s;
@@ -1187,6 +1489,96 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
   return s;
 }
 
+namespace {
+// Orders indexes into a vector of user keys by the keys they index.
+struct ByUserKey {
+  const Comparator* ucmp;
+  const std::vector<Slice>* keys;
+
+  bool operator()(size_t a, size_t b) const {
+    return ucmp->Compare((*keys)[a], (*keys)[b]) < 0;
+  }
+};
+}  // namespace
+
+std::vector<Status> DBImpl::MultiGet(const ReadOptions& options,
+                                     const std::vector<Slice>& keys,
+                                     std::vector<std::string>* values) {
+  const size_t num = keys.size();
+  std::vector<Status> statuses(num);
+  values->resize(num);
+  MutexLock l(&mutex_);
+  SequenceNumber snapshot;
+  if (options.snapshot != nullptr) {
+    snapshot =
+        static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  MemTable* mem = mem_;
+  MemTable* imm = imm_;
+  Version* current = versions_->current();
+  mem->Ref();
+  if (imm != nullptr) imm->Ref();
+  current->Ref();
+
+  std::vector<Version::GetStats> stats;
+
+  // Unlock while reading from files and memtables
+  {
+    mutex_.Unlock();
+    // First look in the memtables, then look for the keys they do not
+    // hold in the table files, all together and in key order.
+    std::deque<LookupKey> lkeys;
+    std::vector<size_t> misses;
+    for (size_t i = 0; i < num; i++) {
+      lkeys.emplace_back(keys[i], snapshot);
+      if (mem->Get(lkeys[i], &(*values)[i], &statuses[i])) {
+        // Done
+      } else if (imm != nullptr && imm->Get(lkeys[i], &(*values)[i],
+                                            &statuses[i])) {
+        // Done
+      } else {
+        misses.push_back(i);
+      }
+    }
+    if (!misses.empty()) {
+      std::sort(misses.begin(), misses.end(),
+                ByUserKey{user_comparator(), &keys});
+      std::vector<const LookupKey*> miss_keys;
+      std::vector<std::string*> miss_values;
+      for (size_t i : misses) {
+        miss_keys.push_back(&lkeys[i]);
+        miss_values.push_back(&(*values)[i]);
+      }
+      std::vector<Status> miss_statuses(misses.size());
+      stats.resize(misses.size());
+      current->MultiGet(options, miss_keys.data(), misses.size(),
+                        miss_values.data(), miss_statuses.data(),
+                        stats.data());
+      for (size_t j = 0; j < misses.size(); j++) {
+        statuses[misses[j]] = miss_statuses[j];
+      }
+    }
+    mutex_.Lock();
+  }
+
+  bool need_compaction = false;
+  for (const Version::GetStats& s : stats) {
+    if (current->UpdateStats(s)) {
+      need_compaction = true;
+    }
+  }
+  if (need_compaction) {
+    MaybeScheduleCompaction();
+  }
+  mem->Unref();
+  if (imm != nullptr) imm->Unref();
+  current->Unref();
+  return statuses;
+}
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
@@ -1226,6 +1618,10 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
 }
 
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
+  if (options_.enable_pipelined_write) {
+    return PipelinedWrite(options, updates);
+  }
+
   Writer w(&mutex_);
   w.batch = updates;
   w.sync = options.sync;
@@ -1245,7 +1641,7 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   uint64_t last_sequence = versions_->LastSequence();
   Writer* last_writer = &w;
   if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
-    WriteBatch* updates = BuildBatchGroup(&last_writer);
+    WriteBatch* updates = BuildBatchGroup(&last_writer, tmp_batch_);
     WriteBatchInternal::SetSequence(updates, last_sequence + 1);
     last_sequence += WriteBatchInternal::Count(updates);
 
@@ -1299,9 +1695,165 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   return status;
 }
 
+Status DBImpl::PipelinedWrite(const WriteOptions& options,
+                              WriteBatch* updates) {
+  Writer w(&mutex_);
+  w.batch = updates;
+  w.sync = options.sync;
+  w.done = false;
+
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (!w.done && w.group == nullptr && &w != writers_.front()) {
+    w.cv.Wait();
+  }
+  if (w.group != nullptr) {
+    // A follower whose batch another writer has logged.
+    return FollowerInsert(&w);
+  }
+  if (w.done) {
+    return w.status;
+  }
+
+  // Log stage.  May temporarily unlock and wait; a nullptr batch (for
+  // compactions) also waits for the memtable stage to drain.
+  Status status = MakeRoomForWrite(updates == nullptr);
+  while (updates == nullptr && !memtable_groups_.empty()) {
+    background_work_finished_signal_.Wait();
+  }
+  if (!status.ok() || updates == nullptr) {
+    writers_.pop_front();
+    if (!writers_.empty()) {
+      writers_.front()->cv.Signal();
+    }
+    return status;
+  }
+
+  WriteGroup group;
+  WriteBatch merged;
+  Writer* last_writer = &w;
+  group.batch = BuildBatchGroup(&last_writer, &merged);
+  // Groups ahead of this one may not have been applied yet.
+  SequenceNumber last_sequence = memtable_groups_.empty()
+                                     ? versions_->LastSequence()
+                                     : memtable_groups_.back()->last_sequence;
+  WriteBatchInternal::SetSequence(group.batch, last_sequence + 1);
+  group.last_sequence = last_sequence + WriteBatchInternal::Count(group.batch);
+  // MakeRoomForWrite() does not switch mem_ while groups are pending.
+  group.mem = mem_;
+  group.inserting = false;
+  group.pending_inserts = 0;
+
+  // &w is at the front of writers_, so it is the only logger.
+  {
+    mutex_.Unlock();
+    status = log_->AddRecord(WriteBatchInternal::Contents(group.batch));
+    bool sync_error = false;
+    if (status.ok() && options.sync) {
+      status = logfile_->Sync();
+      if (!status.ok()) {
+        sync_error = true;
+      }
+    }
+    mutex_.Lock();
+    if (sync_error) {
+      // The state of the log file is indeterminate: the log record we
+      // just added may or may not show up when the DB is re-opened.
+      // So we force the DB into a mode where all future writes fail.
+      RecordBackgroundError(status);
+    }
+  }
+  group.status = status;
+
+  // Hand the group to the memtable stage and let the next group log.
+  while (true) {
+    Writer* ready = writers_.front();
+    writers_.pop_front();
+    ready->group = &group;
+    group.writers.push_back(ready);
+    if (ready == last_writer) break;
+  }
+  memtable_groups_.push_back(&group);
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+
+  // Memtable stage.  Groups are applied in log order, so that
+  // LastSequence() never covers a batch that is not in the memtable yet.
+  while (memtable_groups_.front() != &group) {
+    w.cv.Wait();
+  }
+  if (group.status.ok() && options_.allow_concurrent_memtable_write) {
+    // Every writer inserts its own batch, at its place in the group.
+    SequenceNumber sequence = group.last_sequence -
+                              WriteBatchInternal::Count(group.batch) + 1;
+    for (Writer* writer : group.writers) {
+      WriteBatchInternal::SetSequence(writer->batch, sequence);
+      sequence += WriteBatchInternal::Count(writer->batch);
+    }
+    group.inserting = true;
+    group.pending_inserts = group.writers.size();
+    for (size_t i = 1; i < group.writers.size(); i++) {
+      group.writers[i]->cv.Signal();
+    }
+    mutex_.Unlock();
+    Status s = WriteBatchInternal::InsertConcurrentlyInto(w.batch, group.mem);
+    mutex_.Lock();
+    if (!s.ok() && group.status.ok()) group.status = s;
+    group.pending_inserts--;
+    while (group.pending_inserts > 0) {
+      w.cv.Wait();
+    }
+  } else if (group.status.ok()) {
+    mutex_.Unlock();
+    group.status = WriteBatchInternal::InsertInto(group.batch, group.mem);
+    mutex_.Lock();
+  }
+  versions_->SetLastSequence(group.last_sequence);
+
+  memtable_groups_.pop_front();
+  for (size_t i = 1; i < group.writers.size(); i++) {
+    group.writers[i]->status = group.status;
+    group.writers[i]->done = true;
+    group.writers[i]->cv.Signal();
+  }
+  if (!memtable_groups_.empty()) {
+    memtable_groups_.front()->writers[0]->cv.Signal();
+  } else {
+    // MakeRoomForWrite() may be waiting for the memtable stage to drain.
+    background_work_finished_signal_.SignalAll();
+  }
+  return group.status;
+}
+
+// The memtable stage of a follower in PipelinedWrite(): inserts its own
+// batch if the leader lets it, then waits for the leader to finish the
+// group.
+Status DBImpl::FollowerInsert(Writer* w) {
+  mutex_.AssertHeld();
+  WriteGroup* group = w->group;
+  while (!w->done && !group->inserting) {
+    w->cv.Wait();
+  }
+  if (!w->done) {
+    mutex_.Unlock();
+    Status s = WriteBatchInternal::InsertConcurrentlyInto(w->batch, group->mem);
+    mutex_.Lock();
+    if (!s.ok() && group->status.ok()) group->status = s;
+    if (--group->pending_inserts == 0) {
+      group->writers[0]->cv.Signal();
+    }
+    // The leader publishes the sequence numbers of the whole group.
+    while (!w->done) {
+      w->cv.Wait();
+    }
+  }
+  return w->status;
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-null batch
-WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
+WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer, WriteBatch* scratch) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   Writer* first = writers_.front();
@@ -1338,7 +1890,7 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       // Append to *result
       if (result == first->batch) {
         // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
+        result = scratch;
         assert(WriteBatchInternal::Count(result) == 0);
         WriteBatchInternal::Append(result, first->batch);
       }
@@ -1382,6 +1934,10 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // one is still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
       background_work_finished_signal_.Wait();
+    } else if (!memtable_groups_.empty()) {
+      // Writes already in the log are still being applied to mem_, which
+      // must be complete before it becomes imm_.
+      background_work_finished_signal_.Wait();
     } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
@@ -1408,7 +1964,7 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       log_ = new log::Writer(lfile);
       imm_ = mem_;
       has_imm_.store(true, std::memory_order_release);
-      mem_ = new MemTable(internal_comparator_);
+      mem_ = new MemTable(internal_comparator_, memtable_regions_);
       mem_->Ref();
       force = false;  // Do not force another compaction if have room
       MaybeScheduleCompaction();
@@ -1461,6 +2017,44 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   } else if (in == "sstables") {
     *value = versions_->current()->DebugString();
     return true;
+  } else if (in == "block-cache-stats") {
+    std::vector<CacheShardStats> shards;
+    options_.block_cache->GetShardStats(&shards);
+    if (shards.empty()) {
+      return false;
+    }
+    char buf[200];
+    snprintf(buf, sizeof(buf),
+             "Shard       Hits     Misses    Inserts  Evictions Usage(MB) "
+             "LockWait(ms)\n"
+             "-------------------------------------------------------------"
+             "------------\n");
+    value->append(buf);
+    CacheShardStats total;
+    for (size_t s = 0; s <= shards.size(); s++) {
+      const bool is_total = (s == shards.size());
+      const CacheShardStats& stats = is_total ? total : shards[s];
+      if (is_total) {
+        snprintf(buf, sizeof(buf), "%5s", "all");
+      } else {
+        snprintf(buf, sizeof(buf), "%5d", static_cast<int>(s));
+        total.hits += stats.hits;
+        total.misses += stats.misses;
+        total.inserts += stats.inserts;
+        total.evictions += stats.evictions;
+        total.usage += stats.usage;
+        total.lock_wait_nanos += stats.lock_wait_nanos;
+      }
+      value->append(buf);
+      snprintf(buf, sizeof(buf), " %10llu %10llu %10llu %10llu %9.1f %12.1f\n",
+               static_cast<unsigned long long>(stats.hits),
+               static_cast<unsigned long long>(stats.misses),
+               static_cast<unsigned long long>(stats.inserts),
+               static_cast<unsigned long long>(stats.evictions),
+               stats.usage / 1048576.0, stats.lock_wait_nanos / 1e6);
+      value->append(buf);
+    }
+    return true;
   } else if (in == "approximate-memory-usage") {
     size_t total_usage = options_.block_cache->TotalCharge();
     if (mem_) {
@@ -1517,6 +2111,27 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+std::vector<Status> DB::MultiGet(const ReadOptions& options,
+                                 const std::vector<Slice>& keys,
+                                 std::vector<std::string>* values) {
+  // Read every key from the same snapshot.
+  ReadOptions read_options = options;
+  const Snapshot* snapshot = nullptr;
+  if (read_options.snapshot == nullptr) {
+    snapshot = GetSnapshot();
+    read_options.snapshot = snapshot;
+  }
+  std::vector<Status> statuses(keys.size());
+  values->resize(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    statuses[i] = Get(read_options, keys[i], &(*values)[i]);
+  }
+  if (snapshot != nullptr) {
+    ReleaseSnapshot(snapshot);
+  }
+  return statuses;
+}
+
 DB::~DB() {}
 void DB::PartialDelete() {}
 
@@ -1546,7 +2161,8 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
       impl->log_ = new log::Writer(lfile);
-      impl->mem_ = new MemTable(impl->internal_comparator_);
+      impl->mem_ =
+          new MemTable(impl->internal_comparator_, impl->memtable_regions_);
       impl->mem_->Ref();
     }
   }
@@ -1554,7 +2170,7 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
   if (s.ok() && save_manifest) {
     edit.SetPrevLogNumber(0);  // No older logs needed after recovery.
     edit.SetLogNumber(impl->logfile_number_);
-    s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
+    s = impl->LogAndApply(&edit);
   }
   fprintf(stdout, "s.ok? 2:%d\n", s.ok());
   if (s.ok()) {
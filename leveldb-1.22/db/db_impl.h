@@ -20,6 +20,7 @@
 
 namespace leveldb {
 
+class ArenaRegionPool;
 class MemTable;
 class TableCache;
 class Version;
@@ -42,6 +43,9 @@ class DBImpl : public DB {
   virtual Status Write(const WriteOptions& options, WriteBatch* updates);
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value);
+  virtual std::vector<Status> MultiGet(const ReadOptions& options,
+                                       const std::vector<Slice>& keys,
+                                       std::vector<std::string>* values);
   virtual Iterator* NewIterator(const ReadOptions&);
   virtual const Snapshot* GetSnapshot();
   virtual void ReleaseSnapshot(const Snapshot* snapshot);
@@ -66,6 +70,13 @@ class DBImpl : public DB {
   // file at a level >= 1.
   int64_t TEST_MaxNextLevelOverlappingBytes();
 
+  // Return the number of compactions since open that were split into
+  // more than one key range.
+  int TEST_SplitCompactions();
+
+  // Return the most compactions that have run at the same time since open.
+  int TEST_MaxRunningCompactions();
+
   // Record a sample of bytes read at the specified internal key.
   // Samples are taken approximately once every config::kReadBytesPeriod
   // bytes.
@@ -75,6 +86,7 @@ class DBImpl : public DB {
   friend class DB;
   struct CompactionState;
   struct Writer;
+  struct WriteGroup;
 
   // Information for a manual compaction
   struct ManualCompaction {
@@ -123,28 +135,50 @@ class DBImpl : public DB {
   // Errors are recorded in bg_error_.
   void CompactMemTable() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Applies *edit to the current version and logs it to the MANIFEST.
+  // VersionSet::LogAndApply() releases the mutex while it writes, so
+  // concurrent background jobs take turns here.
+  Status LogAndApply(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   Status RecoverLogFile(uint64_t log_number, bool last_log, bool* save_manifest,
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // If "pending_number" is non-null, the number of the new table is stored
+  // there and left in pending_outputs_ for the caller to remove once *edit
+  // has been applied, so that other background work cannot delete it.
+  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base,
+                          uint64_t* pending_number = nullptr)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-  WriteBatch* BuildBatchGroup(Writer** last_writer)
+  // Merges the batches of the writers at the front of the queue, using
+  // *scratch if there is more than one.
+  WriteBatch* BuildBatchGroup(Writer** last_writer, WriteBatch* scratch)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Write() with options_.enable_pipelined_write.
+  Status PipelinedWrite(const WriteOptions& options, WriteBatch* updates);
+  Status FollowerInsert(Writer* w) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   void RecordBackgroundError(const Status& s);
 
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   static void BGWork(void* db);
+  static void BGFlushWork(void* db);
   void BackgroundCall();
-  void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void BackgroundFlushCall();
+  // Returns false if there was nothing that could be compacted.
+  bool BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Merges the inputs of "compact" that fall in its key range into new
+  // output files.  Flushes the immutable memtable in between if
+  // "imm_micros" is non-null, adding the time spent to it.
+  Status DoCompactionRange(CompactionState* compact, int64_t* imm_micros)
+      LOCKS_EXCLUDED(mutex_);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
@@ -167,6 +201,10 @@ class DBImpl : public DB {
   // table_cache_ provides its own synchronization
   TableCache* const table_cache_;
 
+  // The regions memtables allocate from if options_.memtable_huge_pages,
+  // else nullptr.  Provides its own synchronization.
+  ArenaRegionPool* const memtable_regions_;
+
   // Lock over the persistent DB state.  Non-null iff successfully acquired.
   FileLock* db_lock_;
 
@@ -184,6 +222,9 @@ class DBImpl : public DB {
 
   // Queue of writers.
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
+  // Groups that are in the log and wait to be applied to the memtable, in
+  // log order.  Only used by PipelinedWrite().
+  std::deque<WriteGroup*> memtable_groups_ GUARDED_BY(mutex_);
   WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
 
   SnapshotList snapshots_ GUARDED_BY(mutex_);
@@ -192,8 +233,20 @@ class DBImpl : public DB {
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_ GUARDED_BY(mutex_);
 
-  // Has a background compaction been scheduled or is running?
-  bool background_compaction_scheduled_ GUARDED_BY(mutex_);
+  // Number of background compactions scheduled or running, at most
+  // options_.max_background_compactions.
+  int background_compactions_scheduled_ GUARDED_BY(mutex_);
+  // Number of those that have picked their inputs.
+  int running_compactions_ GUARDED_BY(mutex_);
+  // Peak of running_compactions_; see TEST_MaxRunningCompactions().
+  int max_running_compactions_ GUARDED_BY(mutex_);
+
+  // Has a memtable flush been scheduled or is running?
+  bool background_flush_scheduled_ GUARDED_BY(mutex_);
+  // Is CompactMemTable() writing out imm_?
+  bool flushing_memtable_ GUARDED_BY(mutex_);
+  // Is LogAndApply() writing to the MANIFEST?
+  bool logging_version_edit_ GUARDED_BY(mutex_);
 
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
@@ -203,6 +256,9 @@ class DBImpl : public DB {
   Status bg_error_ GUARDED_BY(mutex_);
 
   CompactionStats stats_[config::kNumLevels] GUARDED_BY(mutex_);
+
+  // Compactions split into key ranges; see TEST_SplitCompactions().
+  int split_compactions_ GUARDED_BY(mutex_);
 };
 
 // Sanitize db options.  The caller should delete result.info_log if
@@ -4,6 +4,7 @@
 
 #include "leveldb/db.h"
 
+#include <algorithm>
 #include <atomic>
 #include <string>
 
@@ -120,6 +121,10 @@ class SpecialEnv : public EnvWrapper {
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
+  // Random reads return their data from memory that is not cache-line
+  // aligned and stays live while the file is open, as an mmap would.
+  bool misalign_reads_;
+
   explicit SpecialEnv(Env* base)
       : EnvWrapper(base),
         delay_data_sync_(false),
@@ -128,7 +133,8 @@ class SpecialEnv : public EnvWrapper {
         non_writable_(false),
         manifest_sync_error_(false),
         manifest_write_error_(false),
-        count_random_reads_(false) {}
+        count_random_reads_(false),
+        misalign_reads_(false) {}
 
   Status NewWritableFile(const std::string& f, WritableFile** r) {
     class DataFile : public WritableFile {
@@ -218,10 +224,45 @@ class SpecialEnv : public EnvWrapper {
       }
     };
 
+    class MisaligningFile : public RandomAccessFile {
+     private:
+      RandomAccessFile* target_;
+      mutable port::Mutex mu_;
+      mutable std::vector<char*> buffers_ GUARDED_BY(mu_);
+
+     public:
+      explicit MisaligningFile(RandomAccessFile* target) : target_(target) {}
+      virtual ~MisaligningFile() {
+        for (char* buf : buffers_) {
+          delete[] buf;
+        }
+        delete target_;
+      }
+      virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                          char* scratch) const {
+        char* buf = new char[n + 64];
+        {
+          MutexLock l(&mu_);
+          buffers_.push_back(buf);
+        }
+        // One byte past a 64-byte boundary.
+        char* data = buf + (65 - reinterpret_cast<uintptr_t>(buf) % 64) % 64;
+        Status s = target_->Read(offset, n, result, data);
+        if (s.ok() && result->data() != data) {
+          memcpy(data, result->data(), result->size());
+          *result = Slice(data, result->size());
+        }
+        return s;
+      }
+    };
+
     Status s = target()->NewRandomAccessFile(f, r);
     if (s.ok() && count_random_reads_) {
       *r = new CountingFile(*r, &random_read_counter_);
     }
+    if (s.ok() && misalign_reads_) {
+      *r = new MisaligningFile(*r);
+    }
     return s;
   }
 };
@@ -236,6 +277,7 @@ class DBTest {
 
   DBTest() : env_(new SpecialEnv(Env::Default())), option_config_(kDefault) {
     filter_policy_ = NewBloomFilterPolicy(10);
+    blocked_filter_policy_ = NewBlockedBloomFilterPolicy(10);
     dbname_ = test::TmpDir() + "/db_test";
     DestroyDB(dbname_, Options());
     db_ = nullptr;
@@ -247,6 +289,7 @@ class DBTest {
     DestroyDB(dbname_, Options());
     delete env_;
     delete filter_policy_;
+    delete blocked_filter_policy_;
   }
 
   // Switch to a fresh database with the next option configuration to
@@ -272,9 +315,33 @@ class DBTest {
       case kFilter:
         options.filter_policy = filter_policy_;
         break;
+      case kBlockedFilter:
+        options.filter_policy = blocked_filter_policy_;
+        break;
+      case kWholeTableFilterPartitionedIndex:
+        options.filter_policy = blocked_filter_policy_;
+        options.whole_table_filter = true;
+        options.index_partition_size = 256;
+        break;
+      case kBlockKeyPrefixes:
+        options.block_key_prefixes = true;
+        break;
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kPipelinedWrite:
+        options.enable_pipelined_write = true;
+        break;
+      case kConcurrentMemtableWrite:
+        options.enable_pipelined_write = true;
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kClockCache:
+        options.use_clock_cache = true;
+        break;
+      case kHugePageMemtable:
+        options.memtable_huge_pages = true;
+        break;
       default:
         break;
     }
@@ -529,9 +596,23 @@ class DBTest {
 
  private:
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kReuse, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kReuse,
+    kFilter,
+    kBlockedFilter,
+    kWholeTableFilterPartitionedIndex,
+    kBlockKeyPrefixes,
+    kUncompressed,
+    kPipelinedWrite,
+    kConcurrentMemtableWrite,
+    kClockCache,
+    kHugePageMemtable,
+    kEnd
+  };
 
   const FilterPolicy* filter_policy_;
+  const FilterPolicy* blocked_filter_policy_;
   int option_config_;
 };
 
@@ -641,6 +722,51 @@ TEST(DBTest, GetSnapshot) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, MultiGet) {
+  do {
+    ASSERT_OK(Put("a", "va1"));
+    ASSERT_OK(Put("b", "vb1"));
+    ASSERT_OK(Put("c", "vc1"));
+    ASSERT_OK(Put("d", "vd1"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(Put("b", "vb2"));
+    ASSERT_OK(Delete("c"));
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_OK(Put("d", "vd2"));
+    ASSERT_OK(Put("e", "ve2"));
+
+    // Out of order, with a duplicate, from the memtable and two tables.
+    std::vector<Slice> keys = {"e", "a", "b", "c", "missing", "d", "a"};
+    std::vector<std::string> values;
+    std::vector<Status> statuses =
+        db_->MultiGet(ReadOptions(), keys, &values);
+    ASSERT_EQ(keys.size(), statuses.size());
+    ASSERT_EQ(keys.size(), values.size());
+    const char* expected[] = {"ve2", "va1", "vb2", nullptr, nullptr, "vd2",
+                              "va1"};
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (expected[i] == nullptr) {
+        ASSERT_TRUE(statuses[i].IsNotFound());
+      } else {
+        ASSERT_OK(statuses[i]);
+        ASSERT_EQ(expected[i], values[i]);
+      }
+    }
+
+    ReadOptions options;
+    options.snapshot = snapshot;
+    statuses = db_->MultiGet(options, keys, &values);
+    ASSERT_EQ("vd1", values[5]);
+    ASSERT_TRUE(statuses[0].IsNotFound());
+    db_->ReleaseSnapshot(snapshot);
+
+    statuses = db_->MultiGet(ReadOptions(), std::vector<Slice>(), &values);
+    ASSERT_TRUE(statuses.empty());
+    ASSERT_TRUE(values.empty());
+  } while (ChangeOptions());
+}
+
 TEST(DBTest, GetIdenticalSnapshots) {
   do {
     // Try with both a short key and a long key
@@ -1915,6 +2041,187 @@ TEST(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+namespace {
+
+// Wraps a filter policy and checks that every filter it is asked to probe
+// starts its 64-byte lines on a 64-byte boundary.
+class AlignmentCheckingPolicy : public FilterPolicy {
+ public:
+  explicit AlignmentCheckingPolicy(const FilterPolicy* base)
+      : base_(base), probes_(0), misaligned_(0) {}
+
+  const char* Name() const override { return base_->Name(); }
+  size_t FilterAlignment() const override { return base_->FilterAlignment(); }
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    base_->CreateFilter(keys, n, dst);
+  }
+  bool KeyMayMatch(const Slice& key, const Slice& filter) const override {
+    const char* lines = filter.data() + filter.size() % 64;
+    probes_.fetch_add(1, std::memory_order_relaxed);
+    if (reinterpret_cast<uintptr_t>(lines) % 64 != 0) {
+      misaligned_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return base_->KeyMayMatch(key, filter);
+  }
+
+  int probes() const { return probes_.load(std::memory_order_relaxed); }
+  int misaligned() const { return misaligned_.load(std::memory_order_relaxed); }
+
+ private:
+  const FilterPolicy* const base_;
+  mutable std::atomic<int> probes_;
+  mutable std::atomic<int> misaligned_;
+};
+
+}  // namespace
+
+TEST(DBTest, BlockedBloomFilterAlignment) {
+  const FilterPolicy* bloom = NewBlockedBloomFilterPolicy(10);
+  env_->misalign_reads_ = true;
+  // Per-block filters, then a whole-table filter.
+  for (int full = 0; full < 2; full++) {
+    AlignmentCheckingPolicy policy(bloom);
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.filter_policy = &policy;
+    options.whole_table_filter = (full == 1);
+    DestroyAndReopen(&options);
+
+    const int N = 1000;
+    for (int i = 0; i < N; i++) {
+      ASSERT_OK(Put(Key(i), Key(i)));
+    }
+    Compact("a", "z");
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ(Key(i), Get(Key(i)));
+      ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+    }
+    ASSERT_GT(policy.probes(), 0) << full;
+    ASSERT_EQ(0, policy.misaligned()) << full;
+    Close();
+  }
+  delete bloom;
+}
+
+TEST(DBTest, WholeTableFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBlockedBloomFilterPolicy(10);
+  options.whole_table_filter = true;
+  options.index_partition_size = 1024;
+  Reopen(&options);
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  // Present keys read an index partition and a data block, but rarely
+  // touch the small sstable.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_GE(reads, 2 * N);
+  ASSERT_LE(reads, 2 * N + 2 * 2 * N / 100);
+
+  // Missing keys are turned away before the index is searched.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 2 * 3 * N / 100);
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST(DBTest, MultiGetReadsEachBlockOnce) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  Reopen(&options);
+
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), std::string(100, 'a' + i % 26)));
+  }
+  Compact("a", "z");
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  // 200 adjacent keys fill a handful of 4KB blocks.
+  std::vector<std::string> key_data;
+  for (int i = 399; i >= 200; i--) {
+    key_data.push_back(Key(i));
+  }
+  std::vector<Slice> keys(key_data.begin(), key_data.end());
+  std::vector<std::string> values;
+  env_->random_read_counter_.Reset();
+  std::vector<Status> statuses = db_->MultiGet(ReadOptions(), keys, &values);
+  int reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d keys => %d reads\n", static_cast<int>(keys.size()),
+          reads);
+  ASSERT_GE(reads, 2);
+  ASSERT_LE(reads, 10);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_OK(statuses[i]);
+    ASSERT_EQ(std::string(100, 'a' + (399 - i) % 26), values[i]);
+  }
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+}
+
+TEST(DBTest, BlockCacheStats) {
+  Options options = CurrentOptions();
+  options.block_cache = NewLRUCache(1 << 20, 2);
+  Reopen(&options);
+
+  ASSERT_OK(Put("foo", "v1"));
+  Compact("a", "z");
+  for (int i = 0; i < 10; i++) {
+    ASSERT_EQ("v1", Get("foo"));
+  }
+
+  std::vector<CacheShardStats> shards;
+  options.block_cache->GetShardStats(&shards);
+  ASSERT_EQ(4u, shards.size());
+  uint64_t hits = 0, misses = 0;
+  for (const CacheShardStats& stats : shards) {
+    hits += stats.hits;
+    misses += stats.misses;
+  }
+  ASSERT_GE(hits, 9u);
+  ASSERT_GE(misses, 1u);
+
+  // A header, one line per shard and the total.
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.block-cache-stats", &property));
+  ASSERT_EQ(2 + 4 + 1, std::count(property.begin(), property.end(), '\n'));
+
+  Close();
+  delete options.block_cache;
+}
+
 // Multi-threaded test:
 namespace {
 
@@ -100,6 +100,13 @@ void InternalKeyComparator::FindShortSuccessor(std::string* key) const {
   }
 }
 
+bool InternalKeyComparator::BytewiseOrderedPart(const Slice& key,
+                                                Slice* part) const {
+  // Internal keys with different user keys order like the user keys.
+  if (key.size() < 8) return false;
+  return user_comparator_->BytewiseOrderedPart(ExtractUserKey(key), part);
+}
+
 const char* InternalFilterPolicy::Name() const { return user_policy_->Name(); }
 
 void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
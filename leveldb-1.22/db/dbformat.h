@@ -31,6 +31,10 @@ static const int kL0_SlowdownWritesTrigger = 8;
 // Maximum number of level-0 files.  We stop writes at this point.
 static const int kL0_StopWritesTrigger = 12;
 
+// Tables in levels up to this one are consulted by most lookups, so their
+// files are pinned (see RandomAccessFile::Pin()) while they stay there.
+static const int kMaxPinnedLevel = 1;
+
 // Maximum level to which a new compacted memtable is pushed if it
 // does not create overlap.  We try to push to level 2 to avoid the
 // relatively expensive level 0=>1 compactions and to avoid some
@@ -111,6 +115,7 @@ class InternalKeyComparator : public Comparator {
   virtual void FindShortestSeparator(std::string* start,
                                      const Slice& limit) const;
   virtual void FindShortSuccessor(std::string* key) const;
+  virtual bool BytewiseOrderedPart(const Slice& key, Slice* part) const;
 
   const Comparator* user_comparator() const { return user_comparator_; }
 
@@ -127,6 +132,9 @@ class InternalFilterPolicy : public FilterPolicy {
   virtual const char* Name() const;
   virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const;
   virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const;
+  size_t FilterAlignment() const override {
+    return user_policy_->FilterAlignment();
+  }
 };
 
 // Modules in this directory should keep internal keys wrapped inside
@@ -20,8 +20,11 @@ class MemTableIterator;
 class MemTable {
  public:
   // MemTables are reference counted.  The initial reference count
-  // is zero and the caller must call Ref() at least once.
-  explicit MemTable(const InternalKeyComparator& comparator);
+  // is zero and the caller must call Ref() at least once.  If "regions" is
+  // non-null, the memtable allocates from one of its regions first (see
+  // Arena(ArenaRegionPool*)); *regions must outlive the memtable.
+  explicit MemTable(const InternalKeyComparator& comparator,
+                    ArenaRegionPool* regions = nullptr);
 
   MemTable(const MemTable&) = delete;
   MemTable& operator=(const MemTable&) = delete;
@@ -56,6 +59,11 @@ class MemTable {
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
 
+  // Like Add(), but safe to call from several threads at once (though not
+  // at the same time as Add()).
+  void AddConcurrently(SequenceNumber seq, ValueType type, const Slice& key,
+                       const Slice& value);
+
   // If memtable contains a value for key, store it in *value and return true.
   // If memtable contains a deletion for key, store a NotFound() error
   // in *status and return true.
@@ -6,6 +6,8 @@
 
 #include <atomic>
 #include <set>
+#include <thread>
+#include <vector>
 
 #include "leveldb/env.h"
 #include "port/port.h"
@@ -224,6 +226,18 @@ class ConcurrentTest {
     current_.Set(k, g);
   }
 
+  // Like WriteStep(), but through InsertConcurrently() and only for the
+  // keys k with (k % num_writers) == writer, so that every key still has
+  // a single writer and num_writers threads can run it at once.
+  // REQUIRES: K % num_writers == 0
+  void ConcurrentWriteStep(Random* rnd, int writer, int num_writers) {
+    const uint32_t k = writer + num_writers * (rnd->Next() % (K / num_writers));
+    const intptr_t g = current_.Get(k) + 1;
+    const Key key = MakeKey(k, g);
+    list_.InsertConcurrently(key);
+    current_.Set(k, g);
+  }
+
   void ReadStep(Random* rnd) {
     // Remember the initial committed state of the skiplist.
     State initial_state;
@@ -358,11 +372,74 @@ static void RunConcurrent(int run) {
   }
 }
 
+// Like RunConcurrent(), but with num_writers threads inserting at once
+// through InsertConcurrently().
+static void RunConcurrentWriters(int run, int num_writers) {
+  const int seed = test::RandomSeed() + (run * 100);
+  const int N = 200;
+  const int kSize = 1000;
+  for (int i = 0; i < N; i++) {
+    if ((i % 50) == 0) {
+      fprintf(stderr, "Run %d of %d\n", i, N);
+    }
+    TestState state(seed + 1);
+    Env::Default()->Schedule(ConcurrentReader, &state);
+    state.Wait(TestState::RUNNING);
+
+    std::vector<std::thread> writers;
+    for (int w = 0; w < num_writers; w++) {
+      writers.emplace_back([&state, w, num_writers, seed]() {
+        Random rnd(seed + 2 + w);
+        for (int i = 0; i < kSize; i++) {
+          state.t_.ConcurrentWriteStep(&rnd, w, num_writers);
+        }
+      });
+    }
+    for (auto& writer : writers) {
+      writer.join();
+    }
+
+    state.quit_flag_.store(true, std::memory_order_release);
+    state.Wait(TestState::DONE);
+  }
+}
+
+TEST(SkipTest, ConcurrentInsertWithoutReaders) {
+  const int kThreads = 4;
+  const int kPerThread = 5000;
+  Arena arena;
+  SkipList<Key, Comparator> list(Comparator(), &arena);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&list, t]() {
+      // Interleave the threads' keys so they contend for the same links.
+      for (int i = 0; i < kPerThread; i++) {
+        list.InsertConcurrently(static_cast<Key>(i) * kThreads + t);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  SkipList<Key, Comparator>::Iterator iter(&list);
+  iter.SeekToFirst();
+  for (Key k = 0; k < kThreads * kPerThread; k++) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+    ASSERT_TRUE(list.Contains(k));
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+}
+
 TEST(SkipTest, Concurrent1) { RunConcurrent(1); }
 TEST(SkipTest, Concurrent2) { RunConcurrent(2); }
 TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
+TEST(SkipTest, ConcurrentWriters2) { RunConcurrentWriters(1, 2); }
+TEST(SkipTest, ConcurrentWriters4) { RunConcurrentWriters(2, 4); }
 
 }  // namespace leveldb
 
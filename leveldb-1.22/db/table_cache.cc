@@ -35,12 +35,13 @@ TableCache::TableCache(const std::string& dbname, const Options& options,
     : env_(options.env),
       dbname_(dbname),
       options_(options),
-      cache_(NewLRUCache(entries)) {}
+      cache_(options.use_clock_cache ? NewClockCache(entries, 4, 1)
+                                     : NewLRUCache(entries)) {}
 
 TableCache::~TableCache() { delete cache_; }
 
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
-                             Cache::Handle** handle) {
+                             Cache::Handle** handle, bool pin_file) {
   Status s;
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
@@ -81,6 +82,9 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
       *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
   }
+  if (s.ok() && pin_file) {
+    reinterpret_cast<TableAndFile*>(cache_->Value(*handle))->file->Pin();
+  }
   return s;
 }
 
@@ -109,11 +113,12 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
 Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
                        uint64_t file_size, const Slice& k, void* arg,
                        void (*handle_result)(void*, const Slice&,
-                                             const Slice&)) {
+                                             const Slice&),
+                       bool pin_file) {
   Cache::Handle* handle = nullptr;
   // fprintf(stderr, "TableCache::Get() filenumber:%lu file_size:%lu\n",
   // file_number, file_size);
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, &handle, pin_file);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
     s = t->InternalGet(options, k, arg, handle_result);
@@ -122,6 +127,32 @@ Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
   return s;
 }
 
+Status TableCache::MultiGet(const ReadOptions& options, uint64_t file_number,
+                            uint64_t file_size, const Slice* k,
+                            void* const* args, size_t num,
+                            void (*handle_result)(void*, const Slice&,
+                                                  const Slice&),
+                            bool pin_file) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle, pin_file);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    s = t->InternalMultiGet(options, k, args, num, handle_result);
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+void TableCache::Unpin(uint64_t file_number) {
+  char buf[sizeof(file_number)];
+  EncodeFixed64(buf, file_number);
+  Cache::Handle* handle = cache_->Lookup(Slice(buf, sizeof(buf)));
+  if (handle != nullptr) {
+    reinterpret_cast<TableAndFile*>(cache_->Value(handle))->file->Unpin();
+    cache_->Release(handle);
+  }
+}
+
 void TableCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
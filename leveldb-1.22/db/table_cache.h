@@ -36,16 +36,31 @@ class TableCache {
                         uint64_t file_size, Table** tableptr = nullptr);
 
   // If a seek to internal key "k" in specified file finds an entry,
-  // call (*handle_result)(arg, found_key, found_value).
+  // call (*handle_result)(arg, found_key, found_value).  If "pin_file" is
+  // true, the table's file is pinned (see RandomAccessFile::Pin()).
   Status Get(const ReadOptions& options, uint64_t file_number,
              uint64_t file_size, const Slice& k, void* arg,
-             void (*handle_result)(void*, const Slice&, const Slice&));
+             void (*handle_result)(void*, const Slice&, const Slice&),
+             bool pin_file = false);
+
+  // Like Get() for each of the internal keys k[0..num-1], which must be
+  // sorted, calling (*handle_result)(args[i], ...) for k[i].  The data
+  // blocks the keys need are read together (see Table::InternalMultiGet()).
+  Status MultiGet(const ReadOptions& options, uint64_t file_number,
+                  uint64_t file_size, const Slice* k, void* const* args,
+                  size_t num,
+                  void (*handle_result)(void*, const Slice&, const Slice&),
+                  bool pin_file = false);
 
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
+  // Unpin the file of the specified file number, if its table is open.
+  void Unpin(uint64_t file_number);
+
  private:
-  Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**,
+                   bool pin_file = false);
 
   Env* const env_;
   const std::string dbname_;
@@ -17,7 +17,8 @@ namespace leveldb {
 class VersionSet;
 
 struct FileMetaData {
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
+  FileMetaData()
+      : refs(0), allowed_seeks(1 << 30), file_size(0), being_compacted(false) {}
 
   int refs;
   int allowed_seeks;  // Seeks allowed until compaction
@@ -25,6 +26,7 @@ struct FileMetaData {
   uint64_t file_size;    // File size in bytes
   InternalKey smallest;  // Smallest internal key served by table
   InternalKey largest;   // Largest internal key served by table
+  bool being_compacted;  // Input of a running compaction; guarded by DB mutex
 };
 
 class VersionEdit {
@@ -7,6 +7,7 @@
 #include <stdio.h>
 
 #include <algorithm>
+#include <cstring>
 
 #include "db/filename.h"
 #include "db/log_reader.h"
@@ -15,6 +16,7 @@
 #include "db/table_cache.h"
 #include "leveldb/env.h"
 #include "leveldb/table_builder.h"
+#include "table/block.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
@@ -105,6 +107,122 @@ int FindFile(const InternalKeyComparator& icmp,
   return right;
 }
 
+// Fills prefixes[k] and ranks[k] for the subtree rooted at k of an
+// Eytzinger layout of sorted[*next..], advancing *next past what it used.
+static void FillEytzinger(const std::vector<uint64_t>& sorted, size_t k,
+                          size_t* next, std::vector<uint64_t>* prefixes,
+                          std::vector<uint32_t>* ranks) {
+  if (k > sorted.size()) return;
+  FillEytzinger(sorted, 2 * k, next, prefixes, ranks);
+  (*prefixes)[k] = sorted[*next];
+  (*ranks)[k] = static_cast<uint32_t>(*next);
+  ++*next;
+  FillEytzinger(sorted, 2 * k + 1, next, prefixes, ranks);
+}
+
+void LevelIndex::Build(const InternalKeyComparator& icmp,
+                       const std::vector<FileMetaData*>& files) {
+  built_ = false;
+  common_prefix_.clear();
+  prefixes_.clear();
+  ranks_.clear();
+  if (files.empty()) return;
+
+  std::vector<Slice> parts(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    if (!icmp.user_comparator()->BytewiseOrderedPart(
+            files[i]->largest.user_key(), &parts[i])) {
+      return;
+    }
+  }
+  // Keys that share their first bytes, like zero-padded numbers, would
+  // otherwise share their prefixes too.
+  size_t common = parts[0].size();
+  for (size_t i = 1; i < parts.size(); i++) {
+    size_t n = 0;
+    while (n < common && n < parts[i].size() && parts[0][n] == parts[i][n]) {
+      n++;
+    }
+    common = n;
+  }
+  common_prefix_.assign(parts[0].data(), common);
+
+  std::vector<uint64_t> sorted(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    parts[i].remove_prefix(common);
+    sorted[i] = BlockKeyPrefix(parts[i]);
+  }
+  prefixes_.resize(files.size() + 1);
+  ranks_.resize(files.size() + 1);
+  size_t next = 0;
+  FillEytzinger(sorted, 1, &next, &prefixes_, &ranks_);
+  built_ = true;
+}
+
+uint32_t LevelIndex::LowerBound(uint64_t prefix, uint64_t* found) const {
+  const size_t n = prefixes_.size() - 1;
+  size_t k = 1;
+  while (k <= n) {
+    k = 2 * k + (prefixes_[k] < prefix);
+  }
+  // The answer is where the search last went left: drop the right turns
+  // taken since, and that left turn.
+  while (k & 1) {
+    k >>= 1;
+  }
+  k >>= 1;
+  if (k == 0) {
+    return static_cast<uint32_t>(n);
+  }
+  *found = prefixes_[k];
+  return ranks_[k];
+}
+
+int LevelIndex::Find(const InternalKeyComparator& icmp,
+                     const std::vector<FileMetaData*>& files,
+                     const Slice& key) const {
+  Slice part;
+  if (!built_ || !icmp.user_comparator()->BytewiseOrderedPart(
+                     ExtractUserKey(key), &part)) {
+    return FindFile(icmp, files, key);
+  }
+
+  // A key that does not start with the bytes the largest keys share comes
+  // before or after all of them.
+  const size_t common = common_prefix_.size();
+  const int r = memcmp(part.data(), common_prefix_.data(),
+                       std::min(part.size(), common));
+  if (r < 0 || (r == 0 && part.size() < common)) {
+    return 0;
+  } else if (r > 0) {
+    return static_cast<int>(files.size());
+  }
+  part.remove_prefix(common);
+  const uint64_t prefix = BlockKeyPrefix(part);
+
+  // Files with a smaller prefix end before the key, and the first file
+  // with a larger one ends after it.  Only the files in between, whose
+  // prefix equals the key's, are compared in full.
+  uint64_t found = 0;
+  uint32_t left = LowerBound(prefix, &found);
+  if (left == files.size() || found != prefix) {
+    return left;
+  }
+  uint32_t right = prefix == ~uint64_t{0}
+                       ? static_cast<uint32_t>(files.size())
+                       : LowerBound(prefix + 1, &found);
+  while (left < right) {
+    uint32_t mid = (left + right) / 2;
+    if (icmp.InternalKeyComparator::Compare(files[mid]->largest.Encode(),
+                                            key) < 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  return right;
+}
+
 static bool AfterFile(const Comparator* ucmp, const Slice* user_key,
                       const FileMetaData* f) {
   // null user_key occurs before all keys and is therefore never after *f
@@ -275,6 +393,71 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
   }
 }
 
+namespace {
+// The lookups of a Version::MultiGet() call, each with the state Get()
+// keeps for its one lookup.
+struct MultiGetState {
+  const LookupKey* const* keys;
+  Status* statuses;
+  Version::GetStats* stats;
+  std::vector<Saver> savers;
+  std::vector<FileMetaData*> last_file_read;
+  std::vector<int> last_file_read_level;
+  std::vector<bool> done;
+};
+}  // namespace
+
+// Searches "f", a file of "level", for the keys of state->keys indexed by
+// "batch", and marks those it resolves done.
+static void MultiGetFromFile(TableCache* table_cache,
+                             const ReadOptions& options, int level,
+                             FileMetaData* f, const std::vector<size_t>& batch,
+                             MultiGetState* state) {
+  std::vector<Slice> ikeys;
+  std::vector<void*> args;
+  ikeys.reserve(batch.size());
+  args.reserve(batch.size());
+  for (size_t i : batch) {
+    Version::GetStats* stats = &state->stats[i];
+    if (state->last_file_read[i] != nullptr && stats->seek_file == nullptr) {
+      // We have had more than one seek for this read.  Charge the 1st file.
+      stats->seek_file = state->last_file_read[i];
+      stats->seek_file_level = state->last_file_read_level[i];
+    }
+    state->last_file_read[i] = f;
+    state->last_file_read_level[i] = level;
+    ikeys.push_back(state->keys[i]->internal_key());
+    args.push_back(&state->savers[i]);
+  }
+
+  Status s = table_cache->MultiGet(options, f->number, f->file_size,
+                                   ikeys.data(), args.data(), ikeys.size(),
+                                   SaveValue, level <= config::kMaxPinnedLevel);
+  for (size_t i : batch) {
+    if (!s.ok()) {
+      state->statuses[i] = s;
+      state->done[i] = true;
+      continue;
+    }
+    switch (state->savers[i].state) {
+      case kNotFound:
+        break;  // Keep searching in other files
+      case kFound:
+        state->done[i] = true;
+        break;
+      case kDeleted:
+        state->statuses[i] = Status::NotFound(Slice());
+        state->done[i] = true;
+        break;
+      case kCorrupt:
+        state->statuses[i] =
+            Status::Corruption("corrupted key for ", state->savers[i].user_key);
+        state->done[i] = true;
+        break;
+    }
+  }
+}
+
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
   return a->number > b->number;
 }
@@ -309,7 +492,8 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
     if (num_files == 0) continue;
 
     // Binary search to find earliest index whose largest key >= internal_key.
-    uint32_t index = FindFile(vset_->icmp_, files_[level], internal_key);
+    uint32_t index =
+        level_indexes_[level].Find(vset_->icmp_, files_[level], internal_key);
     if (index < num_files) {
       FileMetaData* f = files_[level][index];
       if (ucmp->Compare(user_key, f->smallest.user_key()) < 0) {
@@ -364,7 +548,8 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       num_files = tmp.size();
     } else {
       // Binary search to find earliest index whose largest key >= ikey.
-      uint32_t index = FindFile(vset_->icmp_, files_[level], ikey);
+      uint32_t index =
+          level_indexes_[level].Find(vset_->icmp_, files_[level], ikey);
       if (index >= num_files) {
         files = nullptr;
         num_files = 0;
@@ -398,7 +583,8 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       saver.user_key = user_key;
       saver.value = value;
       s = vset_->table_cache_->Get(options, f->number, f->file_size, ikey,
-                                   &saver, SaveValue);
+                                   &saver, SaveValue,
+                                   level <= config::kMaxPinnedLevel);
       if (!s.ok()) {
         return s;
       }
@@ -420,6 +606,101 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   return Status::NotFound(Slice());  // Use an empty error message for speed
 }
 
+void Version::MultiGet(const ReadOptions& options, const LookupKey* const* keys,
+                       size_t num, std::string* const* vals, Status* statuses,
+                       GetStats* stats) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  MultiGetState state;
+  state.keys = keys;
+  state.statuses = statuses;
+  state.stats = stats;
+  state.savers.resize(num);
+  state.last_file_read.assign(num, nullptr);
+  state.last_file_read_level.assign(num, -1);
+  state.done.assign(num, false);
+  std::vector<size_t> pending;  // Keys not resolved by an earlier level
+  for (size_t i = 0; i < num; i++) {
+    Saver& saver = state.savers[i];
+    saver.state = kNotFound;
+    saver.ucmp = ucmp;
+    saver.user_key = keys[i]->user_key();
+    saver.value = vals[i];
+    statuses[i] = Status::OK();
+    stats[i].seek_file = nullptr;
+    stats[i].seek_file_level = -1;
+    pending.push_back(i);
+  }
+
+  // As in Get(), a key found in a level is not looked for in later ones.
+  std::vector<size_t> batch;
+  for (int level = 0; level < config::kNumLevels && !pending.empty();
+       level++) {
+    const std::vector<FileMetaData*>& files = files_[level];
+    if (files.empty()) continue;
+
+    if (level == 0) {
+      // Level-0 files may overlap each other.  Search them from newest to
+      // oldest, each for the keys it overlaps that no newer file resolved.
+      std::vector<FileMetaData*> tmp(files);
+      std::sort(tmp.begin(), tmp.end(), NewestFirst);
+      for (FileMetaData* f : tmp) {
+        batch.clear();
+        for (size_t i : pending) {
+          const Slice user_key = keys[i]->user_key();
+          if (!state.done[i] &&
+              ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+              ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
+            batch.push_back(i);
+          }
+        }
+        if (!batch.empty()) {
+          MultiGetFromFile(vset_->table_cache_, options, level, f, batch,
+                           &state);
+        }
+      }
+    } else {
+      // The keys are sorted, so the keys that fall in one file are adjacent.
+      FileMetaData* batch_file = nullptr;
+      batch.clear();
+      for (size_t i : pending) {
+        FileMetaData* f = nullptr;
+        uint32_t index = level_indexes_[level].Find(vset_->icmp_, files,
+                                                    keys[i]->internal_key());
+        if (index < files.size() &&
+            ucmp->Compare(keys[i]->user_key(),
+                          files[index]->smallest.user_key()) >= 0) {
+          f = files[index];
+        }
+        if (f != batch_file && !batch.empty()) {
+          MultiGetFromFile(vset_->table_cache_, options, level, batch_file,
+                           batch, &state);
+          batch.clear();
+        }
+        batch_file = f;
+        if (f != nullptr) {
+          batch.push_back(i);
+        }
+      }
+      if (!batch.empty()) {
+        MultiGetFromFile(vset_->table_cache_, options, level, batch_file,
+                         batch, &state);
+      }
+    }
+
+    size_t remaining = 0;
+    for (size_t i : pending) {
+      if (!state.done[i]) {
+        pending[remaining++] = i;
+      }
+    }
+    pending.resize(remaining);
+  }
+
+  for (size_t i : pending) {
+    statuses[i] = Status::NotFound(Slice());  // Use an empty error message
+  }
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != nullptr) {
@@ -790,6 +1071,9 @@ void VersionSet::AppendVersion(Version* v) {
   }
   current_ = v;
   v->Ref();
+  for (int level = 1; level < config::kNumLevels; level++) {
+    v->level_indexes_[level].Build(icmp_, v->files_[level]);
+  }
 
   // Append to linked list
   v->prev_ = dummy_versions_.prev_;
@@ -1075,6 +1359,7 @@ void VersionSet::Finalize(Version* v) {
           static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
     }
 
+    v->compaction_scores_[level] = score;
     if (score > best_score) {
       best_level = level;
       best_score = score;
@@ -1268,45 +1553,103 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
 }
 
 Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
-
   // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != nullptr);
-  if (size_compaction) {
-    level = current_->compaction_level_;
-    assert(level >= 0);
-    assert(level + 1 < config::kNumLevels);
-    c = new Compaction(options_, level);
-
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
-        break;
-      }
+  // the compactions triggered by seeks.  Levels are tried in decreasing
+  // order of score, so that a level whose candidates are all busy in
+  // running compactions does not hold up the others.
+  int levels[config::kNumLevels - 1];
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    levels[level] = level;
+  }
+  const Version* v = current_;
+  std::stable_sort(levels, levels + config::kNumLevels - 1,
+                   [v](int a, int b) {
+                     return v->compaction_scores_[a] > v->compaction_scores_[b];
+                   });
+  for (int i = 0; i < config::kNumLevels - 1; i++) {
+    if (v->compaction_scores_[levels[i]] < 1) {
+      break;
     }
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+    Compaction* c = PickSizeCompaction(levels[i]);
+    if (c != nullptr) {
+      return c;
     }
-  } else if (seek_compaction) {
-    level = current_->file_to_compact_level_;
-    c = new Compaction(options_, level);
+  }
+
+  if (current_->file_to_compact_ != nullptr &&
+      !current_->file_to_compact_->being_compacted) {
+    const int level = current_->file_to_compact_level_;
+    const std::string saved_pointer = compact_pointer_[level];
+    Compaction* c = new Compaction(options_, level);
     c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
+    SetupInputs(c);
+    if (!c->InputsBeingCompacted()) {
+      return c;
+    }
+    compact_pointer_[level] = saved_pointer;
+    delete c;
+  }
+  return nullptr;
+}
+
+Compaction* VersionSet::PickSizeCompaction(int level) {
+  const std::vector<FileMetaData*>& files = current_->files_[level];
+  if (files.empty()) {
     return nullptr;
   }
+  if (level == 0) {
+    // Level-0 compactions pick up all overlapping level-0 files, so two of
+    // them cannot run at once.
+    for (size_t i = 0; i < files.size(); i++) {
+      if (files[i]->being_compacted) {
+        return nullptr;
+      }
+    }
+  }
+
+  // Pick the first file that comes after compact_pointer_[level]
+  size_t first = 0;
+  if (!compact_pointer_[level].empty()) {
+    while (first < files.size() &&
+           icmp_.Compare(files[first]->largest.Encode(),
+                         compact_pointer_[level]) <= 0) {
+      first++;
+    }
+    if (first == files.size()) {
+      // Wrap-around to the beginning of the key space
+      first = 0;
+    }
+  }
 
+  // If that file, or the files it pulls in, are being compacted, move on
+  // to the next one.
+  const std::string saved_pointer = compact_pointer_[level];
+  for (size_t n = 0; n < files.size(); n++) {
+    FileMetaData* f = files[(first + n) % files.size()];
+    if (f->being_compacted) {
+      continue;
+    }
+    Compaction* c = new Compaction(options_, level);
+    c->inputs_[0].push_back(f);
+    SetupInputs(c);
+    if (!c->InputsBeingCompacted()) {
+      return c;
+    }
+    compact_pointer_[level] = saved_pointer;
+    delete c;
+    if (level == 0) {
+      break;
+    }
+  }
+  return nullptr;
+}
+
+void VersionSet::SetupInputs(Compaction* c) {
   c->input_version_ = current_;
   c->input_version_->Ref();
 
   // Files in level 0 may overlap each other, so pick up all overlapping ones
-  if (level == 0) {
+  if (c->level() == 0) {
     InternalKey smallest, largest;
     GetRange(c->inputs_[0], &smallest, &largest);
     // Note that the next call will discard the file we placed in
@@ -1317,8 +1660,6 @@ Compaction* VersionSet::PickCompaction() {
   }
 
   SetupOtherInputs(c);
-
-  return c;
 }
 
 // Finds the largest key in a vector of files. Returns true if files it not
@@ -1582,4 +1923,84 @@ void Compaction::ReleaseInputs() {
   }
 }
 
+void Compaction::MarkInputsBeingCompacted(bool value) {
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      assert(inputs_[which][i]->being_compacted != value);
+      inputs_[which][i]->being_compacted = value;
+    }
+  }
+}
+
+void Compaction::SplitKeyRanges(int max_ranges,
+                                std::vector<std::string>* boundaries) const {
+  boundaries->clear();
+  if (max_ranges <= 1) {
+    return;
+  }
+
+  std::vector<std::pair<Slice, uint64_t>> ends;  // (largest user key, size)
+  uint64_t total = 0;
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      FileMetaData* f = inputs_[which][i];
+      ends.push_back(std::make_pair(f->largest.user_key(), f->file_size));
+      total += f->file_size;
+    }
+  }
+
+  // Ranges smaller than an output file would only produce small files.
+  uint64_t ranges = total / max_output_file_size_;
+  if (ranges > static_cast<uint64_t>(max_ranges)) {
+    ranges = max_ranges;
+  }
+  if (ranges <= 1) {
+    return;
+  }
+
+  const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
+  std::sort(ends.begin(), ends.end(),
+            [user_cmp](const std::pair<Slice, uint64_t>& a,
+                       const std::pair<Slice, uint64_t>& b) {
+              return user_cmp->Compare(a.first, b.first) < 0;
+            });
+  // Cut after the file that takes the running total past the next
+  // multiple of total/ranges.  The data of a file is attributed to its
+  // largest key, which is good enough for files of similar size.
+  const uint64_t target = total / ranges;
+  uint64_t sum = 0;
+  for (size_t i = 0; i + 1 < ends.size() && boundaries->size() + 1 < ranges;
+       i++) {
+    sum += ends[i].second;
+    if (sum >= target * (boundaries->size() + 1) &&
+        (boundaries->empty() ||
+         user_cmp->Compare(ends[i].first, boundaries->back()) > 0)) {
+      boundaries->push_back(ends[i].first.ToString());
+    }
+  }
+}
+
+Compaction* Compaction::CloneForKeyRange() const {
+  Compaction* c = new Compaction(*this);
+  c->input_version_->Ref();
+  c->grandparent_index_ = 0;
+  c->seen_key_ = false;
+  c->overlapped_bytes_ = 0;
+  for (int i = 0; i < config::kNumLevels; i++) {
+    c->level_ptrs_[i] = 0;
+  }
+  return c;
+}
+
+bool Compaction::InputsBeingCompacted() const {
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      if (inputs_[which][i]->being_compacted) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
 }  // namespace leveldb
@@ -17,6 +17,7 @@
 
 #include <map>
 #include <set>
+#include <string>
 #include <vector>
 
 #include "db/dbformat.h"
@@ -45,6 +46,42 @@ class WritableFile;
 int FindFile(const InternalKeyComparator& icmp,
              const std::vector<FileMetaData*>& files, const Slice& key);
 
+// A search structure over the largest keys of a sorted list of
+// non-overlapping files, for finding the file a key falls in without
+// chasing pointers to every key that a binary search would compare.  It
+// holds an 8-byte prefix of each largest key, after the bytes all of them
+// share, in Eytzinger (breadth-first) order, so that the first steps of a
+// search touch the same few cache lines.  Only files whose prefix equals
+// the key's are compared in full.
+class LevelIndex {
+ public:
+  LevelIndex() = default;
+
+  // Builds the index over "files".  The index stays empty, and Find()
+  // falls back on FindFile(), if "files" is empty or the comparator does
+  // not expose a bytewise-ordered part of its keys (see
+  // Comparator::BytewiseOrderedPart()).
+  // REQUIRES: "files" contains a sorted list of non-overlapping files.
+  void Build(const InternalKeyComparator& icmp,
+             const std::vector<FileMetaData*>& files);
+
+  // Returns FindFile(icmp, files, key).
+  // REQUIRES: "files" is what the index was last built over.
+  int Find(const InternalKeyComparator& icmp,
+           const std::vector<FileMetaData*>& files, const Slice& key) const;
+
+ private:
+  // Returns the position in files of the first prefix >= "prefix", and
+  // stores that prefix in *found, or returns the number of files if there
+  // is none.
+  uint32_t LowerBound(uint64_t prefix, uint64_t* found) const;
+
+  bool built_ = false;
+  std::string common_prefix_;       // Shared by the largest keys of all files
+  std::vector<uint64_t> prefixes_;  // 1-based, in Eytzinger order
+  std::vector<uint32_t> ranks_;     // Position in files of each prefix
+};
+
 // Returns true iff some file in "files" overlaps the user key range
 // [*smallest,*largest].
 // smallest==nullptr represents a key smaller than all keys in the DB.
@@ -75,6 +112,14 @@ class Version {
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
              GetStats* stats);
 
+  // Looks up each of keys[0..num-1] as Get() would, setting *vals[i],
+  // statuses[i] and stats[i] for keys[i].  The keys should be sorted by
+  // user key; a table file is searched once for all the keys that may be
+  // in it (see TableCache::MultiGet()).
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, const LookupKey* const* keys, size_t num,
+                std::string* const* vals, Status* statuses, GetStats* stats);
+
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
   // REQUIRES: lock is held
@@ -128,7 +173,11 @@ class Version {
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {}
+        compaction_level_(-1) {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      compaction_scores_[level] = -1;
+    }
+  }
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
@@ -153,6 +202,10 @@ class Version {
   // List of files per level
   std::vector<FileMetaData*> files_[config::kNumLevels];
 
+  // Search structures over files_[1..], built when the version is made
+  // current (see VersionSet::AppendVersion()).
+  LevelIndex level_indexes_[config::kNumLevels];
+
   // Next file to compact based on seek stats.
   FileMetaData* file_to_compact_;
   int file_to_compact_level_;
@@ -162,6 +215,10 @@ class Version {
   // are initialized by Finalize().
   double compaction_score_;
   int compaction_level_;
+
+  // Compaction score of every level, so that another level can be picked
+  // when the best one is busy with running compactions.
+  double compaction_scores_[config::kNumLevels];
 };
 
 class VersionSet {
@@ -228,7 +285,8 @@ class VersionSet {
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
   // Pick level and inputs for a new compaction.
-  // Returns nullptr if there is no compaction to be done.
+  // Returns nullptr if there is no compaction to be done, or if every
+  // candidate shares inputs with a compaction that is still running.
   // Otherwise returns a pointer to a heap-allocated object that
   // describes the compaction.  Caller should delete the result.
   Compaction* PickCompaction();
@@ -279,6 +337,13 @@ class VersionSet {
 
   void Finalize(Version* v);
 
+  // Returns a compaction of the "level" files that comes after
+  // compact_pointer_[level], or nullptr if all candidates are busy.
+  Compaction* PickSizeCompaction(int level);
+
+  // Adds the inputs that the files already in c->inputs_[0] require.
+  void SetupInputs(Compaction* c);
+
   void GetRange(const std::vector<FileMetaData*>& inputs, InternalKey* smallest,
                 InternalKey* largest);
 
@@ -357,6 +422,28 @@ class Compaction {
   // is successful.
   void ReleaseInputs();
 
+  // Set FileMetaData::being_compacted of all inputs to "value", so that
+  // concurrent compactions do not pick the same files.
+  // REQUIRES: DB mutex held.
+  void MarkInputsBeingCompacted(bool value);
+
+  // Returns true iff some input is part of another running compaction.
+  // REQUIRES: DB mutex held.
+  bool InputsBeingCompacted() const;
+
+  // Picks up to max_ranges-1 user keys, taken from the largest keys of the
+  // inputs, that cut the compaction into key ranges of similar input size.
+  // Range i covers the user keys after (*boundaries)[i-1] up to and
+  // including (*boundaries)[i].  Leaves *boundaries empty if the
+  // compaction is too small to be worth splitting.
+  void SplitKeyRanges(int max_ranges, std::vector<std::string>* boundaries) const;
+
+  // Returns a copy of this compaction with its own ShouldStopBefore() and
+  // IsBaseLevelForKey() state, for merging one of the key ranges on
+  // another thread.  Caller should delete the result.
+  // REQUIRES: DB mutex held.
+  Compaction* CloneForKeyRange() const;
+
  private:
   friend class Version;
   friend class VersionSet;
@@ -3,7 +3,11 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "db/version_set.h"
+
+#include <algorithm>
+
 #include "util/logging.h"
+#include "util/random.h"
 #include "util/testharness.h"
 #include "util/testutil.h"
 
@@ -32,7 +36,14 @@ class FindFileTest {
   int Find(const char* key) {
     InternalKey target(key, 100, kTypeValue);
     InternalKeyComparator cmp(BytewiseComparator());
-    return FindFile(cmp, files_, target.Encode());
+    const int index = FindFile(cmp, files_, target.Encode());
+    if (disjoint_sorted_files_) {
+      // The level index must agree with the binary search.
+      LevelIndex level_index;
+      level_index.Build(cmp, files_);
+      ASSERT_EQ(index, level_index.Find(cmp, files_, target.Encode()));
+    }
+    return index;
   }
 
   bool Overlaps(const char* smallest, const char* largest) {
@@ -46,7 +57,7 @@ class FindFileTest {
 
   bool disjoint_sorted_files_;
 
- private:
+ protected:
   std::vector<FileMetaData*> files_;
 };
 
@@ -146,6 +157,36 @@ TEST(FindFileTest, MultipleNullBoundaries) {
   ASSERT_TRUE(Overlaps("450", nullptr));
 }
 
+TEST(FindFileTest, LevelIndex) {
+  // Keys of different lengths that share a long prefix, as zero-padded
+  // numbers do, and files that end with the same user key.
+  Random rnd(301);
+  InternalKeyComparator cmp(BytewiseComparator());
+  std::vector<std::string> user_keys;
+  for (int i = 0; i < 1000; i++) {
+    std::string key = "user0000" + std::to_string(rnd.Uniform(1 << 20));
+    key.append(rnd.Uniform(3), static_cast<char>(rnd.Uniform(256)));
+    user_keys.push_back(key);
+  }
+  std::sort(user_keys.begin(), user_keys.end());
+  for (size_t i = 0; i + 1 < user_keys.size(); i += 2) {
+    Add(user_keys[i].c_str(), user_keys[i + 1].c_str(), 200, 100);
+  }
+  Add(user_keys.back().c_str(), user_keys.back().c_str(), 100, 50);
+
+  LevelIndex level_index;
+  level_index.Build(cmp, files_);
+  for (int i = 0; i < 5000; i++) {
+    std::string key = i % 2 == 0 ? user_keys[rnd.Uniform(user_keys.size())]
+                                 : "user" + std::to_string(rnd.Uniform(10000));
+    if (rnd.OneIn(3)) key.resize(rnd.Uniform(key.size() + 1));
+    if (rnd.OneIn(3)) key.push_back(static_cast<char>(rnd.Uniform(256)));
+    InternalKey target(key, rnd.Uniform(300), kTypeValue);
+    ASSERT_EQ(FindFile(cmp, files_, target.Encode()),
+              level_index.Find(cmp, files_, target.Encode()));
+  }
+}
+
 TEST(FindFileTest, OverlapSequenceChecks) {
   Add("200", "200", 5000, 3000);
   ASSERT_TRUE(!Overlaps("199", "199"));
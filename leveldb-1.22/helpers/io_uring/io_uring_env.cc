@@ -0,0 +1,671 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "helpers/io_uring/io_uring_env.h"
+
+#if defined(__linux__) && !defined(JL_LIBCFS) && \
+    __has_include(<linux/io_uring.h>)
+#define LEVELDB_HAVE_IO_URING 1
+#else
+#define LEVELDB_HAVE_IO_URING 0
+#endif
+
+#if LEVELDB_HAVE_IO_URING
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <string>
+#endif  // LEVELDB_HAVE_IO_URING
+
+#include "leveldb/env.h"
+#include "leveldb/status.h"
+#include "util/env_posix_limits.h"
+
+namespace leveldb {
+
+#if LEVELDB_HAVE_IO_URING
+
+namespace {
+
+// Submission queue entries per thread. MultiRead() issues larger batches in
+// several rounds.
+constexpr const unsigned kRingEntries = 64;
+
+constexpr const size_t kWritableFileBufferSize = 65536;
+
+Status IoUringError(const std::string& context, int error_number) {
+  if (error_number == ENOENT) {
+    return Status::NotFound(context, std::strerror(error_number));
+  } else {
+    return Status::IOError(context, std::strerror(error_number));
+  }
+}
+
+// A minimal io_uring instance, used by one thread. Every batch of requests is
+// submitted and waited for before the next one is prepared, so buffers never
+// outlive their requests and the completion queue cannot overflow.
+class Ring {
+ public:
+  // Returns nullptr if the kernel refuses to set up a ring.
+  static Ring* Open(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+      return nullptr;
+    }
+    std::unique_ptr<Ring> ring(new Ring(fd));
+    return ring->Map(params) ? ring.release() : nullptr;
+  }
+
+  Ring(const Ring&) = delete;
+  Ring& operator=(const Ring&) = delete;
+
+  ~Ring() {
+    if (sqes_ != nullptr) {
+      ::munmap(sqes_, sqes_size_);
+    }
+    if (cq_ptr_ != nullptr && cq_ptr_ != sq_ptr_) {
+      ::munmap(cq_ptr_, cq_size_);
+    }
+    if (sq_ptr_ != nullptr) {
+      ::munmap(sq_ptr_, sq_size_);
+    }
+    ::close(fd_);
+  }
+
+  // Returns true if the kernel supports all of |ops|.
+  bool Supports(std::initializer_list<int> ops) const {
+    constexpr int kMaxOps = 256;
+    std::unique_ptr<char[]> buf(
+        new char[sizeof(io_uring_probe) + kMaxOps * sizeof(io_uring_probe_op)]());
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buf.get());
+    if (::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe,
+                  kMaxOps) < 0) {
+      return false;  // Older than 5.6, which also lacks IORING_OP_READ.
+    }
+    for (int op : ops) {
+      if (op > probe->last_op ||
+          (probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Maximum number of requests in one batch.
+  unsigned capacity() const { return sq_entries_; }
+
+  // True once a submission failed in a way that may have left requests in
+  // the ring; the ring must not be used again.
+  bool broken() const { return broken_; }
+
+  // Returns a zeroed submission entry for a request whose result is reported
+  // under "index" by SubmitAndWait().
+  //
+  // REQUIRES: Fewer than capacity() requests are pending, index < capacity().
+  io_uring_sqe* Prepare(unsigned index) {
+    const unsigned slot = (sq_tail_local_ + pending_) & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[slot];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = index;
+    sq_array_[slot] = slot;
+    pending_++;
+    return sqe;
+  }
+
+  // Submits the pending requests and waits for all of them to complete,
+  // storing the result of the request prepared with index i in results[i].
+  // Returns 0, or -errno if io_uring_enter() fails.
+  int SubmitAndWait(int* results) {
+    sq_tail_local_ += pending_;
+    __atomic_store_n(sq_tail_, sq_tail_local_, __ATOMIC_RELEASE);
+    unsigned to_submit = pending_;
+    unsigned outstanding = pending_;
+    pending_ = 0;
+    while (outstanding > 0) {
+      int ret = static_cast<int>(::syscall(__NR_io_uring_enter, fd_, to_submit,
+                                           1, IORING_ENTER_GETEVENTS,
+                                           nullptr, 0));
+      if (ret < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+          continue;  // Retry
+        }
+        broken_ = true;
+        return -errno;
+      }
+      to_submit -= std::min(to_submit, static_cast<unsigned>(ret));
+
+      unsigned head = *cq_head_;
+      const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      while (head != tail) {
+        const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+        results[cqe.user_data] = cqe.res;
+        head++;
+        outstanding--;
+      }
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+  }
+
+ private:
+  explicit Ring(int fd) : fd_(fd) {}
+
+  bool Map(const io_uring_params& params) {
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    }
+    void* sq = ::mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+      return false;
+    }
+    sq_ptr_ = static_cast<char*>(sq);
+    if (single_mmap) {
+      cq_ptr_ = sq_ptr_;
+    } else {
+      void* cq = ::mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+      if (cq == MAP_FAILED) {
+        return false;
+      }
+      cq_ptr_ = static_cast<char*>(cq);
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      return false;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    sq_tail_ = reinterpret_cast<unsigned*>(sq_ptr_ + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq_ptr_ + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq_ptr_ + params.sq_off.array);
+    sq_entries_ = params.sq_entries;
+    sq_tail_local_ = *sq_tail_;
+    cq_head_ = reinterpret_cast<unsigned*>(cq_ptr_ + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq_ptr_ + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq_ptr_ + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq_ptr_ + params.cq_off.cqes);
+    return true;
+  }
+
+  const int fd_;
+  bool broken_ = false;
+
+  char* sq_ptr_ = nullptr;
+  char* cq_ptr_ = nullptr;  // Equal to sq_ptr_ with IORING_FEAT_SINGLE_MMAP.
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sq_size_ = 0;
+  size_t cq_size_ = 0;
+  size_t sqes_size_ = 0;
+
+  unsigned* sq_tail_ = nullptr;
+  unsigned* sq_array_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned sq_entries_ = 0;
+  unsigned sq_tail_local_ = 0;  // Only this thread advances the tail.
+  unsigned pending_ = 0;        // Prepared but not yet submitted.
+
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+};
+
+// Returns the calling thread's ring, or nullptr if none can be set up (e.g.
+// because of RLIMIT_MEMLOCK on older kernels), in which case callers fall
+// back to plain system calls.
+Ring* ThreadRing() {
+  thread_local std::unique_ptr<Ring> ring;
+  thread_local bool failed = false;
+  if ((ring == nullptr && !failed) || (ring != nullptr && ring->broken())) {
+    ring.reset(Ring::Open(kRingEntries));
+    failed = (ring == nullptr);
+  }
+  return ring.get();
+}
+
+// Returns true if the kernel has io_uring with the operations used here.
+bool IoUringSupported() {
+  std::unique_ptr<Ring> ring(Ring::Open(4));
+  return ring != nullptr &&
+         ring->Supports({IORING_OP_READ, IORING_OP_WRITE, IORING_OP_FSYNC});
+}
+
+class IoUringRandomAccessFile final : public RandomAccessFile {
+ public:
+  // The new instance takes ownership of |fd|. |fd_limiter| and |fd_cache|
+  // must outlive this instance. |fd_limiter| is used to determine if the
+  // instance keeps |fd| open; otherwise reads borrow a descriptor from
+  // |fd_cache|.
+  IoUringRandomAccessFile(std::string filename, int fd, Limiter* fd_limiter,
+                          ReadOnlyFdCache* fd_cache)
+      : has_permanent_fd_(fd_limiter->Acquire()),
+        fd_(has_permanent_fd_ ? fd : -1),
+        fd_limiter_(fd_limiter),
+        fd_cache_(fd_cache),
+        filename_(std::move(filename)) {
+    if (!has_permanent_fd_) {
+      assert(fd_ == -1);
+      ::close(fd);  // The file will be opened through fd_cache_.
+      fd_cache_->Register(filename_);
+    }
+  }
+
+  ~IoUringRandomAccessFile() override {
+    if (has_permanent_fd_) {
+      assert(fd_ != -1);
+      ::close(fd_);
+      fd_limiter_->Release();
+    } else {
+      fd_cache_->Unregister(filename_);
+    }
+  }
+
+  // Files with a permanent descriptor have nothing to pin.
+  void Pin() override {
+    if (!has_permanent_fd_) {
+      fd_cache_->Pin(filename_);
+    }
+  }
+
+  void Unpin() override {
+    if (!has_permanent_fd_) {
+      fd_cache_->Unpin(filename_);
+    }
+  }
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    ReadRequest req;
+    req.offset = offset;
+    req.n = n;
+    req.scratch = scratch;
+    MultiRead(&req, 1);
+    *result = req.result;
+    return req.status;
+  }
+
+  Status MultiRead(ReadRequest* reqs, size_t num) const override {
+    if (has_permanent_fd_) {
+      return MultiReadFrom(fd_, reqs, num);
+    }
+    int fd = fd_cache_->Acquire(filename_);
+    if (fd < 0) {
+      const int error_number = errno;
+      for (size_t i = 0; i < num; i++) {
+        Finish(&reqs[i], -error_number);
+      }
+      return IoUringError(filename_, error_number);
+    }
+    Status s = MultiReadFrom(fd, reqs, num);
+    fd_cache_->Release(filename_);
+    return s;
+  }
+
+ private:
+  Status MultiReadFrom(int fd, ReadRequest* reqs, size_t num) const {
+    Ring* ring = ThreadRing();
+    Status s;
+    if (ring == nullptr) {
+      for (size_t i = 0; i < num; i++) {
+        ReadRequest& req = reqs[i];
+        ssize_t read_size = ::pread(fd, req.scratch, req.n,
+                                    static_cast<off_t>(req.offset));
+        Finish(&req, read_size < 0 ? -errno : static_cast<int>(read_size));
+        if (s.ok()) {
+          s = req.status;
+        }
+      }
+      return s;
+    }
+
+    int results[kRingEntries];
+    const size_t batch = std::min<size_t>(ring->capacity(), kRingEntries);
+    for (size_t first = 0; first < num; first += batch) {
+      const size_t count = std::min(batch, num - first);
+      for (size_t i = 0; i < count; i++) {
+        const ReadRequest& req = reqs[first + i];
+        io_uring_sqe* sqe = ring->Prepare(static_cast<unsigned>(i));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(req.scratch);
+        sqe->len = static_cast<uint32_t>(req.n);
+        sqe->off = req.offset;
+      }
+      int ret = ring->SubmitAndWait(results);
+      for (size_t i = 0; i < count; i++) {
+        ReadRequest& req = reqs[first + i];
+        Finish(&req, ret < 0 ? ret : results[i]);
+        if (s.ok()) {
+          s = req.status;
+        }
+      }
+    }
+    return s;
+  }
+
+  // Fills in the outputs of |req| from |res|, a byte count or -errno.
+  void Finish(ReadRequest* req, int res) const {
+    if (res < 0) {
+      req->result = Slice(req->scratch, 0);
+      req->status = IoUringError(filename_, -res);
+    } else {
+      req->result = Slice(req->scratch, static_cast<size_t>(res));
+      req->status = Status::OK();
+    }
+  }
+
+  const bool has_permanent_fd_;  // If false, reads go through fd_cache_.
+  const int fd_;                 // -1 if has_permanent_fd_ is false.
+  Limiter* const fd_limiter_;
+  ReadOnlyFdCache* const fd_cache_;
+  const std::string filename_;
+};
+
+bool IsManifest(const std::string& filename) {
+  const size_t separator = filename.rfind('/');
+  const size_t basename =
+      separator == std::string::npos ? 0 : separator + 1;
+  return filename.compare(basename, 8, "MANIFEST") == 0;
+}
+
+std::string Dirname(const std::string& filename) {
+  const size_t separator = filename.rfind('/');
+  if (separator == std::string::npos) {
+    return std::string(".");
+  }
+  return filename.substr(0, separator);
+}
+
+class IoUringWritableFile final : public WritableFile {
+ public:
+  // The new instance takes ownership of |fd|, whose data continues at
+  // |offset|.
+  IoUringWritableFile(std::string filename, int fd, uint64_t offset)
+      : fd_(fd),
+        offset_(offset),
+        is_manifest_(IsManifest(filename)),
+        filename_(std::move(filename)),
+        buf_(new char[kWritableFileBufferSize]) {}
+
+  ~IoUringWritableFile() override {
+    if (fd_ >= 0) {
+      // Ignoring any potential errors
+      Close();
+    }
+  }
+
+  Status Append(const Slice& data) override {
+    size_t write_size = data.size();
+    const char* write_data = data.data();
+
+    // Fit as much as possible into buffer.
+    size_t copy_size = std::min(write_size, kWritableFileBufferSize - pos_);
+    std::memcpy(buf_.get() + pos_, write_data, copy_size);
+    write_data += copy_size;
+    write_size -= copy_size;
+    pos_ += copy_size;
+    if (write_size == 0) {
+      return Status::OK();
+    }
+
+    // Can't fit in buffer, so need to do at least one write.
+    Status status = Flush();
+    if (!status.ok()) {
+      return status;
+    }
+
+    // Small writes go to buffer, large writes are written directly.
+    if (write_size < kWritableFileBufferSize) {
+      std::memcpy(buf_.get(), write_data, write_size);
+      pos_ = write_size;
+      return Status::OK();
+    }
+    return Write(write_data, write_size, /*sync=*/false, /*dir_fd=*/-1);
+  }
+
+  Status Close() override {
+    Status status = Flush();
+    if (::close(fd_) < 0 && status.ok()) {
+      status = IoUringError(filename_, errno);
+    }
+    fd_ = -1;
+    return status;
+  }
+
+  Status Flush() override {
+    Status status = Write(buf_.get(), pos_, /*sync=*/false, /*dir_fd=*/-1);
+    pos_ = 0;
+    return status;
+  }
+
+  // Writes out the buffer and syncs it in one submission. For the manifest,
+  // the directory sync that makes the new files it refers to durable is
+  // linked in front, as it must complete first.
+  Status Sync() override {
+    int dir_fd = -1;
+    if (is_manifest_) {
+      const std::string dirname = Dirname(filename_);
+      dir_fd = ::open(dirname.c_str(), O_RDONLY);
+      if (dir_fd < 0) {
+        return IoUringError(dirname, errno);
+      }
+    }
+    Status status = Write(buf_.get(), pos_, /*sync=*/true, dir_fd);
+    pos_ = 0;
+    if (dir_fd >= 0) {
+      ::close(dir_fd);
+    }
+    return status;
+  }
+
+ private:
+  // Writes |data| at the end of the file. If |sync| is true, the data is then
+  // made durable with fdatasync, preceded by a sync of |dir_fd| if it is not
+  // -1.
+  Status Write(const char* data, size_t size, bool sync, int dir_fd) {
+    Ring* ring = ThreadRing();
+    if (ring == nullptr) {
+      return WriteWithoutRing(data, size, sync, dir_fd);
+    }
+
+    int results[3];
+    while (true) {
+      unsigned n = 0;
+      int dir_sync = -1, data_write = -1, data_sync = -1;
+      if (dir_fd >= 0) {
+        io_uring_sqe* sqe = ring->Prepare(n);
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = dir_fd;
+        sqe->flags = IOSQE_IO_LINK;
+        dir_sync = n++;
+      }
+      if (size > 0) {
+        io_uring_sqe* sqe = ring->Prepare(n);
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = fd_;
+        sqe->addr = reinterpret_cast<uint64_t>(data);
+        sqe->len = static_cast<uint32_t>(
+            std::min<size_t>(size, std::numeric_limits<int32_t>::max()));
+        sqe->off = offset_;
+        if (sync) {
+          sqe->flags = IOSQE_IO_LINK;
+        }
+        data_write = n++;
+      }
+      if (sync) {
+        io_uring_sqe* sqe = ring->Prepare(n);
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = fd_;
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        data_sync = n++;
+      }
+      if (n == 0) {
+        return Status::OK();
+      }
+
+      int ret = ring->SubmitAndWait(results);
+      if (ret < 0) {
+        return IoUringError(filename_, -ret);
+      }
+      if (dir_sync >= 0) {
+        if (results[dir_sync] < 0) {
+          return IoUringError(Dirname(filename_), -results[dir_sync]);
+        }
+        dir_fd = -1;
+      }
+      if (data_write >= 0) {
+        const int res = results[data_write];
+        if (res < 0 && res != -EINTR && res != -EAGAIN) {
+          return IoUringError(filename_, -res);
+        }
+        if (res > 0) {
+          data += res;
+          size -= res;
+          offset_ += res;
+        }
+      }
+      if (data_sync >= 0 && results[data_sync] < 0 &&
+          results[data_sync] != -ECANCELED) {
+        return IoUringError(filename_, -results[data_sync]);
+      }
+      if (size == 0 && (!sync || results[data_sync] >= 0)) {
+        return Status::OK();
+      }
+      // A short write cancels the sync linked to it; go on with the rest.
+    }
+  }
+
+  Status WriteWithoutRing(const char* data, size_t size, bool sync,
+                          int dir_fd) {
+    if (dir_fd >= 0 && ::fsync(dir_fd) < 0) {
+      return IoUringError(Dirname(filename_), errno);
+    }
+    while (size > 0) {
+      ssize_t write_result =
+          ::pwrite(fd_, data, size, static_cast<off_t>(offset_));
+      if (write_result < 0) {
+        if (errno == EINTR) {
+          continue;  // Retry
+        }
+        return IoUringError(filename_, errno);
+      }
+      data += write_result;
+      size -= write_result;
+      offset_ += write_result;
+    }
+    if (sync && ::fdatasync(fd_) < 0) {
+      return IoUringError(filename_, errno);
+    }
+    return Status::OK();
+  }
+
+  int fd_;
+  uint64_t offset_;  // Where the next write goes.
+  const bool is_manifest_;  // True if the file's name starts with MANIFEST.
+  const std::string filename_;
+  std::unique_ptr<char[]> buf_;
+  size_t pos_ = 0;  // buf_[0, pos_ - 1] contains data to be written.
+};
+
+class IoUringEnv : public EnvWrapper {
+ public:
+  explicit IoUringEnv(Env* base_env)
+      : EnvWrapper(base_env),
+        fd_limiter_(MaxOpenFiles()),
+        fd_cache_(kDefaultReadOnlyFdCacheSize, /*direct=*/false) {}
+
+  Status NewRandomAccessFile(const std::string& filename,
+                             RandomAccessFile** result) override {
+    if (use_direct_reads_.load(std::memory_order_relaxed)) {
+      // The base Env knows how to align the reads.
+      return target()->NewRandomAccessFile(filename, result);
+    }
+    *result = nullptr;
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return IoUringError(filename, errno);
+    }
+    *result = new IoUringRandomAccessFile(filename, fd, &fd_limiter_,
+                                          &fd_cache_);
+    return Status::OK();
+  }
+
+  Status NewWritableFile(const std::string& filename,
+                         WritableFile** result) override {
+    *result = nullptr;
+    int fd = ::open(filename.c_str(), O_TRUNC | O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) {
+      return IoUringError(filename, errno);
+    }
+    *result = new IoUringWritableFile(filename, fd, 0);
+    return Status::OK();
+  }
+
+  Status NewAppendableFile(const std::string& filename,
+                           WritableFile** result) override {
+    *result = nullptr;
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) {
+      return IoUringError(filename, errno);
+    }
+    struct ::stat file_stat;
+    if (::fstat(fd, &file_stat) != 0) {
+      Status status = IoUringError(filename, errno);
+      ::close(fd);
+      return status;
+    }
+    *result = new IoUringWritableFile(filename, fd, file_stat.st_size);
+    return Status::OK();
+  }
+
+  void SetUseDirectReads(bool use) override {
+    use_direct_reads_.store(use, std::memory_order_relaxed);
+    target()->SetUseDirectReads(use);
+  }
+
+  void SetReadOnlyFdCacheSize(int size) override {
+    fd_cache_.SetCapacity(size);
+    target()->SetReadOnlyFdCacheSize(size);
+  }
+
+ private:
+  std::atomic<bool> use_direct_reads_{false};
+  Limiter fd_limiter_;  // Thread-safe.
+  ReadOnlyFdCache fd_cache_;  // Thread-safe.
+};
+
+}  // namespace
+
+Env* NewIoUringEnv(Env* base_env) {
+  static const bool supported = IoUringSupported();
+  return supported ? new IoUringEnv(base_env) : nullptr;
+}
+
+#else  // LEVELDB_HAVE_IO_URING
+
+Env* NewIoUringEnv(Env* base_env) { return nullptr; }
+
+#endif  // LEVELDB_HAVE_IO_URING
+
+}  // namespace leveldb
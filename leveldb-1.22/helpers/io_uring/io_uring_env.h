@@ -0,0 +1,30 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_HELPERS_IO_URING_IO_URING_ENV_H_
+#define STORAGE_LEVELDB_HELPERS_IO_URING_IO_URING_ENV_H_
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class Env;
+
+// Returns a new environment whose random access and writable files do their
+// I/O through io_uring, and which delegates everything else to base_env.
+// Every thread submits to a ring of its own; MultiRead() issues all of its
+// reads with one system call, and Sync() links the write of the buffered
+// data with the fdatasync. As in the POSIX Env, only a fifth of
+// RLIMIT_NOFILE random access files keep their descriptor open; the others
+// open the file for every read.
+//
+// Returns nullptr if io_uring is not available (a kernel older than 5.6, a
+// non-Linux platform, or a build for uFS). The caller must delete the result
+// when it is no longer needed.  *base_env must remain live while the result
+// is in use.
+LEVELDB_EXPORT Env* NewIoUringEnv(Env* base_env);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_HELPERS_IO_URING_IO_URING_ENV_H_
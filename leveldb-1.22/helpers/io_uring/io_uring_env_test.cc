@@ -0,0 +1,193 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "helpers/io_uring/io_uring_env.h"
+
+#include <sys/resource.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "db/db_impl.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "util/random.h"
+#include "util/testharness.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+class IoUringEnvTest {
+ public:
+  // Restores RLIMIT_NOFILE when a test that lowered it ends, even on failure.
+  class RlimitRestorer {
+   public:
+    RlimitRestorer() { ok_ = getrlimit(RLIMIT_NOFILE, &limit_) == 0; }
+    RlimitRestorer(const RlimitRestorer&) = delete;
+    RlimitRestorer& operator=(const RlimitRestorer&) = delete;
+    ~RlimitRestorer() {
+      if (ok_) setrlimit(RLIMIT_NOFILE, &limit_);
+    }
+
+    bool ok() const { return ok_; }
+    const struct rlimit& limit() const { return limit_; }
+
+   private:
+    bool ok_;
+    struct rlimit limit_;
+  };
+
+  IoUringEnvTest() : env_(NewIoUringEnv(Env::Default())) {
+    ASSERT_OK(Env::Default()->GetTestDirectory(&test_dir_));
+    if (env_ == nullptr) {
+      std::fprintf(stderr, "io_uring is not available; skipping\n");
+    }
+  }
+  ~IoUringEnvTest() { delete env_; }
+
+  Env* env_;
+  std::string test_dir_;
+};
+
+TEST(IoUringEnvTest, ReadWrite) {
+  if (env_ == nullptr) return;
+  const std::string fname = test_dir_ + "/io_uring_read_write";
+  Random rnd(301);
+  std::string data;
+
+  // Small appends go through the buffer, large ones are written directly.
+  WritableFile* writable_file;
+  ASSERT_OK(env_->NewWritableFile(fname, &writable_file));
+  for (int i = 0; i < 40; i++) {
+    std::string piece;
+    test::RandomString(&rnd, i % 10 == 9 ? 100000 : rnd.Uniform(5000), &piece);
+    ASSERT_OK(writable_file->Append(piece));
+    data += piece;
+    if (i % 7 == 0) {
+      ASSERT_OK(i % 2 == 0 ? writable_file->Sync() : writable_file->Flush());
+    }
+  }
+  ASSERT_OK(writable_file->Close());
+  delete writable_file;
+
+  ASSERT_OK(env_->NewAppendableFile(fname, &writable_file));
+  ASSERT_OK(writable_file->Append("tail"));
+  ASSERT_OK(writable_file->Sync());
+  delete writable_file;
+  data += "tail";
+
+  uint64_t file_size;
+  ASSERT_OK(env_->GetFileSize(fname, &file_size));
+  ASSERT_EQ(data.size(), file_size);
+
+  RandomAccessFile* file;
+  ASSERT_OK(env_->NewRandomAccessFile(fname, &file));
+  std::string scratch(5000, '\0');
+  Slice result;
+  ASSERT_OK(file->Read(12345, 5000, &result, &scratch[0]));
+  ASSERT_EQ(data.substr(12345, 5000), result.ToString());
+  ASSERT_OK(file->Read(data.size() - 2, 5000, &result, &scratch[0]));
+  ASSERT_EQ("il", result.ToString());
+
+  // More requests than one ring submission holds, some past the end.
+  std::vector<ReadRequest> reqs(150);
+  std::vector<std::string> scratches(reqs.size(), std::string(1000, '\0'));
+  for (size_t i = 0; i < reqs.size(); i++) {
+    reqs[i].offset = i == 0 ? data.size() + 10 : rnd.Uniform(data.size());
+    reqs[i].n = 1 + rnd.Uniform(1000);
+    reqs[i].scratch = &scratches[i][0];
+  }
+  ASSERT_OK(file->MultiRead(reqs.data(), reqs.size()));
+  for (const ReadRequest& req : reqs) {
+    ASSERT_OK(req.status);
+    const size_t offset = std::min<size_t>(req.offset, data.size());
+    ASSERT_EQ(data.substr(offset, req.n), req.result.ToString());
+  }
+  delete file;
+
+  ASSERT_TRUE(env_->NewRandomAccessFile(fname + ".missing", &file)
+                  .IsNotFound());
+  ASSERT_OK(env_->DeleteFile(fname));
+}
+
+TEST(IoUringEnvTest, OpenFileLimit) {
+  if (env_ == nullptr) return;
+  // The Env keeps at most a fifth of RLIMIT_NOFILE read-only files open, and
+  // reads the others through its descriptor cache.
+  RlimitRestorer restorer;
+  ASSERT_TRUE(restorer.ok());
+  struct rlimit limit = restorer.limit();
+  limit.rlim_cur = std::min<rlim_t>(limit.rlim_cur, 100);
+  ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &limit));
+  const int kMaxOpenFiles = static_cast<int>(limit.rlim_cur / 5);
+  Env* env = NewIoUringEnv(Env::Default());
+  ASSERT_TRUE(env != nullptr);
+
+  const std::string fname = test_dir_ + "/io_uring_open_file_limit";
+  ASSERT_OK(WriteStringToFile(env, "0123456789", fname));
+  std::vector<std::string> fds;
+  ASSERT_OK(env->GetChildren("/proc/self/fd", &fds));
+  const size_t kNumFdsBefore = fds.size();
+
+  const int kNumFiles = kMaxOpenFiles + 5;
+  std::vector<RandomAccessFile*> files(kNumFiles);
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_OK(env->NewRandomAccessFile(fname, &files[i]));
+  }
+  ASSERT_OK(env->GetChildren("/proc/self/fd", &fds));
+  ASSERT_LE(fds.size(), kNumFdsBefore + kMaxOpenFiles);
+
+  char scratch[4];
+  for (int i = 0; i < kNumFiles; i++) {
+    Slice result;
+    ASSERT_OK(files[i]->Read(i % 7, 3, &result, scratch));
+    ASSERT_EQ(std::string("0123456789").substr(i % 7, 3), result.ToString());
+  }
+  // The files beyond the limit share one cached descriptor.
+  ASSERT_OK(env->GetChildren("/proc/self/fd", &fds));
+  ASSERT_LE(fds.size(), kNumFdsBefore + kMaxOpenFiles + 2);  // Plus the ring.
+  for (int i = 0; i < kNumFiles; i++) {
+    delete files[i];
+  }
+  ASSERT_OK(env->GetChildren("/proc/self/fd", &fds));
+  ASSERT_LE(fds.size(), kNumFdsBefore + 1);  // Plus this thread's ring.
+
+  ASSERT_OK(env->DeleteFile(fname));
+  delete env;
+}
+
+TEST(IoUringEnvTest, DB) {
+  if (env_ == nullptr) return;
+  const std::string dbname = test_dir_ + "/io_uring_db";
+  Options options;
+  options.create_if_missing = true;
+  options.env = env_;
+  DestroyDB(dbname, options);
+
+  DB* db;
+  ASSERT_OK(DB::Open(options, dbname, &db));
+  WriteOptions sync;
+  sync.sync = true;
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_OK(db->Put(i % 10 == 0 ? sync : WriteOptions(),
+                      "key" + std::to_string(i), std::string(100, 'a' + i % 26)));
+  }
+  ASSERT_OK(reinterpret_cast<DBImpl*>(db)->TEST_CompactMemTable());
+  delete db;
+
+  // Recovers from the manifest and log written through the rings.
+  ASSERT_OK(DB::Open(options, dbname, &db));
+  for (int i = 0; i < 1000; i++) {
+    std::string value;
+    ASSERT_OK(db->Get(ReadOptions(), "key" + std::to_string(i), &value));
+    ASSERT_EQ(std::string(100, 'a' + i % 26), value);
+  }
+  delete db;
+  ASSERT_OK(DestroyDB(dbname, options));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
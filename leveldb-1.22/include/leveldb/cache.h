@@ -10,8 +10,8 @@
 // length strings, may use the length of the string as the charge for
 // the string.
 //
-// A builtin cache implementation with a least-recently-used eviction
-// policy is provided.  Clients may use their own implementations if
+// Builtin cache implementations with least-recently-used and CLOCK
+// eviction policies are provided.  Clients may use their own implementations if
 // they want something more sophisticated (like scan-resistance, a
 // custom eviction policy, variable cache sizing, etc.)
 
@@ -20,6 +20,8 @@
 
 #include <stdint.h>
 
+#include <vector>
+
 #include "leveldb/export.h"
 #include "leveldb/slice.h"
 
@@ -28,8 +30,28 @@ namespace leveldb {
 class LEVELDB_EXPORT Cache;
 
 // Create a new cache with a fixed size capacity.  This implementation
-// of Cache uses a least-recently-used eviction policy.
-LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
+// of Cache uses a least-recently-used eviction policy, in each of
+// 2^shard_bits independently locked shards.
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, int shard_bits = 4);
+
+// Create a new cache with a fixed size capacity that evicts with the CLOCK
+// (second chance) policy.  Lookup() and Release() take no locks, so that
+// hot entries do not serialize readers; Insert() and Erase() lock one of
+// the 2^shard_bits shards.  Each shard has a fixed number of slots, sized
+// for entries of about estimated_entry_charge; if entries are smaller, the
+// slots run out before the capacity does and the cache holds fewer entries.
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity, int shard_bits = 4,
+                                    size_t estimated_entry_charge = 4096);
+
+// Counters of one shard of a cache; see Cache::GetShardStats().
+struct LEVELDB_EXPORT CacheShardStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t inserts = 0;
+  uint64_t evictions = 0;  // Entries dropped to stay within the capacity
+  size_t usage = 0;        // Combined charge of the entries in the shard
+  uint64_t lock_wait_nanos = 0;  // Time spent waiting for the shard's lock
+};
 
 class LEVELDB_EXPORT Cache {
  public:
@@ -93,6 +115,11 @@ class LEVELDB_EXPORT Cache {
   // leveldb may change Prune() to a pure abstract method.
   virtual void Prune() {}
 
+  // Append the counters of every shard, in shard order, to *stats.  The
+  // default implementation appends nothing, for caches that keep no
+  // statistics.
+  virtual void GetShardStats(std::vector<CacheShardStats>* stats) const {}
+
   // Return an estimate of the combined charges of all elements stored in the
   // cache.
   virtual size_t TotalCharge() const = 0;
@@ -52,6 +52,16 @@ class LEVELDB_EXPORT Comparator {
   // Simple comparator implementations may return with *key unchanged,
   // i.e., an implementation of this method that does nothing is correct.
   virtual void FindShortSuccessor(std::string* key) const = 0;
+
+  // If keys are ordered by the bytes of some part of them, sets *part to
+  // that part of "key" and returns true. More precisely, whenever the part
+  // of a is bytewise less than the part of b, Compare(a, b) must be < 0.
+  // Blocks written with Options::block_key_prefixes use this to order keys
+  // by fixed-width prefixes. Comparators that return false (the default)
+  // get no prefixes.
+  virtual bool BytewiseOrderedPart(const Slice& key, Slice* part) const {
+    return false;
+  }
 };
 
 // Return a builtin comparator that uses lexicographic byte-wise
@@ -8,6 +8,9 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include <string>
+#include <vector>
+
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
@@ -88,6 +91,19 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value) = 0;
 
+  // Look up each of "keys" as Get() would, all as of the same state of the
+  // database, storing the value of keys[i] in (*values)[i].  Returns the
+  // status of each lookup; (*values)[i] is unspecified unless the i-th
+  // status is OK.
+  //
+  // The data blocks the keys need from one table file are read together
+  // (see RandomAccessFile::MultiRead()), and a block that holds several of
+  // the keys is read once, so this is cheaper than calling Get() for each
+  // key.  The default implementation calls Get() for each key.
+  virtual std::vector<Status> MultiGet(const ReadOptions& options,
+                                       const std::vector<Slice>& keys,
+                                       std::vector<std::string>* values);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -122,6 +138,10 @@ class LEVELDB_EXPORT DB {
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.block-cache-stats" - returns a multi-line string with the hits,
+  //     misses, inserts, evictions, usage and lock wait time of every shard
+  //     of the block cache, if it keeps statistics (see
+  //     Cache::GetShardStats()).
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -190,6 +190,18 @@ class LEVELDB_EXPORT Env {
   // serialized.
   virtual void Schedule(void (*function)(void* arg), void* arg) = 0;
 
+  // Like Schedule(), but for short, latency-critical work such as memtable
+  // flushes.  Implementations may run it on a separate lane so that it does
+  // not wait behind long-running work queued with Schedule().  The default
+  // implementation calls Schedule().
+  virtual void ScheduleFlush(void (*function)(void* arg), void* arg) {
+    Schedule(function, arg);
+  }
+
+  // Make sure that at least "num" threads run the work queued with
+  // Schedule().  The default implementation does nothing.
+  virtual void SetBackgroundThreads(int num) {}
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -209,6 +221,21 @@ class LEVELDB_EXPORT Env {
 
   // Sleep/delay the thread for the prescribed number of micro-seconds.
   virtual void SleepForMicroseconds(int micros) = 0;
+
+  // Set the number of file descriptors the Env may keep cached for random
+  // access files that could not be given a descriptor of their own.  Reads
+  // of such files otherwise open and close the file every time.
+  //
+  // The default implementation ignores the setting.
+  virtual void SetReadOnlyFdCacheSize(int size) {}
+
+  // Open the random access files (i.e. the table files) created from now on
+  // so that their reads bypass the operating system's page cache, leaving
+  // the block cache as the only cache of table data.  Files on file systems
+  // that do not support this are read as before.
+  //
+  // The default implementation ignores the setting.
+  virtual void SetUseDirectReads(bool use) {}
 };
 
 // A file abstraction for reading sequentially through a file
@@ -241,6 +268,18 @@ class LEVELDB_EXPORT SequentialFile {
   virtual Status Skip(uint64_t n) = 0;
 };
 
+// One of the reads of RandomAccessFile::MultiRead().
+struct LEVELDB_EXPORT ReadRequest {
+  // Inputs, as for RandomAccessFile::Read().
+  uint64_t offset = 0;
+  size_t n = 0;
+  char* scratch = nullptr;
+
+  // Outputs.
+  Slice result;
+  Status status;
+};
+
 // A file abstraction for randomly reading the contents of a file.
 class LEVELDB_EXPORT RandomAccessFile {
  public:
@@ -262,6 +301,28 @@ class LEVELDB_EXPORT RandomAccessFile {
   // Safe for concurrent use by multiple threads.
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
+
+  // Performs reqs[0..num-1], setting the result and status of each as
+  // Read() would.  Implementations may issue the reads together and
+  // complete them in any order.  Returns the first non-OK status of a
+  // request, if any.  The default implementation calls Read() for each
+  // request in turn.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual Status MultiRead(ReadRequest* reqs, size_t num) const;
+
+  // Hint that this file is read often, so that the implementation keeps
+  // whatever makes reads cheap (e.g. an open file descriptor) until Unpin()
+  // is called or the file is deleted.  Implementations may bound the number
+  // of files they keep pinned.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual void Pin() {}
+
+  // Undoes Pin(), once the file is no longer read often.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual void Unpin() {}
 };
 
 // A file abstraction for sequential writing.  The implementation
@@ -377,6 +438,12 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) override {
     return target_->Schedule(f, a);
   }
+  void ScheduleFlush(void (*f)(void*), void* a) override {
+    return target_->ScheduleFlush(f, a);
+  }
+  void SetBackgroundThreads(int num) override {
+    target_->SetBackgroundThreads(num);
+  }
   void StartThread(void (*f)(void*), void* a) override {
     return target_->StartThread(f, a);
   }
@@ -390,6 +457,12 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   void SleepForMicroseconds(int micros) override {
     target_->SleepForMicroseconds(micros);
   }
+  void SetReadOnlyFdCacheSize(int size) override {
+    target_->SetReadOnlyFdCacheSize(size);
+  }
+  void SetUseDirectReads(bool use) override {
+    target_->SetUseDirectReads(use);
+  }
 
  private:
   Env* target_;
@@ -49,6 +49,12 @@ class LEVELDB_EXPORT FilterPolicy {
   // This method may return true or false if the key was not on the
   // list, but it should aim to return false with a high probability.
   virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const = 0;
+
+  // Return the alignment, in bytes, that the filter data of this policy
+  // wants in memory. A filter block whose contents are not aligned this
+  // way is copied once when the table is opened, so that every lookup
+  // touches as few cache lines as possible.
+  virtual size_t FilterAlignment() const { return 1; }
 };
 
 // Return a new filter policy that uses a bloom filter with approximately
@@ -67,6 +73,20 @@ class LEVELDB_EXPORT FilterPolicy {
 // trailing spaces in keys.
 LEVELDB_EXPORT const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Return a new filter policy that uses a cache-line-blocked bloom filter
+// with approximately the specified number of bits per key. All the probes
+// for a key fall into one 64-byte line of the filter, so a negative lookup
+// costs a single cache miss instead of one per probe, at the price of a
+// slightly higher false positive rate for the same size. Small filters
+// are rounded up to a whole line. Probes are done with AVX2 when the CPU
+// has it.
+//
+// The number of probes is part of Name(), so tables written with a
+// different bits_per_key are read without their filters. The same caveat
+// about custom comparators as for NewBloomFilterPolicy() applies.
+LEVELDB_EXPORT const FilterPolicy* NewBlockedBloomFilterPolicy(
+    int bits_per_key);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
@@ -82,6 +82,34 @@ struct LEVELDB_EXPORT Options {
   // the next time the database is opened.
   size_t write_buffer_size = 4 * 1024 * 1024;
 
+  // Maximum number of compactions that may run at the same time, on key
+  // ranges that do not overlap.  Memtable flushes do not count against this
+  // limit; they are handed to Env::ScheduleFlush().  The Env is asked for
+  // at least this many background threads.
+  int max_background_compactions = 1;
+
+  // Maximum number of threads that a single compaction is split across.
+  // Large compactions are cut into this many disjoint key ranges at input
+  // file boundaries; each range is merged into its own output files.
+  int max_subcompactions = 1;
+
+  // If true, writes go through a two-stage pipeline: while one group of
+  // writers is being applied to the memtable, the next group can already
+  // be appended to the log.
+  bool enable_pipelined_write = false;
+
+  // If true, together with enable_pipelined_write, the writers of a group
+  // insert their own batches into the memtable in parallel instead of one
+  // writer inserting the whole group.
+  bool allow_concurrent_memtable_write = false;
+
+  // If true, each memtable allocates from one region of about
+  // write_buffer_size bytes that is backed by huge pages where the platform
+  // has them (explicit huge pages, else transparent ones), which saves TLB
+  // misses on the random skiplist accesses.  The regions of retired
+  // memtables are kept for the next ones instead of being unmapped.
+  bool memtable_huge_pages = false;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
@@ -94,6 +122,10 @@ struct LEVELDB_EXPORT Options {
   // If null, leveldb will automatically create and use an 8MB internal cache.
   Cache* block_cache = nullptr;
 
+  // If true, the table cache, and the block cache if leveldb creates it,
+  // use NewClockCache() instead of NewLRUCache().
+  bool use_clock_cache = false;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -144,6 +176,30 @@ struct LEVELDB_EXPORT Options {
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // If true (and filter_policy is set), every table gets a single filter
+  // over all of its keys instead of one per 2KB of data, so that a lookup
+  // can rule a table out before it searches the index. Pairs well with
+  // NewBlockedBloomFilterPolicy(). Tables of either kind can be read
+  // whatever this is set to.
+  bool whole_table_filter = false;
+
+  // If non-zero, the index of every table is split into blocks of about
+  // this many bytes, found through a small top-level index. Only the top
+  // level stays in memory while the table is open; the partitions are read
+  // through block_cache like data blocks, so big tables (a large
+  // max_file_size) no longer pin their whole index. Such tables cannot be
+  // read by leveldb versions without partitioned indexes.
+  size_t index_partition_size = 0;
+
+  // If true, blocks also store the first 8 bytes (after the prefix that
+  // all of them share) of the key at every restart point, and Seek() finds
+  // the restart point with a SIMD compare over these instead of binary
+  // search with a full key comparison per step. Needs a comparator that
+  // implements Comparator::BytewiseOrderedPart(), such as the default one;
+  // it is ignored otherwise. Such blocks cannot be read by leveldb
+  // versions without key prefixes.
+  bool block_key_prefixes = false;
 };
 
 // Options that control read operations
@@ -158,6 +214,12 @@ struct LEVELDB_EXPORT ReadOptions {
   // Callers may wish to set this field to false for bulk scans.
   bool fill_cache = true;
 
+  // Number of data blocks an iterator reads ahead, on background threads,
+  // once it detects that it is scanning forward.  Zero disables readahead.
+  // Callers may wish to set this field for range scans that span several
+  // blocks.
+  int readahead_blocks = 0;
+
   // If "snapshot" is non-null, read as of the supplied snapshot
   // (which must belong to the DB that is being read and which must
   // not have been released).  If "snapshot" is null, use an implicit
@@ -64,6 +64,10 @@ class LEVELDB_EXPORT Table {
 
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
 
+  // Returns an iterator over the index entries of the data blocks, which
+  // reads index partitions as it needs them.
+  Iterator* NewIndexIterator(const ReadOptions&) const;
+
   explicit Table(Rep* rep) : rep_(rep) {}
 
   // Calls (*handle_result)(arg, ...) with the entry found after a call
@@ -73,8 +77,17 @@ class LEVELDB_EXPORT Table {
                      void (*handle_result)(void* arg, const Slice& k,
                                            const Slice& v));
 
+  // Like InternalGet() for each of keys[0..num-1], which must be sorted,
+  // calling handle_result with args[i] for keys[i].  The data blocks the
+  // keys need that are not in the block cache are read with one
+  // ReadBlocks(), so that each is fetched once however many keys it holds.
+  Status InternalMultiGet(const ReadOptions&, const Slice* keys,
+                          void* const* args, size_t num,
+                          void (*handle_result)(void* arg, const Slice& k,
+                                                const Slice& v));
+
   void ReadMeta(const Footer& footer);
-  void ReadFilter(const Slice& filter_handle_value);
+  void ReadFilter(const Slice& filter_handle_value, bool full);
 
   Rep* const rep_;
 };
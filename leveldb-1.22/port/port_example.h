@@ -34,6 +34,10 @@ class LOCKABLE Mutex {
   // Will deadlock if the mutex is already locked by this thread.
   void Lock() EXCLUSIVE_LOCK_FUNCTION();
 
+  // Lock the mutex if no other thread holds it and return true, else
+  // return false right away.
+  bool TryLock() EXCLUSIVE_TRYLOCK_FUNCTION(true);
+
   // Unlock the mutex.
   // REQUIRES: This mutex was locked by this thread.
   void Unlock() UNLOCK_FUNCTION();
@@ -98,6 +102,14 @@ bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg);
 // the newly extended CRC value (which may also be zero).
 uint32_t AcceleratedCRC32C(uint32_t crc, const char* buf, size_t size);
 
+// Returns true if the CPU can run AVX2 code (see the users of
+// __attribute__((target("avx2")))).
+bool HasAVX2();
+
+// Returns true if the CPU has both the SSE4.2 crc32 instruction and
+// PCLMULQDQ (see util/crc32c.cc).
+bool HasSSE42AndPCLMUL();
+
 }  // namespace port
 }  // namespace leveldb
 
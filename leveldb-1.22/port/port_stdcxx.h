@@ -55,6 +55,7 @@ class LOCKABLE Mutex {
   Mutex& operator=(const Mutex&) = delete;
 
   void Lock() EXCLUSIVE_LOCK_FUNCTION() { mu_.lock(); }
+  bool TryLock() EXCLUSIVE_TRYLOCK_FUNCTION(true) { return mu_.try_lock(); }
   void Unlock() UNLOCK_FUNCTION() { mu_.unlock(); }
   void AssertHeld() ASSERT_EXCLUSIVE_LOCK() {}
 
@@ -147,6 +148,25 @@ inline uint32_t AcceleratedCRC32C(uint32_t crc, const char* buf, size_t size) {
 #endif  // HAVE_CRC32C
 }
 
+inline bool HasAVX2() {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2;
+#else
+  return false;
+#endif
+}
+
+inline bool HasSSE42AndPCLMUL() {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+  static const bool has_sse42_pclmul =
+      __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul");
+  return has_sse42_pclmul;
+#else
+  return false;
+#endif
+}
+
 }  // namespace port
 }  // namespace leveldb
 
@@ -5,11 +5,13 @@
 import sys
 import subprocess
 
-assert (len(sys.argv) == 5)
+# Arguments after the first four are passed on to do_work
+assert (len(sys.argv) >= 5)
 num_app = int(sys.argv[1])
 num_worker = int(sys.argv[2])
 trace = sys.argv[3]
 output_dir = sys.argv[4]
+extra_args = sys.argv[5:]
 
 ENV1 = "FSP_KEY_LISTS="
 workers = [0, 10, 20, 30, 40, 50, 60, 70, 80, 90]
@@ -68,6 +70,7 @@ for appid in range(1, num_app + 1):
     command.append("80")
     command.append("-wef" if is_load else "-ef")
     command.append(trace)
+    command.extend(extra_args)
     print(command)
 
     with open(f"{output_dir}/leveldb-{appid}.out", "w") as ldb_out:
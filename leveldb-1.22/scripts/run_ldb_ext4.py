@@ -49,6 +49,20 @@ def parse_cmd_args():
         help=
         'If specified, reuse data in this directory as LevelDB start image (copy to this directory if workload is fillseq or fillrand; copy from if YCSB workload)'
     )
+    parser.add_argument(
+        '--direct-reads',
+        action='store_true',
+        help=
+        'read table files with O_DIRECT, so that the page cache does not affect the results'
+    )
+    parser.add_argument('--io-uring',
+                        action='store_true',
+                        help='do the file I/O of LevelDB through io_uring')
+    parser.add_argument(
+        '--multiget-batch',
+        type=int,
+        default=1,
+        help='look up the reads of the trace in batches of this many keys')
     return (parser.parse_args())
 
 
@@ -62,6 +76,9 @@ is_load = 'load' in trace
 output_dir = args.output_dir
 num_app_only = args.num_app_only
 reuse_data_dir = args.reuse_data_dir
+direct_reads = args.direct_reads
+io_uring = args.io_uring
+multiget_batch = args.multiget_batch
 
 # check mount
 is_mounted = False
@@ -82,6 +99,12 @@ def start_leveldb(trace_path, num_app, num_worker, log_dir):
         str(num_app),
         str(num_worker), trace_path, log_dir
     ]
+    if direct_reads:
+        ldb_load_command.append("--direct_reads")
+    if io_uring:
+        ldb_load_command.append("--io_uring")
+    if multiget_batch > 1:
+        ldb_load_command.append(f"--multiget_batch={multiget_batch}")
     return subprocess.run(ldb_load_command)
 
 
@@ -11,9 +11,12 @@ CFS_ROOT_DIR = os.environ['CFS_ROOT_DIR']
 MKFS_SPDK_BIN = os.environ['MKFS_SPDK_BIN']
 CFS_MAIN_BIN_NAME = os.environ['CFS_MAIN_BIN_NAME']
 
-assert (len(sys.argv) == 3)
+# An optional third argument runs the reads of the trace in batches of that
+# many keys, each looked up with one MultiGet.
+assert (len(sys.argv) in (3, 4))
 workload = sys.argv[1]
 output_dir = sys.argv[2]
+multiget_batch = int(sys.argv[3]) if len(sys.argv) == 4 else 1
 
 workload_trace_map = {}
 for name in ["a", "b", "c", "d", "e", "f"]:
@@ -98,12 +101,14 @@ def load_data(num_app, num_worker, log_dir):
     return subprocess.run(ldb_load_command)
 
 
-def start_leveldb(trace_path, num_app, num_worker, log_dir):
+def start_leveldb(trace_path, num_app, num_worker, log_dir, multiget_batch=1):
     ldb_load_command = [
         "python3", "scripts/run_ldb_common.py",
         str(num_app),
         str(num_worker), trace_path, log_dir
     ]
+    if multiget_batch > 1:
+        ldb_load_command.append(f"--multiget_batch={multiget_batch}")
     return subprocess.run(ldb_load_command)
 
 
@@ -137,7 +142,8 @@ for num_app in range(1, 11):
     os.mkdir(ldb_output_dir)
 
     # use same number of workers as apps
-    p = start_leveldb(trace, num_app, num_app, ldb_output_dir)
+    p = start_leveldb(trace, num_app, num_app, ldb_output_dir,
+                      multiget_batch)
     shutdown_fsp(fs_proc)
     if p.returncode != 0:
         print("LevelDB return non-zero exit code!")
@@ -10,50 +10,65 @@
 #include <vector>
 
 #include "leveldb/comparator.h"
+#include "port/port.h"
 #include "table/format.h"
+#include "util/block_buffer_pool.h"
 #include "util/coding.h"
 #include "util/logging.h"
 
-#ifdef JL_LIBCFS
-#include "fsapi.h"
-extern thread_local int threadFsTid;
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define LEVELDB_BLOCK_AVX2 1
 #endif
 
 namespace leveldb {
 
 inline uint32_t Block::NumRestarts() const {
   assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+  return DecodeFixed32(data_ + size_ - sizeof(uint32_t)) &
+         ~kBlockKeyPrefixesFlag;
 }
 
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
-      owned_(contents.heap_allocated)
-#ifdef JL_LIBCFS
-      , allocatorFsTid(contents.allocatorFsTid)
-#endif
-{
+      prefixes_(nullptr),
+      owned_(contents.heap_allocated),
+      buffer_size_(contents.data.size() + kBlockTrailerSize) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
-  } else {
-    size_t max_restarts_allowed = (size_ - sizeof(uint32_t)) / sizeof(uint32_t);
-    if (NumRestarts() > max_restarts_allowed) {
-      // The size is too small for NumRestarts()
+    return;
+  }
+  size_t trailer_end = size_ - sizeof(uint32_t);
+  const uint64_t num_restarts = NumRestarts();
+  if (DecodeFixed32(data_ + trailer_end) & kBlockKeyPrefixesFlag) {
+    // See block_builder.cc for the layout.
+    if (trailer_end < sizeof(uint32_t)) {
       size_ = 0;
-    } else {
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      return;
     }
+    trailer_end -= sizeof(uint32_t);
+    const uint32_t common_length = DecodeFixed32(data_ + trailer_end);
+    if (common_length + num_restarts * sizeof(uint64_t) > trailer_end) {
+      size_ = 0;
+      return;
+    }
+    trailer_end -= common_length;
+    common_prefix_ = Slice(data_ + trailer_end, common_length);
+    trailer_end -= num_restarts * sizeof(uint64_t);
+    prefixes_ = data_ + trailer_end;
+  }
+  if (num_restarts > trailer_end / sizeof(uint32_t)) {
+    // The size is too small for NumRestarts()
+    size_ = 0;
+  } else {
+    restart_offset_ = trailer_end - num_restarts * sizeof(uint32_t);
   }
 }
 
 Block::~Block() {
   if (owned_) {
-#ifdef JL_LIBCFS
-    fs_free_pad(const_cast<char*>(data_), allocatorFsTid);
-#else
-    delete[] data_;
-#endif
+    FreeBlockBuffer(const_cast<char*>(data_), buffer_size_);
   }
 }
 
@@ -86,12 +101,102 @@ static inline const char* DecodeEntry(const char* p, const char* limit,
   return p;
 }
 
+// Sets *below to the number of the n (sorted) prefixes that are less than
+// "target", and *not_above to the number that are not greater.
+static void CountKeyPrefixes(const char* prefixes, uint32_t n, uint64_t target,
+                             uint32_t* below, uint32_t* not_above) {
+  uint32_t lt = 0, le = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    const uint64_t prefix = DecodeFixed64(prefixes + i * sizeof(uint64_t));
+    lt += (prefix < target);
+    le += (prefix <= target);
+  }
+  *below = lt;
+  *not_above = le;
+}
+
+// Blocks with more restart points than this (such as index blocks, with
+// their restart interval of 1) have their prefixes binary-searched.
+static const uint32_t kMaxScannedPrefixes = 64;
+
+// Same as CountKeyPrefixes(), in O(log n).
+static void SearchKeyPrefixes(const char* prefixes, uint32_t n,
+                              uint64_t target, uint32_t* below,
+                              uint32_t* not_above) {
+  uint32_t lo = 0, hi = n;  // First prefix >= target
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    if (DecodeFixed64(prefixes + mid * sizeof(uint64_t)) < target) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  *below = lo;
+  hi = n;  // First prefix > target
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    if (DecodeFixed64(prefixes + mid * sizeof(uint64_t)) <= target) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  *not_above = lo;
+}
+
+#ifdef LEVELDB_BLOCK_AVX2
+// Compares four prefixes per step. There is only a signed 64-bit compare,
+// so both sides get their sign bit flipped first.
+__attribute__((target("avx2"))) static void CountKeyPrefixesAVX2(
+    const char* prefixes, uint32_t n, uint64_t target, uint32_t* below,
+    uint32_t* not_above) {
+  const __m256i sign = _mm256_set1_epi64x(static_cast<int64_t>(1ull << 63));
+  const __m256i t = _mm256_xor_si256(
+      _mm256_set1_epi64x(static_cast<int64_t>(target)), sign);
+  uint32_t lt = 0, gt = 0;
+  uint32_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m256i p = _mm256_xor_si256(
+        _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(prefixes + i * sizeof(uint64_t))),
+        sign);
+    lt += __builtin_popcount(
+        _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(t, p))));
+    gt += __builtin_popcount(
+        _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(p, t))));
+  }
+  uint32_t tail_below, tail_not_above;
+  CountKeyPrefixes(prefixes + i * sizeof(uint64_t), n - i, target, &tail_below,
+                   &tail_not_above);
+  *below = lt + tail_below;
+  *not_above = (i - gt) + tail_not_above;
+}
+#endif
+
+static void FindKeyPrefixes(const char* prefixes, uint32_t n, uint64_t target,
+                            uint32_t* below, uint32_t* not_above) {
+  if (n > kMaxScannedPrefixes) {
+    SearchKeyPrefixes(prefixes, n, target, below, not_above);
+    return;
+  }
+#ifdef LEVELDB_BLOCK_AVX2
+  if (port::HasAVX2()) {
+    CountKeyPrefixesAVX2(prefixes, n, target, below, not_above);
+    return;
+  }
+#endif
+  CountKeyPrefixes(prefixes, n, target, below, not_above);
+}
+
 class Block::Iter : public Iterator {
  private:
   const Comparator* const comparator_;
   const char* const data_;       // underlying block contents
   uint32_t const restarts_;      // Offset of restart array (list of fixed32)
   uint32_t const num_restarts_;  // Number of uint32_t entries in restart array
+  const char* const prefixes_;   // Key prefix array, or nullptr if none
+  Slice const common_prefix_;    // Shared by all restart keys (see .h)
 
   // current_ is offset in data_ of current entry.  >= restarts_ if !Valid
   uint32_t current_;
@@ -126,11 +231,13 @@ class Block::Iter : public Iterator {
 
  public:
   Iter(const Comparator* comparator, const char* data, uint32_t restarts,
-       uint32_t num_restarts)
+       uint32_t num_restarts, const char* prefixes, const Slice& common_prefix)
       : comparator_(comparator),
         data_(data),
         restarts_(restarts),
         num_restarts_(num_restarts),
+        prefixes_(prefixes),
+        common_prefix_(common_prefix),
         current_(restarts_),
         restart_index_(num_restarts_) {
     assert(num_restarts_ > 0);
@@ -178,6 +285,9 @@ class Block::Iter : public Iterator {
     // with a key < target
     uint32_t left = 0;
     uint32_t right = num_restarts_ - 1;
+    if (prefixes_ != nullptr) {
+      NarrowByKeyPrefix(target, &left, &right);
+    }
     while (left < right) {
       uint32_t mid = (left + right + 1) / 2;
       uint32_t region_offset = GetRestartPoint(mid);
@@ -226,6 +336,38 @@ class Block::Iter : public Iterator {
   }
 
  private:
+  // Narrows the range [*left, *right] of restart points that the binary
+  // search in Seek() starts from: restart keys whose prefix is less than
+  // that of "target" are less than "target", and those whose prefix is
+  // greater are greater.
+  void NarrowByKeyPrefix(const Slice& target, uint32_t* left,
+                         uint32_t* right) const {
+    Slice part;
+    if (!comparator_->BytewiseOrderedPart(target, &part)) {
+      return;
+    }
+    const size_t n = common_prefix_.size();
+    const int r =
+        Slice(part.data(), std::min(n, part.size())).compare(common_prefix_);
+    if (r < 0) {
+      // Below every restart key
+      *right = 0;
+      return;
+    } else if (r > 0) {
+      // Above every restart key
+      *left = num_restarts_ - 1;
+      return;
+    }
+    part.remove_prefix(n);
+
+    uint32_t below, not_above;
+    FindKeyPrefixes(prefixes_, num_restarts_, BlockKeyPrefix(part), &below,
+                    &not_above);
+    // not_above >= below, so this keeps *left <= *right.
+    *left = below > 0 ? below - 1 : 0;
+    *right = not_above > 0 ? not_above - 1 : 0;
+  }
+
   void CorruptionError() {
     current_ = restarts_;
     restart_index_ = num_restarts_;
@@ -272,7 +414,8 @@ Iterator* Block::NewIterator(const Comparator* comparator) {
   if (num_restarts == 0) {
     return NewEmptyIterator();
   } else {
-    return new Iter(comparator, data_, restart_offset_, num_restarts);
+    return new Iter(comparator, data_, restart_offset_, num_restarts,
+                    prefixes_, common_prefix_);
   }
 }
 
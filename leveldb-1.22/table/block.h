@@ -9,12 +9,29 @@
 #include <stdint.h>
 
 #include "leveldb/iterator.h"
+#include "leveldb/slice.h"
 
 namespace leveldb {
 
 struct BlockContents;
 class Comparator;
 
+// Set in the restart count of blocks that carry key prefixes (see
+// Options::block_key_prefixes and BlockBuilder::Finish()).
+static const uint32_t kBlockKeyPrefixesFlag = 1u << 31;
+
+// The first 8 bytes of "key", zero-padded, as a big-endian number, so that
+// numbers order like the keys they come from.
+inline uint64_t BlockKeyPrefix(const Slice& key) {
+  uint64_t prefix = 0;
+  const size_t n = key.size() < 8 ? key.size() : 8;
+  for (size_t i = 0; i < n; i++) {
+    prefix |= static_cast<uint64_t>(static_cast<uint8_t>(key[i]))
+              << (56 - 8 * i);
+  }
+  return prefix;
+}
+
 class Block {
  public:
   // Initialize the block with the specified contents.
@@ -36,10 +53,10 @@ class Block {
   const char* data_;
   size_t size_;
   uint32_t restart_offset_;  // Offset in data_ of restart array
+  const char* prefixes_;     // Key prefix array, or nullptr if none
+  Slice common_prefix_;      // Shared by the keys of all restart points
   bool owned_;               // Block owns data_[]
-#ifdef JL_LIBCFS
-  int allocatorFsTid;
-#endif
+  size_t buffer_size_;       // Size data_[] was allocated with, if owned_
 };
 
 }  // namespace leveldb
@@ -25,6 +25,15 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// With Options::block_key_prefixes, the restart array is followed by
+//     prefixes: fixed64[num_restarts]
+//     common_prefix: char[common_prefix_length]
+//     common_prefix_length: uint32
+// and num_restarts has kBlockKeyPrefixesFlag set. common_prefix is what the
+// ordered parts (see Comparator::BytewiseOrderedPart()) of all the restart
+// keys start with, and prefixes[i] is BlockKeyPrefix() of the rest of the
+// part of restart key i.
 
 #include "table/block_builder.h"
 
@@ -34,6 +43,7 @@
 
 #include "leveldb/comparator.h"
 #include "leveldb/table_builder.h"
+#include "table/block.h"
 #include "util/coding.h"
 
 namespace leveldb {
@@ -56,19 +66,70 @@ void BlockBuilder::Reset() {
 size_t BlockBuilder::CurrentSizeEstimate() const {
   return (buffer_.size() +                       // Raw data buffer
           restarts_.size() * sizeof(uint32_t) +  // Restart array
-          sizeof(uint32_t));                     // Restart array length
+          (options_->block_key_prefixes          // Key prefix array
+               ? restarts_.size() * sizeof(uint64_t)
+               : 0) +
+          sizeof(uint32_t));  // Restart array length
 }
 
 Slice BlockBuilder::Finish() {
   // Append restart array
+  const size_t entries_end = buffer_.size();
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
-  PutFixed32(&buffer_, restarts_.size());
+  uint32_t num_restarts = restarts_.size();
+  if (options_->block_key_prefixes && AppendKeyPrefixes(entries_end)) {
+    num_restarts |= kBlockKeyPrefixesFlag;
+  }
+  PutFixed32(&buffer_, num_restarts);
   finished_ = true;
   return Slice(buffer_);
 }
 
+// Appends the key prefix trailer described above; returns false, appending
+// nothing, if the comparator cannot provide it. Restart keys are stored
+// whole, so they are decoded from buffer_.
+bool BlockBuilder::AppendKeyPrefixes(size_t entries_end) {
+  if (entries_end == 0) return false;  // No keys
+  const Comparator* comparator = options_->comparator;
+  std::vector<Slice> parts(restarts_.size());
+  for (size_t i = 0; i < restarts_.size(); i++) {
+    const char* p = buffer_.data() + restarts_[i];
+    const char* limit = buffer_.data() + entries_end;
+    uint32_t shared, non_shared, value_length;
+    p = GetVarint32Ptr(p, limit, &shared);
+    p = GetVarint32Ptr(p, limit, &non_shared);
+    p = GetVarint32Ptr(p, limit, &value_length);
+    assert(p != nullptr && shared == 0);
+    if (!comparator->BytewiseOrderedPart(Slice(p, non_shared), &parts[i])) {
+      return false;
+    }
+  }
+
+  // Parts are sorted, so the first and the last share what all share.
+  const Slice& first = parts.front();
+  const Slice& last = parts.back();
+  size_t common = 0;
+  const size_t min_length = std::min(first.size(), last.size());
+  while (common < min_length && first[common] == last[common]) {
+    common++;
+  }
+
+  // Appending may move buffer_, and with it the parts, so they go to a
+  // separate string first.
+  std::string trailer;
+  for (size_t i = 0; i < parts.size(); i++) {
+    Slice rest = parts[i];
+    rest.remove_prefix(common);
+    PutFixed64(&trailer, BlockKeyPrefix(rest));
+  }
+  trailer.append(first.data(), common);
+  PutFixed32(&trailer, common);
+  buffer_.append(trailer);
+  return true;
+}
+
 void BlockBuilder::Add(const Slice& key, const Slice& value) {
   Slice last_key_piece(last_key_);
   assert(!finished_);
@@ -42,6 +42,8 @@ class BlockBuilder {
   bool empty() const { return buffer_.empty(); }
 
  private:
+  bool AppendKeyPrefixes(size_t entries_end);
+
   const Options* options_;
   std::string buffer_;              // Destination buffer
   std::vector<uint32_t> restarts_;  // Restart points
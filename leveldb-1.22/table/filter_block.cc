@@ -4,6 +4,8 @@
 
 #include "table/filter_block.h"
 
+#include <string.h>
+
 #include "leveldb/filter_policy.h"
 #include "util/coding.h"
 
@@ -15,6 +17,24 @@ namespace leveldb {
 static const size_t kFilterBaseLg = 11;
 static const size_t kFilterBase = 1 << kFilterBaseLg;
 
+// Returns contents.data(), or a copy of the contents in *copy if they are
+// not aligned as the policy asks.
+static const char* AlignContents(const FilterPolicy* policy,
+                                 const Slice& contents,
+                                 std::unique_ptr<char[]>* copy) {
+  const size_t alignment = policy->FilterAlignment();
+  const uintptr_t address = reinterpret_cast<uintptr_t>(contents.data());
+  if (alignment <= 1 || address % alignment == 0) {
+    return contents.data();
+  }
+  copy->reset(new char[contents.size() + alignment - 1]);
+  char* aligned = copy->get();
+  aligned += (alignment - reinterpret_cast<uintptr_t>(aligned) % alignment) %
+             alignment;
+  memcpy(aligned, contents.data(), contents.size());
+  return aligned;
+}
+
 FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy)
     : policy_(policy) {}
 
@@ -82,7 +102,7 @@ FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
   base_lg_ = contents[n - 1];
   uint32_t last_word = DecodeFixed32(contents.data() + n - 5);
   if (last_word > n - 5) return;
-  data_ = contents.data();
+  data_ = AlignContents(policy, contents, &aligned_copy_);
   offset_ = data_ + last_word;
   num_ = (n - 5 - last_word) / 4;
 }
@@ -103,4 +123,41 @@ bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
   return true;  // Errors are treated as potential matches
 }
 
+FullFilterBlockBuilder::FullFilterBlockBuilder(const FilterPolicy* policy)
+    : policy_(policy) {}
+
+void FullFilterBlockBuilder::AddKey(const Slice& key) {
+  start_.push_back(keys_.size());
+  keys_.append(key.data(), key.size());
+}
+
+Slice FullFilterBlockBuilder::Finish() {
+  if (!start_.empty()) {
+    const size_t num_keys = start_.size();
+    start_.push_back(keys_.size());  // Simplify length computation
+    std::vector<Slice> tmp_keys(num_keys);
+    for (size_t i = 0; i < num_keys; i++) {
+      tmp_keys[i] = Slice(keys_.data() + start_[i], start_[i + 1] - start_[i]);
+    }
+    policy_->CreateFilter(&tmp_keys[0], static_cast<int>(num_keys), &result_);
+  }
+  keys_.clear();
+  start_.clear();
+  return Slice(result_);
+}
+
+FullFilterBlockReader::FullFilterBlockReader(const FilterPolicy* policy,
+                                             const Slice& contents)
+    : policy_(policy),
+      filter_(AlignContents(policy, contents, &aligned_copy_),
+              contents.size()) {}
+
+bool FullFilterBlockReader::KeyMayMatch(const Slice& key) const {
+  if (filter_.empty()) {
+    // The table has no keys
+    return false;
+  }
+  return policy_->KeyMayMatch(key, filter_);
+}
+
 }  // namespace leveldb
@@ -119,6 +119,37 @@ TEST(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(!reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST(FilterBlockTest, BlockedBloomMisaligned) {
+  const FilterPolicy* policy = NewBlockedBloomFilterPolicy(10);
+  FilterBlockBuilder builder(policy);
+  for (int i = 0; i < 300; i++) {
+    if (i % 100 == 0) builder.StartBlock(i * 40);
+    builder.AddKey(NumberToString(i));
+  }
+  const std::string block = builder.Finish().ToString();
+
+  // Every filter is a whole number of lines, so no padding is needed.
+  const uint32_t array_offset = DecodeFixed32(block.data() + block.size() - 5);
+  ASSERT_EQ(0, array_offset % 64);
+  ASSERT_EQ(3 * 2 * 64, array_offset);
+
+  // The reader works on an aligned copy of misaligned contents.
+  std::string buffer(block.size() + 64, '\0');
+  char* start = &buffer[0];
+  start += 65 - reinterpret_cast<uintptr_t>(start) % 64;
+  memcpy(start, block.data(), block.size());
+  FilterBlockReader reader(policy, Slice(start, block.size()));
+  for (int i = 0; i < 300; i++) {
+    ASSERT_TRUE(reader.KeyMayMatch(i * 40 / 4000 * 4000, NumberToString(i)));
+  }
+  int false_positives = 0;
+  for (int i = 300; i < 1300; i++) {
+    if (reader.KeyMayMatch(0, NumberToString(i))) false_positives++;
+  }
+  ASSERT_LE(false_positives, 30);
+  delete policy;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
@@ -4,18 +4,15 @@
 
 #include "table/format.h"
 
+#include <vector>
+
 #include "leveldb/env.h"
 #include "port/port.h"
 #include "table/block.h"
+#include "util/block_buffer_pool.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 
-#include <stdexcept>
-
-#ifdef JL_LIBCFS
-extern thread_local int threadFsTid;
-#endif
-
 namespace leveldb {
 
 void BlockHandle::EncodeTo(std::string* dst) const {
@@ -39,8 +36,10 @@ void Footer::EncodeTo(std::string* dst) const {
   metaindex_handle_.EncodeTo(dst);
   index_handle_.EncodeTo(dst);
   dst->resize(2 * BlockHandle::kMaxEncodedLength);  // Padding
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber & 0xffffffffu));
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber >> 32));
+  const uint64_t magic =
+      partitioned_index_ ? kPartitionedIndexTableMagicNumber : kTableMagicNumber;
+  PutFixed32(dst, static_cast<uint32_t>(magic & 0xffffffffu));
+  PutFixed32(dst, static_cast<uint32_t>(magic >> 32));
   assert(dst->size() == original_size + kEncodedLength);
   (void)original_size;  // Disable unused variable warning.
 }
@@ -51,9 +50,11 @@ Status Footer::DecodeFrom(Slice* input) {
   const uint32_t magic_hi = DecodeFixed32(magic_ptr + 4);
   const uint64_t magic = ((static_cast<uint64_t>(magic_hi) << 32) |
                           (static_cast<uint64_t>(magic_lo)));
-  if (magic != kTableMagicNumber) {
+  if (magic != kTableMagicNumber &&
+      magic != kPartitionedIndexTableMagicNumber) {
     return Status::Corruption("not an sstable (bad magic number)");
   }
+  partitioned_index_ = (magic == kPartitionedIndexTableMagicNumber);
 
   Status result = metaindex_handle_.DecodeFrom(input);
   if (result.ok()) {
@@ -67,45 +68,19 @@ Status Footer::DecodeFrom(Slice* input) {
   return result;
 }
 
-void DestructBlockBuf(char* buf) {
-#ifdef JL_LIBCFS
-  fs_free_pad(buf);
-#else
-  delete[] buf;
-#endif  // JL_LIBCFS
-}
-
-Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result) {
+// Checks and decodes "contents", the bytes read into "buf" for the block
+// identified by "handle".  Takes ownership of "buf".
+static Status FinishBlockRead(const ReadOptions& options,
+                              const BlockHandle& handle, char* buf,
+                              const Slice& contents, BlockContents* result) {
   result->data = Slice();
   result->cachable = false;
   result->heap_allocated = false;
 
-  // Read the block contents as well as the type/crc footer.
-  // See table_builder.cc for the code that built this structure.
   size_t n = static_cast<size_t>(handle.size());
-  // char* buf = new char[n + kBlockTrailerSize];
-#ifdef JL_LIBCFS
-  // fprintf(stderr, "alloc for readBlock size:%lu\n", n + kBlockTrailerSize);
-  char* buf = (char*)fs_malloc_pad(n + kBlockTrailerSize);
-  if (buf == nullptr) {
-    throw std::runtime_error(std::to_string(threadFsTid) +
-                             " ReadBlock cannot alloc size:" +
-                             std::to_string(n + kBlockTrailerSize));
-  }
-#else  // JL_LIBCFS
-  char* buf = new char[n + kBlockTrailerSize];
-#endif
-
-  Slice contents;
-  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
-  if (!s.ok()) {
-    DestructBlockBuf(buf);
-    // delete[] buf;
-    return s;
-  }
+  Status s;
   if (contents.size() != n + kBlockTrailerSize) {
-    DestructBlockBuf(buf);
+    FreeBlockBuffer(buf, n + kBlockTrailerSize);
     // delete[] buf;
     return Status::Corruption("truncated block read");
   }
@@ -116,7 +91,7 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
     const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
     const uint32_t actual = crc32c::Value(data, n + 1);
     if (actual != crc) {
-      delete[] buf;
+      FreeBlockBuffer(buf, n + kBlockTrailerSize);
       s = Status::Corruption("block checksum mismatch");
       return s;
     }
@@ -128,7 +103,7 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
         // File implementation gave us pointer to some other data.
         // Use it directly under the assumption that it will be live
         // while the file is open.
-        DestructBlockBuf(buf);
+        FreeBlockBuffer(buf, n + kBlockTrailerSize);
         // delete[] buf;
         result->data = Slice(data, n);
         result->heap_allocated = false;
@@ -137,9 +112,6 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
         result->data = Slice(buf, n);
         result->heap_allocated = true;
         result->cachable = true;
-#ifdef JL_LIBCFS
-        result->allocatorFsTid = threadFsTid;
-#endif
       }
 
       // Ok
@@ -147,19 +119,19 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
     case kSnappyCompression: {
       size_t ulength = 0;
       if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
-        DestructBlockBuf(buf);
+        FreeBlockBuffer(buf, n + kBlockTrailerSize);
         // delete[] buf;
         return Status::Corruption("corrupted compressed block contents");
       }
-      char* ubuf = new char[ulength];
+      char* ubuf = AllocateBlockBuffer(ulength + kBlockTrailerSize);
       if (!port::Snappy_Uncompress(data, n, ubuf)) {
         // delete[] buf;
-        DestructBlockBuf(buf);
-        delete[] ubuf;
+        FreeBlockBuffer(buf, n + kBlockTrailerSize);
+        FreeBlockBuffer(ubuf, ulength + kBlockTrailerSize);
         return Status::Corruption("corrupted compressed block contents");
       }
       // delete[] buf;
-      DestructBlockBuf(buf);
+      FreeBlockBuffer(buf, n + kBlockTrailerSize);
       result->data = Slice(ubuf, ulength);
       result->heap_allocated = true;
       result->cachable = true;
@@ -167,11 +139,65 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
     }
     default:
       // delete[] buf;
-      DestructBlockBuf(buf);
+      FreeBlockBuffer(buf, n + kBlockTrailerSize);
       return Status::Corruption("bad block type");
   }
 
   return Status::OK();
 }
 
+Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
+                 const BlockHandle& handle, BlockContents* result) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+
+  // Read the block contents as well as the type/crc footer.
+  // See table_builder.cc for the code that built this structure.
+  size_t n = static_cast<size_t>(handle.size());
+  char* buf = AllocateBlockBuffer(n + kBlockTrailerSize);
+
+  Slice contents;
+  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+  if (!s.ok()) {
+    FreeBlockBuffer(buf, n + kBlockTrailerSize);
+    // delete[] buf;
+    return s;
+  }
+  return FinishBlockRead(options, handle, buf, contents, result);
+}
+
+Status ReadBlocks(RandomAccessFile* file, const ReadOptions& options,
+                  const BlockHandle* handles, size_t num,
+                  BlockContents* results) {
+  std::vector<ReadRequest> reqs(num);
+  for (size_t i = 0; i < num; i++) {
+    reqs[i].offset = handles[i].offset();
+    reqs[i].n = static_cast<size_t>(handles[i].size()) + kBlockTrailerSize;
+    reqs[i].scratch = AllocateBlockBuffer(reqs[i].n);
+  }
+
+  Status s = file->MultiRead(reqs.data(), num);
+  size_t finished = 0;  // Buffers handed to FinishBlockRead()
+  while (s.ok() && finished < num) {
+    const ReadRequest& req = reqs[finished];
+    s = FinishBlockRead(options, handles[finished], req.scratch, req.result,
+                        &results[finished]);
+    finished++;
+  }
+  if (!s.ok()) {
+    // Only the last block handed over failed, and its buffer is gone.
+    for (size_t i = 0; i + 1 < finished; i++) {
+      if (results[i].heap_allocated) {
+        FreeBlockBuffer(const_cast<char*>(results[i].data.data()),
+                        results[i].data.size() + kBlockTrailerSize);
+      }
+    }
+    for (size_t i = finished; i < num; i++) {
+      FreeBlockBuffer(reqs[i].scratch, reqs[i].n);
+    }
+  }
+  return s;
+}
+
 }  // namespace leveldb
@@ -53,7 +53,7 @@ class Footer {
   // of two block handles and a magic number.
   enum { kEncodedLength = 2 * BlockHandle::kMaxEncodedLength + 8 };
 
-  Footer() {}
+  Footer() : partitioned_index_(false) {}
 
   // The block handle for the metaindex block of the table
   const BlockHandle& metaindex_handle() const { return metaindex_handle_; }
@@ -63,12 +63,18 @@ class Footer {
   const BlockHandle& index_handle() const { return index_handle_; }
   void set_index_handle(const BlockHandle& h) { index_handle_ = h; }
 
+  // Whether the index block is a top-level index over index partitions
+  // (see Options::index_partition_size) rather than over data blocks.
+  bool partitioned_index() const { return partitioned_index_; }
+  void set_partitioned_index(bool p) { partitioned_index_ = p; }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(Slice* input);
 
  private:
   BlockHandle metaindex_handle_;
   BlockHandle index_handle_;
+  bool partitioned_index_;
 };
 
 // kTableMagicNumber was picked by running
@@ -76,16 +82,21 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// Tables with a partitioned index use a magic number of their own, so that
+// readers that do not know about partitioned indexes reject them instead
+// of taking the index partitions for data blocks.
+static const uint64_t kPartitionedIndexTableMagicNumber =
+    0xdb4775248b80fb58ull;
+
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
 struct BlockContents {
   Slice data;           // Actual contents of data
   bool cachable;        // True iff data can be cached
-  bool heap_allocated;  // True iff caller should delete[] data.data()
-#ifdef JL_LIBCFS
-  int allocatorFsTid{0};
-#endif
+  // True iff caller should FreeBlockBuffer(data.data(), data.size() +
+  // kBlockTrailerSize); heap-allocated blocks always have room for a trailer.
+  bool heap_allocated;
 };
 
 // Read the block identified by "handle" from "file".  On failure
@@ -93,6 +104,14 @@ struct BlockContents {
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
                  const BlockHandle& handle, BlockContents* result);
 
+// Read the blocks identified by handles[0..num-1] from "file" with a single
+// RandomAccessFile::MultiRead().  On failure return non-OK and fill none
+// of results[0..num-1].  On success fill results[i] with the contents of
+// the block identified by handles[i] and return OK.
+Status ReadBlocks(RandomAccessFile* file, const ReadOptions& options,
+                  const BlockHandle* handles, size_t num,
+                  BlockContents* results);
+
 // Implementation details follow.  Clients should ignore,
 
 inline BlockHandle::BlockHandle()
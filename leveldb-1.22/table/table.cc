@@ -13,15 +13,19 @@
 #include "table/filter_block.h"
 #include "table/format.h"
 #include "table/two_level_iterator.h"
+#include "util/block_buffer_pool.h"
 #include "util/coding.h"
 #include <stdexcept>
+#include <vector>
 
 namespace leveldb {
 
 struct Table::Rep {
   ~Rep() {
     delete filter;
-    delete[] filter_data;
+    delete full_filter;
+    FreeBlockBuffer(const_cast<char*>(filter_data),
+                    filter_data_size + kBlockTrailerSize);
     delete index_block;
   }
 
@@ -30,10 +34,13 @@ struct Table::Rep {
   RandomAccessFile* file;
   uint64_t cache_id;
   FilterBlockReader* filter;
+  FullFilterBlockReader* full_filter;
   const char* filter_data;
+  size_t filter_data_size;
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+  bool partitioned_index;  // index_block indexes index partitions
 };
 
 void DestructFooterSpace(char* buf) {
@@ -91,9 +98,12 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     rep->file = file;
     rep->metaindex_handle = footer.metaindex_handle();
     rep->index_block = index_block;
+    rep->partitioned_index = footer.partitioned_index();
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = nullptr;
+    rep->filter_data_size = 0;
     rep->filter = nullptr;
+    rep->full_filter = nullptr;
     *table = new Table(rep);
     (*table)->ReadMeta(footer);
   }
@@ -120,17 +130,24 @@ void Table::ReadMeta(const Footer& footer) {
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
+  std::string key = "fullfilter.";
   key.append(rep_->options.filter_policy->Name());
   iter->Seek(key);
   if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+    ReadFilter(iter->value(), true);
+  } else {
+    key = "filter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilter(iter->value(), false);
+    }
   }
   delete iter;
   delete meta;
 }
 
-void Table::ReadFilter(const Slice& filter_handle_value) {
+void Table::ReadFilter(const Slice& filter_handle_value, bool full) {
   Slice v = filter_handle_value;
   BlockHandle filter_handle;
   if (!filter_handle.DecodeFrom(&v).ok()) {
@@ -149,8 +166,14 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   }
   if (block.heap_allocated) {
     rep_->filter_data = block.data.data();  // Will need to delete later
+    rep_->filter_data_size = block.data.size();
+  }
+  if (full) {
+    rep_->full_filter =
+        new FullFilterBlockReader(rep_->options.filter_policy, block.data);
+  } else {
+    rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
   }
-  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
 }
 
 Table::~Table() { delete rep_; }
@@ -170,6 +193,14 @@ static void ReleaseBlock(void* arg, void* h) {
   cache->Release(handle);
 }
 
+// Returns the block cache key, stored in buf[0..15], of the block at
+// "offset" in the table with the given cache id.
+static Slice BlockCacheKey(uint64_t cache_id, uint64_t offset, char* buf) {
+  EncodeFixed64(buf, cache_id);
+  EncodeFixed64(buf + 8, offset);
+  return Slice(buf, 16);
+}
+
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
@@ -189,9 +220,8 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
     BlockContents contents;
     if (block_cache != nullptr) {
       char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
-      EncodeFixed64(cache_key_buffer + 8, handle.offset());
-      Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+      Slice key = BlockCacheKey(table->rep_->cache_id, handle.offset(),
+                                cache_key_buffer);
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != nullptr) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
@@ -227,17 +257,38 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
   return iter;
 }
 
+Iterator* Table::NewIndexIterator(const ReadOptions& options) const {
+  Iterator* iter = rep_->index_block->NewIterator(rep_->options.comparator);
+  if (!rep_->partitioned_index) {
+    return iter;
+  }
+  // The top-level index maps the last key of every index partition to its
+  // handle, so the partitions read like data blocks (and share the block
+  // cache with them).
+  ReadOptions partition_options = options;
+  partition_options.readahead_blocks = 0;
+  return NewTwoLevelIterator(iter, &Table::BlockReader,
+                             const_cast<Table*>(this), partition_options);
+}
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  Iterator* lookahead_index_iter = nullptr;
+  if (options.readahead_blocks > 0) {
+    lookahead_index_iter = NewIndexIterator(options);
+  }
+  return NewTwoLevelIterator(NewIndexIterator(options), &Table::BlockReader,
+                             const_cast<Table*>(this), options,
+                             lookahead_index_iter);
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
                                                 const Slice&)) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  if (rep_->full_filter != nullptr && !rep_->full_filter->KeyMayMatch(k)) {
+    return s;  // Not found
+  }
+  Iterator* iiter = NewIndexIterator(options);
   iiter->Seek(k);
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
@@ -263,9 +314,121 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
   return s;
 }
 
+Status Table::InternalMultiGet(const ReadOptions& options, const Slice* keys,
+                               void* const* args, size_t num,
+                               void (*handle_result)(void*, const Slice&,
+                                                     const Slice&)) {
+  // The data blocks to search, each with the keys that may be in it.  The
+  // keys are sorted, so the keys of one block are adjacent.
+  struct BlockLookup {
+    BlockHandle handle;
+    size_t begin, end;  // The block's keys are keys[matches[begin..end-1]]
+    Block* block;
+    Cache::Handle* cache_handle;
+  };
+  std::vector<BlockLookup> lookups;
+  std::vector<size_t> matches;  // Keys that passed the filters
+  Status s;
+  Iterator* iiter = NewIndexIterator(options);
+  for (size_t i = 0; i < num && s.ok(); i++) {
+    const Slice& k = keys[i];
+    if (rep_->full_filter != nullptr && !rep_->full_filter->KeyMayMatch(k)) {
+      continue;
+    }
+    iiter->Seek(k);
+    if (!iiter->Valid()) {
+      break;  // All the remaining keys are past the last block
+    }
+    Slice handle_value = iiter->value();
+    BlockHandle handle;
+    s = handle.DecodeFrom(&handle_value);
+    if (!s.ok()) {
+      break;
+    }
+    if (rep_->filter != nullptr &&
+        !rep_->filter->KeyMayMatch(handle.offset(), k)) {
+      continue;
+    }
+    if (lookups.empty() ||
+        lookups.back().handle.offset() != handle.offset()) {
+      lookups.push_back(BlockLookup{handle, matches.size(), matches.size(),
+                                    nullptr, nullptr});
+    }
+    matches.push_back(i);
+    lookups.back().end = matches.size();
+  }
+  if (s.ok()) {
+    s = iiter->status();
+  }
+  delete iiter;
+  if (!s.ok()) {
+    return s;
+  }
+
+  // Take what blocks we can from the cache and read the rest together.
+  Cache* block_cache = rep_->options.block_cache;
+  char cache_key_buffer[16];
+  std::vector<size_t> missing;  // Indexes into lookups
+  std::vector<BlockHandle> handles;
+  for (size_t i = 0; i < lookups.size(); i++) {
+    BlockLookup& lookup = lookups[i];
+    if (block_cache != nullptr) {
+      lookup.cache_handle = block_cache->Lookup(BlockCacheKey(
+          rep_->cache_id, lookup.handle.offset(), cache_key_buffer));
+      if (lookup.cache_handle != nullptr) {
+        lookup.block =
+            reinterpret_cast<Block*>(block_cache->Value(lookup.cache_handle));
+        continue;
+      }
+    }
+    missing.push_back(i);
+    handles.push_back(lookup.handle);
+  }
+  if (!missing.empty()) {
+    std::vector<BlockContents> contents(missing.size());
+    s = ReadBlocks(rep_->file, options, handles.data(), handles.size(),
+                   contents.data());
+    for (size_t i = 0; s.ok() && i < missing.size(); i++) {
+      BlockLookup& lookup = lookups[missing[i]];
+      lookup.block = new Block(contents[i]);
+      if (block_cache != nullptr && contents[i].cachable &&
+          options.fill_cache) {
+        lookup.cache_handle = block_cache->Insert(
+            BlockCacheKey(rep_->cache_id, lookup.handle.offset(),
+                          cache_key_buffer),
+            lookup.block, lookup.block->size(), &DeleteCachedBlock);
+      }
+    }
+  }
+
+  for (BlockLookup& lookup : lookups) {
+    if (lookup.block == nullptr) {
+      continue;  // The blocks were not read
+    }
+    if (s.ok()) {
+      Iterator* block_iter =
+          lookup.block->NewIterator(rep_->options.comparator);
+      for (size_t j = lookup.begin; j < lookup.end; j++) {
+        const size_t i = matches[j];
+        block_iter->Seek(keys[i]);
+        if (block_iter->Valid()) {
+          (*handle_result)(args[i], block_iter->key(), block_iter->value());
+        }
+      }
+      s = block_iter->status();
+      delete block_iter;
+    }
+    if (lookup.cache_handle != nullptr) {
+      block_cache->Release(lookup.cache_handle);
+    } else {
+      delete lookup.block;
+    }
+  }
+  return s;
+}
+
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
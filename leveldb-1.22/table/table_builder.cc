@@ -6,6 +6,10 @@
 
 #include <assert.h>
 
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
@@ -28,9 +32,13 @@ struct TableBuilder::Rep {
         index_block(&index_block_options),
         num_entries(0),
         closed(false),
-        filter_block(opt.filter_policy == nullptr
+        filter_block(opt.filter_policy == nullptr || opt.whole_table_filter
                          ? nullptr
                          : new FilterBlockBuilder(opt.filter_policy)),
+        full_filter_block(
+            opt.filter_policy == nullptr || !opt.whole_table_filter
+                ? nullptr
+                : new FullFilterBlockBuilder(opt.filter_policy)),
         pending_index_entry(false) {
     index_block_options.block_restart_interval = 1;
   }
@@ -46,6 +54,12 @@ struct TableBuilder::Rep {
   int64_t num_entries;
   bool closed;  // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
+  FullFilterBlockBuilder* full_filter_block;
+
+  // With Options::index_partition_size, the finished index partitions and
+  // the last key of each. They are written out by Finish(), so that data
+  // block offsets stay those that the filter block has been told about.
+  std::vector<std::pair<std::string, std::string>> index_partitions;
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -72,6 +86,7 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
   delete rep_->filter_block;
+  delete rep_->full_filter_block;
   delete rep_;
 }
 
@@ -82,6 +97,12 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if (options.whole_table_filter != rep_->options.whole_table_filter ||
+      (options.index_partition_size == 0) !=
+          (rep_->options.index_partition_size == 0)) {
+    return Status::InvalidArgument(
+        "changing filter or index layout while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
@@ -106,11 +127,19 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     r->pending_handle.EncodeTo(&handle_encoding);
     r->index_block.Add(r->last_key, Slice(handle_encoding));
     r->pending_index_entry = false;
+    if (r->options.index_partition_size > 0 &&
+        r->index_block.CurrentSizeEstimate() >=
+            r->options.index_partition_size) {
+      CutIndexPartition();
+    }
   }
 
   if (r->filter_block != nullptr) {
     r->filter_block->AddKey(key);
   }
+  if (r->full_filter_block != nullptr) {
+    r->full_filter_block->AddKey(key);
+  }
 
   r->last_key.assign(key.data(), key.size());
   r->num_entries++;
@@ -138,14 +167,27 @@ void TableBuilder::Flush() {
   }
 }
 
+void TableBuilder::CutIndexPartition() {
+  Rep* r = rep_;
+  // r->last_key is the key of the last entry of the partition, which
+  // separates it from the next one.
+  r->index_partitions.emplace_back(r->last_key,
+                                   r->index_block.Finish().ToString());
+  r->index_block.Reset();
+}
+
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
+  WriteBlock(block->Finish(), handle);
+  block->Reset();
+}
+
+void TableBuilder::WriteBlock(const Slice& raw, BlockHandle* handle) {
   // File format contains a sequence of blocks where each block has:
   //    block_data: uint8[n]
   //    type: uint8
   //    crc: uint32
   assert(ok());
   Rep* r = rep_;
-  Slice raw = block->Finish();
 
   Slice block_contents;
   CompressionType type = r->options.compression;
@@ -171,7 +213,6 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   }
   WriteRawBlock(block_contents, type, handle);
   r->compressed_output.clear();
-  block->Reset();
 }
 
 void TableBuilder::WriteRawBlock(const Slice& block_contents,
@@ -208,13 +249,23 @@ Status TableBuilder::Finish() {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
   }
+  if (ok() && r->full_filter_block != nullptr) {
+    WriteRawBlock(r->full_filter_block->Finish(), kNoCompression,
+                  &filter_block_handle);
+  }
 
   // Write metaindex block
   if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
-    if (r->filter_block != nullptr) {
-      // Add mapping from "filter.Name" to location of filter data
-      std::string key = "filter.";
+    // The metaindex is read with BytewiseComparator(), whose view of the
+    // key prefixes may differ from that of options.comparator.
+    Options meta_index_options = r->options;
+    meta_index_options.block_key_prefixes = false;
+    BlockBuilder meta_index_block(&meta_index_options);
+    if (r->filter_block != nullptr || r->full_filter_block != nullptr) {
+      // Add mapping from "filter.Name" (or "fullfilter.Name") to location
+      // of filter data
+      std::string key =
+          r->full_filter_block != nullptr ? "fullfilter." : "filter.";
       key.append(r->options.filter_policy->Name());
       std::string handle_encoding;
       filter_block_handle.EncodeTo(&handle_encoding);
@@ -234,7 +285,25 @@ Status TableBuilder::Finish() {
       r->index_block.Add(r->last_key, Slice(handle_encoding));
       r->pending_index_entry = false;
     }
-    WriteBlock(&r->index_block, &index_block_handle);
+    if (r->options.index_partition_size > 0) {
+      if (!r->index_block.empty()) {
+        CutIndexPartition();
+      }
+      BlockBuilder top_level_index(&r->index_block_options);
+      for (size_t i = 0; i < r->index_partitions.size() && ok(); i++) {
+        BlockHandle partition_handle;
+        WriteBlock(r->index_partitions[i].second, &partition_handle);
+        std::string handle_encoding;
+        partition_handle.EncodeTo(&handle_encoding);
+        top_level_index.Add(r->index_partitions[i].first, handle_encoding);
+      }
+      r->index_partitions.clear();
+      if (ok()) {
+        WriteBlock(&top_level_index, &index_block_handle);
+      }
+    } else {
+      WriteBlock(&r->index_block, &index_block_handle);
+    }
   }
 
   // Write footer
@@ -242,6 +311,7 @@ Status TableBuilder::Finish() {
     Footer footer;
     footer.set_metaindex_handle(metaindex_block_handle);
     footer.set_index_handle(index_block_handle);
+    footer.set_partitioned_index(r->options.index_partition_size > 0);
     std::string footer_encoding;
     footer.EncodeTo(&footer_encoding);
     r->status = r->file->Append(footer_encoding);
@@ -6,6 +6,7 @@
 
 #include <map>
 #include <string>
+#include <thread>
 
 #include "db/dbformat.h"
 #include "db/memtable.h"
@@ -237,6 +238,10 @@ class TableConstructor : public Constructor {
     return table_->NewIterator(ReadOptions());
   }
 
+  Iterator* NewTableIterator(const ReadOptions& options) const {
+    return table_->NewIterator(options);
+  }
+
   uint64_t ApproximateOffsetOf(const Slice& key) const {
     return table_->ApproximateOffsetOf(key);
   }
@@ -375,6 +380,8 @@ struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  size_t index_partition_size;
+  bool key_prefixes;
 };
 
 static const TestArgs kTestArgList[] = {
@@ -385,12 +392,24 @@ static const TestArgs kTestArgList[] = {
     {TABLE_TEST, true, 1},
     {TABLE_TEST, true, 1024},
 
+    // Small index partitions, so that most tables have several
+    {TABLE_TEST, false, 16, 64},
+    {TABLE_TEST, true, 1, 64},
+
+    // Key prefixes; the reverse comparator does not support them
+    {TABLE_TEST, false, 16, 0, true},
+    {TABLE_TEST, false, 1, 64, true},
+    {TABLE_TEST, true, 16, 0, true},
+
     {BLOCK_TEST, false, 16},
     {BLOCK_TEST, false, 1},
     {BLOCK_TEST, false, 1024},
     {BLOCK_TEST, true, 16},
     {BLOCK_TEST, true, 1},
     {BLOCK_TEST, true, 1024},
+    {BLOCK_TEST, false, 16, 0, true},
+    {BLOCK_TEST, false, 1, 0, true},
+    {BLOCK_TEST, false, 1024, 0, true},
 
     // Restart interval does not matter for memtables
     {MEMTABLE_TEST, false, 16},
@@ -415,6 +434,8 @@ class Harness {
     // Use shorter block size for tests to exercise block boundary
     // conditions more.
     options_.block_size = 256;
+    options_.index_partition_size = args.index_partition_size;
+    options_.block_key_prefixes = args.key_prefixes;
     if (args.reverse_compare) {
       options_.comparator = &reverse_key_comparator;
     }
@@ -676,6 +697,23 @@ TEST(Harness, SimpleSpecialKey) {
   }
 }
 
+TEST(Harness, LongSharedPrefixes) {
+  // do_work style keys, which agree on their first 8 bytes or more, and
+  // keys that are prefixes of others.
+  for (int i = 0; i < kNumTestArgs; i++) {
+    Init(kTestArgList[i]);
+    Random rnd(test::RandomSeed() + 6);
+    Add("0000", "short");
+    Add("00000000", "eight");
+    for (int j = 0; j < 500; j++) {
+      char key[20];
+      snprintf(key, sizeof(key), "%016d", j * 7);
+      Add(key, std::string(rnd.Uniform(20), 'v'));
+    }
+    Test(&rnd);
+  }
+}
+
 TEST(Harness, Randomized) {
   for (int i = 0; i < kNumTestArgs; i++) {
     Init(kTestArgList[i]);
@@ -787,6 +825,132 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 610000, 612000));
 }
 
+TEST(TableTest, ApproximateOffsetOfPartitionedIndex) {
+  TableConstructor c(BytewiseComparator());
+  c.Add("k01", "hello");
+  c.Add("k02", "hello2");
+  c.Add("k03", std::string(10000, 'x'));
+  c.Add("k04", std::string(200000, 'x'));
+  c.Add("k05", std::string(300000, 'x'));
+  c.Add("k06", "hello3");
+  c.Add("k07", std::string(100000, 'x'));
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  options.index_partition_size = 1;  // One index entry per partition
+  c.Finish(options, &keys, &kvmap);
+
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("abc"), 0, 0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k02"), 0, 0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k04"), 10000, 11000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k04a"), 210000, 211000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k06"), 510000, 511000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 610000, 612000));
+}
+
+TEST(TableTest, Readahead) {
+  TableConstructor c(BytewiseComparator());
+  Random rnd(301);
+  std::string value;
+  for (int i = 0; i < 1000; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "k%06d", i);
+    c.Add(key, test::RandomString(&rnd, 100, &value).ToString());
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  c.Finish(options, &keys, &kvmap);
+
+  ReadOptions read_options;
+  read_options.readahead_blocks = 4;
+
+  // A full forward scan sees every entry in order.
+  Iterator* iter = c.NewTableIterator(read_options);
+  KVMap::const_iterator model = kvmap.begin();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++model) {
+    ASSERT_TRUE(model != kvmap.end());
+    ASSERT_EQ(model->first, iter->key().ToString());
+    ASSERT_EQ(model->second, iter->value().ToString());
+  }
+  ASSERT_TRUE(model == kvmap.end());
+  ASSERT_OK(iter->status());
+
+  // Seeks and reverse steps in the middle of a scan drop blocks that were
+  // read ahead without losing entries.
+  for (int i = 0; i < 100; i++) {
+    const int start = rnd.Uniform(keys.size());
+    iter->Seek(keys[start]);
+    const int steps = rnd.Uniform(200);
+    for (int j = 0; j < steps && iter->Valid(); j++) {
+      ASSERT_EQ(keys[start + j], iter->key().ToString());
+      iter->Next();
+    }
+    if (iter->Valid() && rnd.OneIn(4)) {
+      const std::string key = iter->key().ToString();
+      iter->Prev();
+      ASSERT_TRUE(iter->Valid());
+      iter->Next();
+      ASSERT_EQ(key, iter->key().ToString());
+    }
+  }
+  ASSERT_OK(iter->status());
+
+  // Deleting an iterator with blocks still being read ahead is safe.
+  iter->SeekToFirst();
+  for (int i = 0; i < 50; i++) {
+    iter->Next();
+  }
+  delete iter;
+}
+
+TEST(TableTest, ConcurrentReadahead) {
+  TableConstructor c(BytewiseComparator());
+  Random rnd(301);
+  std::string value;
+  for (int i = 0; i < 1000; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "k%06d", i);
+    c.Add(key, test::RandomString(&rnd, 100, &value).ToString());
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  c.Finish(options, &keys, &kvmap);
+
+  ReadOptions read_options;
+  read_options.readahead_blocks = 4;
+
+  // Scans on several threads share the readahead threads; each one sees its
+  // own entries, and seeks that drop readahead do not hold up the others.
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 6; t++) {
+    threads.emplace_back([&, t]() {
+      Random thread_rnd(t + 1);
+      Iterator* iter = c.NewTableIterator(read_options);
+      for (int i = 0; i < 20; i++) {
+        const int start = thread_rnd.Uniform(keys.size());
+        int j = start;
+        for (iter->Seek(keys[start]); iter->Valid() && j < start + 300;
+             iter->Next(), j++) {
+          ASSERT_EQ(keys[j], iter->key().ToString());
+        }
+      }
+      ASSERT_OK(iter->status());
+      delete iter;
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
 static bool SnappyCompressionSupported() {
   std::string out;
   Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
@@ -4,10 +4,20 @@
 
 #include "table/two_level_iterator.h"
 
+#include <algorithm>
+#include <deque>
+#include <thread>
+
 #include "leveldb/table.h"
+#include "port/port.h"
 #include "table/block.h"
 #include "table/format.h"
 #include "table/iterator_wrapper.h"
+#include "util/mutexlock.h"
+
+#ifdef JL_LIBCFS
+#include "fsapi.h"
+#endif
 
 namespace leveldb {
 
@@ -15,10 +25,104 @@ namespace {
 
 typedef Iterator* (*BlockFunction)(void*, const ReadOptions&, const Slice&);
 
+// A data block read issued ahead of a forward scan.
+struct ReadaheadRequest {
+  BlockFunction block_function;
+  void* arg;
+  const ReadOptions* options;
+  std::string handle;
+
+  // Owned by the issuing iterator; guard the fields below.
+  port::Mutex* mu;
+  port::CondVar* cv;
+  bool cancelled;     // Set by the iterator if the block is no longer wanted
+  bool done;          // Set once "result" is filled in
+  Iterator* result;   // nullptr if the request was cancelled before it ran
+};
+
+// Runs readahead requests on a few background threads that are started on
+// first use and never exit. Requests are started in the order they were
+// submitted, but different threads' scans do not wait for each other.
+class ReadaheadPool {
+ public:
+  static ReadaheadPool* Default() {
+    static ReadaheadPool* pool = new ReadaheadPool;
+    return pool;
+  }
+
+  void Submit(ReadaheadRequest* req) {
+    MutexLock l(&mu_);
+    queue_.push_back(req);
+    cv_.Signal();
+  }
+
+  // Takes the requests of "reqs" that no thread has started off the queue,
+  // marking them done without a result, so that discarding readahead only
+  // waits for the reads already under way.
+  void Withdraw(const std::deque<ReadaheadRequest*>& reqs) {
+    MutexLock l(&mu_);
+    for (ReadaheadRequest* req : reqs) {
+      auto it = std::find(queue_.begin(), queue_.end(), req);
+      if (it != queue_.end()) {
+        queue_.erase(it);
+        req->mu->Lock();
+        req->done = true;
+        req->mu->Unlock();
+      }
+    }
+  }
+
+ private:
+  static const int kNumThreads = 4;
+
+  ReadaheadPool() : cv_(&mu_) {
+    for (int i = 0; i < kNumThreads; i++) {
+      std::thread(&ReadaheadPool::Run, this).detach();
+    }
+  }
+
+  void Run() {
+#ifdef JL_LIBCFS
+    // Blocks are read into this thread's uFS shared memory.
+    fs_init_thread_local_mem();
+#endif
+    while (true) {
+      mu_.Lock();
+      while (queue_.empty()) {
+        cv_.Wait();
+      }
+      ReadaheadRequest* req = queue_.front();
+      queue_.pop_front();
+      mu_.Unlock();
+
+      req->mu->Lock();
+      const bool cancelled = req->cancelled;
+      req->mu->Unlock();
+
+      Iterator* result = nullptr;
+      if (!cancelled) {
+        result = (*req->block_function)(req->arg, *req->options, req->handle);
+      }
+
+      // "req" may be deleted by its iterator as soon as the lock is released.
+      req->mu->Lock();
+      req->result = result;
+      req->done = true;
+      req->cv->SignalAll();
+      req->mu->Unlock();
+    }
+  }
+
+  port::Mutex mu_;
+  port::CondVar cv_;
+  std::deque<ReadaheadRequest*> queue_;  // Requests no thread has started.
+};
+
 class TwoLevelIterator : public Iterator {
  public:
   TwoLevelIterator(Iterator* index_iter, BlockFunction block_function,
-                   void* arg, const ReadOptions& options);
+                   void* arg, const ReadOptions& options,
+                   Iterator* lookahead_index_iter);
 
   virtual ~TwoLevelIterator();
 
@@ -57,6 +161,12 @@ class TwoLevelIterator : public Iterator {
   void SetDataIterator(Iterator* data_iter);
   void InitDataBlock();
 
+  // Readahead helpers; no-ops unless a lookahead index iterator was supplied.
+  void IssueReadahead();
+  Iterator* TakeReadahead(const Slice& handle);
+  Iterator* WaitForReadahead(ReadaheadRequest* req);
+  void DiscardReadahead();
+
   BlockFunction block_function_;
   void* arg_;
   const ReadOptions options_;
@@ -66,20 +176,44 @@ class TwoLevelIterator : public Iterator {
   // If data_iter_ is non-null, then "data_block_handle_" holds the
   // "index_value" passed to block_function_ to create the data_iter_.
   std::string data_block_handle_;
+
+  // Positioned at the handle of the last block in readahead_, if any.
+  Iterator* lookahead_iter_;  // May be nullptr
+  const int readahead_limit_;
+  // True iff the last block was entered by stepping forward from the
+  // previous one.
+  bool sequential_;
+  port::Mutex readahead_mu_;
+  port::CondVar readahead_cv_;
+  // Outstanding requests, in index order.
+  std::deque<ReadaheadRequest*> readahead_;
 };
 
 TwoLevelIterator::TwoLevelIterator(Iterator* index_iter,
                                    BlockFunction block_function, void* arg,
-                                   const ReadOptions& options)
+                                   const ReadOptions& options,
+                                   Iterator* lookahead_index_iter)
     : block_function_(block_function),
       arg_(arg),
       options_(options),
       index_iter_(index_iter),
-      data_iter_(nullptr) {}
+      data_iter_(nullptr),
+      lookahead_iter_(lookahead_index_iter),
+      readahead_limit_(lookahead_index_iter != nullptr
+                           ? options.readahead_blocks
+                           : 0),
+      sequential_(false),
+      readahead_cv_(&readahead_mu_) {}
 
-TwoLevelIterator::~TwoLevelIterator() {}
+TwoLevelIterator::~TwoLevelIterator() {
+  // Outstanding requests refer to options_ and the mutex, so they must
+  // finish before the iterator goes away.
+  DiscardReadahead();
+  delete lookahead_iter_;
+}
 
 void TwoLevelIterator::Seek(const Slice& target) {
+  sequential_ = false;
   index_iter_.Seek(target);
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.Seek(target);
@@ -87,6 +221,7 @@ void TwoLevelIterator::Seek(const Slice& target) {
 }
 
 void TwoLevelIterator::SeekToFirst() {
+  sequential_ = false;
   index_iter_.SeekToFirst();
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.SeekToFirst();
@@ -94,6 +229,7 @@ void TwoLevelIterator::SeekToFirst() {
 }
 
 void TwoLevelIterator::SeekToLast() {
+  sequential_ = false;
   index_iter_.SeekToLast();
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.SeekToLast();
@@ -120,6 +256,7 @@ void TwoLevelIterator::SkipEmptyDataBlocksForward() {
       return;
     }
     index_iter_.Next();
+    sequential_ = true;
     InitDataBlock();
     if (data_iter_.iter() != nullptr) data_iter_.SeekToFirst();
   }
@@ -133,6 +270,7 @@ void TwoLevelIterator::SkipEmptyDataBlocksBackward() {
       return;
     }
     index_iter_.Prev();
+    sequential_ = false;
     InitDataBlock();
     if (data_iter_.iter() != nullptr) data_iter_.SeekToLast();
   }
@@ -153,19 +291,90 @@ void TwoLevelIterator::InitDataBlock() {
       // data_iter_ is already constructed with this iterator, so
       // no need to change anything
     } else {
-      Iterator* iter = (*block_function_)(arg_, options_, handle);
+      Iterator* iter = TakeReadahead(handle);
+      if (iter == nullptr) {
+        iter = (*block_function_)(arg_, options_, handle);
+      }
       data_block_handle_.assign(handle.data(), handle.size());
       SetDataIterator(iter);
+      if (sequential_) {
+        IssueReadahead();
+      }
     }
   }
 }
 
+void TwoLevelIterator::IssueReadahead() {
+  if (readahead_limit_ <= 0) return;
+  if (readahead_.empty()) {
+    lookahead_iter_->Seek(index_iter_.key());
+  }
+  while (static_cast<int>(readahead_.size()) < readahead_limit_ &&
+         lookahead_iter_->Valid()) {
+    lookahead_iter_->Next();
+    if (!lookahead_iter_->Valid()) break;
+    Slice handle = lookahead_iter_->value();
+    ReadaheadRequest* req = new ReadaheadRequest;
+    req->block_function = block_function_;
+    req->arg = arg_;
+    req->options = &options_;
+    req->handle.assign(handle.data(), handle.size());
+    req->mu = &readahead_mu_;
+    req->cv = &readahead_cv_;
+    req->cancelled = false;
+    req->done = false;
+    req->result = nullptr;
+    readahead_.push_back(req);
+    ReadaheadPool::Default()->Submit(req);
+  }
+}
+
+Iterator* TwoLevelIterator::TakeReadahead(const Slice& handle) {
+  if (readahead_.empty()) return nullptr;
+  if (handle.compare(readahead_.front()->handle) != 0) {
+    // The scan did not move on to the next prefetched block, so everything
+    // queued is probably useless.
+    DiscardReadahead();
+    return nullptr;
+  }
+  ReadaheadRequest* req = readahead_.front();
+  readahead_.pop_front();
+  return WaitForReadahead(req);
+}
+
+Iterator* TwoLevelIterator::WaitForReadahead(ReadaheadRequest* req) {
+  readahead_mu_.Lock();
+  while (!req->done) {
+    readahead_cv_.Wait();
+  }
+  readahead_mu_.Unlock();
+  Iterator* result = req->result;
+  delete req;
+  return result;
+}
+
+void TwoLevelIterator::DiscardReadahead() {
+  if (readahead_.empty()) return;
+  readahead_mu_.Lock();
+  for (ReadaheadRequest* req : readahead_) {
+    req->cancelled = true;
+  }
+  readahead_mu_.Unlock();
+  ReadaheadPool::Default()->Withdraw(readahead_);
+  for (ReadaheadRequest* req : readahead_) {
+    delete WaitForReadahead(req);
+  }
+  readahead_.clear();
+}
+
 }  // namespace
 
 Iterator* NewTwoLevelIterator(Iterator* index_iter,
                               BlockFunction block_function, void* arg,
-                              const ReadOptions& options) {
-  return new TwoLevelIterator(index_iter, block_function, arg, options);
+                              const ReadOptions& options,
+                              Iterator* lookahead_index_iter) {
+  return new TwoLevelIterator(index_iter, block_function, arg, options,
+                              lookahead_index_iter);
 }
 
 }  // namespace leveldb
@@ -20,11 +20,18 @@ struct ReadOptions;
 //
 // Uses a supplied function to convert an index_iter value into
 // an iterator over the contents of the corresponding block.
+//
+// If "lookahead_index_iter" is non-null, it must be a second iterator over
+// the same index, and the returned iterator takes ownership of it.  Once a
+// forward scan moves from one block to the next, it is used to build the
+// next options.readahead_blocks blocks on a background thread, so that they
+// are ready by the time the scan reaches them.
 Iterator* NewTwoLevelIterator(
     Iterator* index_iter,
     Iterator* (*block_function)(void* arg, const ReadOptions& options,
                                 const Slice& index_value),
-    void* arg, const ReadOptions& options);
+    void* arg, const ReadOptions& options,
+    Iterator* lookahead_index_iter = nullptr);
 
 }  // namespace leveldb
 
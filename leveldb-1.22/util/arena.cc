@@ -4,17 +4,141 @@
 
 #include "util/arena.h"
 
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include "util/mutexlock.h"
+
 namespace leveldb {
 
 static const int kBlockSize = 4096;
 
-Arena::Arena()
-    : alloc_ptr_(nullptr), alloc_bytes_remaining_(0), memory_usage_(0) {}
+static const int kAlign = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+static_assert((kAlign & (kAlign - 1)) == 0,
+              "Pointer size should be a power of 2");
+
+namespace {
+
+// The unused part of the block that the calling thread allocates from in
+// AllocateConcurrently().
+struct ThreadSlice {
+  uint64_t arena_id = 0;
+  char* ptr = nullptr;
+  size_t remaining = 0;
+};
+
+thread_local ThreadSlice thread_slice;
+
+std::atomic<uint64_t> next_arena_id(1);
+
+}  // namespace
+
+// The size of the huge pages that regions are made of, and to which their
+// size is rounded up.
+static const size_t kHugePageSize = 2 << 20;
+
+// Regions kept by a pool for reuse.  A memtable and an immutable memtable
+// are alive at once, and a third is made while the second is flushed.
+static const size_t kMaxFreeRegions = 2;
+
+static char* MapRegion(size_t bytes) {
+#if defined(__linux__)
+  void* region = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  region = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (region != MAP_FAILED) {
+    return reinterpret_cast<char*>(region);
+  }
+#endif
+  // No reserved huge pages.  Align the region to a huge page so that
+  // transparent huge pages can back all of it.
+  const size_t mapped = bytes + kHugePageSize;
+  region = ::mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED) {
+    return nullptr;
+  }
+  const uintptr_t start = reinterpret_cast<uintptr_t>(region);
+  const uintptr_t aligned =
+      (start + kHugePageSize - 1) & ~uintptr_t{kHugePageSize - 1};
+  if (aligned > start) {
+    ::munmap(region, aligned - start);
+  }
+  if (start + mapped > aligned + bytes) {
+    ::munmap(reinterpret_cast<void*>(aligned + bytes),
+             start + mapped - (aligned + bytes));
+  }
+#ifdef MADV_HUGEPAGE
+  ::madvise(reinterpret_cast<void*>(aligned), bytes, MADV_HUGEPAGE);
+#endif
+  return reinterpret_cast<char*>(aligned);
+#else
+  return new char[bytes];
+#endif
+}
+
+static void UnmapRegion(char* region, size_t bytes) {
+#if defined(__linux__)
+  ::munmap(region, bytes);
+#else
+  delete[] region;
+#endif
+}
+
+ArenaRegionPool::ArenaRegionPool(size_t region_bytes)
+    : region_bytes_((region_bytes + kHugePageSize - 1) & ~(kHugePageSize - 1)) {
+}
+
+ArenaRegionPool::~ArenaRegionPool() {
+  for (char* region : free_regions_) {
+    UnmapRegion(region, region_bytes_);
+  }
+}
+
+char* ArenaRegionPool::Take() {
+  {
+    MutexLock l(&mu_);
+    if (!free_regions_.empty()) {
+      char* region = free_regions_.back();
+      free_regions_.pop_back();
+      return region;
+    }
+  }
+  return MapRegion(region_bytes_);
+}
+
+void ArenaRegionPool::Return(char* region) {
+  {
+    MutexLock l(&mu_);
+    if (free_regions_.size() < kMaxFreeRegions) {
+      free_regions_.push_back(region);
+      return;
+    }
+  }
+  UnmapRegion(region, region_bytes_);
+}
+
+Arena::Arena() : Arena(nullptr) {}
+
+Arena::Arena(ArenaRegionPool* pool)
+    : alloc_ptr_(nullptr),
+      alloc_bytes_remaining_(0),
+      pool_(pool),
+      region_(pool != nullptr ? pool->Take() : nullptr),
+      region_ptr_(region_),
+      region_remaining_(region_ != nullptr ? pool->region_bytes() : 0),
+      memory_usage_(0),
+      id_(next_arena_id.fetch_add(1, std::memory_order_relaxed)) {}
 
 Arena::~Arena() {
   for (size_t i = 0; i < blocks_.size(); i++) {
     delete[] blocks_[i];
   }
+  if (region_ != nullptr) {
+    pool_->Return(region_);
+  }
 }
 
 char* Arena::AllocateFallback(size_t bytes) {
@@ -36,9 +160,7 @@ char* Arena::AllocateFallback(size_t bytes) {
 }
 
 char* Arena::AllocateAligned(size_t bytes) {
-  const int align = (sizeof(void*) > 8) ? sizeof(void*) : 8;
-  static_assert((align & (align - 1)) == 0,
-                "Pointer size should be a power of 2");
+  const int align = kAlign;
   size_t current_mod = reinterpret_cast<uintptr_t>(alloc_ptr_) & (align - 1);
   size_t slop = (current_mod == 0 ? 0 : align - current_mod);
   size_t needed = bytes + slop;
@@ -55,9 +177,58 @@ char* Arena::AllocateAligned(size_t bytes) {
   return result;
 }
 
+char* Arena::AllocateConcurrently(size_t bytes) {
+  return AllocateFromSlice(bytes, false);
+}
+
+char* Arena::AllocateAlignedConcurrently(size_t bytes) {
+  return AllocateFromSlice(bytes, true);
+}
+
+char* Arena::AllocateFromSlice(size_t bytes, bool aligned) {
+  assert(bytes > 0);
+  ThreadSlice& slice = thread_slice;
+  if (slice.arena_id != id_) {
+    // The slice belongs to another (possibly deleted) arena.
+    slice.arena_id = id_;
+    slice.ptr = nullptr;
+    slice.remaining = 0;
+  }
+  size_t slop = 0;
+  if (aligned) {
+    size_t current_mod = reinterpret_cast<uintptr_t>(slice.ptr) & (kAlign - 1);
+    slop = (current_mod == 0 ? 0 : kAlign - current_mod);
+  }
+  if (bytes + slop <= slice.remaining) {
+    char* result = slice.ptr + slop;
+    slice.ptr += bytes + slop;
+    slice.remaining -= bytes + slop;
+    return result;
+  }
+
+  // Same policy as AllocateFallback(), which also keeps the result aligned.
+  MutexLock l(&mu_);
+  if (bytes > kBlockSize / 4) {
+    return AllocateNewBlock(bytes);
+  }
+  char* result = AllocateNewBlock(kBlockSize);
+  slice.ptr = result + bytes;
+  slice.remaining = kBlockSize - bytes;
+  return result;
+}
+
 char* Arena::AllocateNewBlock(size_t block_bytes) {
-  char* result = new char[block_bytes];
-  blocks_.push_back(result);
+  // Blocks carved from the region stay aligned, as new[] ones are.
+  const size_t carved = (block_bytes + kAlign - 1) & ~size_t{kAlign - 1};
+  char* result;
+  if (carved <= region_remaining_) {
+    result = region_ptr_;
+    region_ptr_ += carved;
+    region_remaining_ -= carved;
+  } else {
+    result = new char[block_bytes];
+    blocks_.push_back(result);
+  }
   memory_usage_.fetch_add(block_bytes + sizeof(char*),
                           std::memory_order_relaxed);
   return result;
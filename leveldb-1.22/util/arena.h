@@ -11,12 +11,53 @@
 #include <cstdint>
 #include <vector>
 
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
 namespace leveldb {
 
+// Hands out memory regions of one size to arenas (see
+// Arena(ArenaRegionPool*)).  Regions are backed by huge pages where the
+// platform has them: reserved ones (MAP_HUGETLB) if the system has any,
+// else transparent huge pages.  A returned region is kept, with the pages
+// it has touched, for the next Take(), unless a few are kept already.
+//
+// Thread-safe.
+class ArenaRegionPool {
+ public:
+  // Regions hold at least "region_bytes" bytes.
+  explicit ArenaRegionPool(size_t region_bytes);
+
+  ArenaRegionPool(const ArenaRegionPool&) = delete;
+  ArenaRegionPool& operator=(const ArenaRegionPool&) = delete;
+
+  // REQUIRES: Every region taken has been returned.
+  ~ArenaRegionPool();
+
+  size_t region_bytes() const { return region_bytes_; }
+
+  // Returns a region of region_bytes() bytes, or nullptr if no memory
+  // could be mapped.
+  char* Take();
+
+  // Gives back a region returned by Take().
+  void Return(char* region);
+
+ private:
+  const size_t region_bytes_;
+  port::Mutex mu_;
+  std::vector<char*> free_regions_ GUARDED_BY(mu_);
+};
+
 class Arena {
  public:
   Arena();
 
+  // Makes an arena that allocates from a region of "*pool" until the
+  // region runs out, and returns the region when destroyed.  *pool must
+  // outlive the arena.
+  explicit Arena(ArenaRegionPool* pool);
+
   Arena(const Arena&) = delete;
   Arena& operator=(const Arena&) = delete;
 
@@ -28,6 +69,16 @@ class Arena {
   // Allocate memory with the normal alignment guarantees provided by malloc.
   char* AllocateAligned(size_t bytes);
 
+  // Like Allocate() and AllocateAligned(), but safe to call from several
+  // threads at once.  Each thread carves its allocations out of its own
+  // slice of the arena and only synchronizes with the others to take a
+  // new slice.  A thread that switches between arenas gives up the rest
+  // of its slice.
+  // REQUIRES: Allocate() and AllocateAligned() are not running at the
+  // same time.
+  char* AllocateConcurrently(size_t bytes);
+  char* AllocateAlignedConcurrently(size_t bytes);
+
   // Returns an estimate of the total memory usage of data allocated
   // by the arena.
   size_t MemoryUsage() const {
@@ -37,6 +88,7 @@ class Arena {
  private:
   char* AllocateFallback(size_t bytes);
   char* AllocateNewBlock(size_t block_bytes);
+  char* AllocateFromSlice(size_t bytes, bool aligned);
 
   // Allocation state
   char* alloc_ptr_;
@@ -45,11 +97,24 @@ class Arena {
   // Array of new[] allocated memory blocks
   std::vector<char*> blocks_;
 
+  // The region from "pool_" that blocks are carved from while it lasts,
+  // and the part of it not carved yet.
+  ArenaRegionPool* const pool_;
+  char* region_;
+  char* region_ptr_;
+  size_t region_remaining_;
+
   // Total memory usage of the arena.
   //
   // TODO(costan): This member is accessed via atomics, but the others are
   //               accessed without any locking. Is this OK?
   std::atomic<size_t> memory_usage_;
+
+  // Serializes the concurrent allocations' updates of blocks_.
+  port::Mutex mu_;
+
+  // Tells the per-thread slices of different arenas apart.
+  const uint64_t id_;
 };
 
 inline char* Arena::Allocate(size_t bytes) {
@@ -13,9 +13,8 @@ class ArenaTest {};
 
 TEST(ArenaTest, Empty) { Arena arena; }
 
-TEST(ArenaTest, Simple) {
+static void CheckAllocations(Arena* arena) {
   std::vector<std::pair<size_t, char*> > allocated;
-  Arena arena;
   const int N = 100000;
   size_t bytes = 0;
   Random rnd(301);
@@ -34,9 +33,9 @@ TEST(ArenaTest, Simple) {
     }
     char* r;
     if (rnd.OneIn(10)) {
-      r = arena.AllocateAligned(s);
+      r = arena->AllocateAligned(s);
     } else {
-      r = arena.Allocate(s);
+      r = arena->Allocate(s);
     }
 
     for (size_t b = 0; b < s; b++) {
@@ -45,9 +44,9 @@ TEST(ArenaTest, Simple) {
     }
     bytes += s;
     allocated.push_back(std::make_pair(s, r));
-    ASSERT_GE(arena.MemoryUsage(), bytes);
+    ASSERT_GE(arena->MemoryUsage(), bytes);
     if (i > N / 10) {
-      ASSERT_LE(arena.MemoryUsage(), bytes * 1.10);
+      ASSERT_LE(arena->MemoryUsage(), bytes * 1.10);
     }
   }
   for (size_t i = 0; i < allocated.size(); i++) {
@@ -60,6 +59,35 @@ TEST(ArenaTest, Simple) {
   }
 }
 
+TEST(ArenaTest, Simple) {
+  Arena arena;
+  CheckAllocations(&arena);
+}
+
+TEST(ArenaTest, RegionPool) {
+  // Smaller than the allocations below, which overflow into new[] blocks.
+  ArenaRegionPool pool(1 << 20);
+  ASSERT_GE(pool.region_bytes(), 1 << 20);
+  {
+    Arena arena(&pool);
+    CheckAllocations(&arena);
+  }
+
+  char* region = pool.Take();
+  ASSERT_TRUE(region != nullptr);
+  pool.Return(region);
+  {
+    // The region given back is reused, and allocations start at its head.
+    Arena arena(&pool);
+    char* r = arena.Allocate(100);
+    ASSERT_GE(r, region);
+    ASSERT_LT(r, region + pool.region_bytes());
+    memset(r, 1, 100);
+  }
+  ASSERT_EQ(region, pool.Take());
+  pool.Return(region);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
@@ -0,0 +1,327 @@
+// Copyright (c) 2020 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/block_buffer_pool.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+#ifdef JL_LIBCFS
+#include "fsapi.h"
+extern thread_local int threadFsTid;
+#endif
+
+namespace leveldb {
+
+namespace {
+
+// Sizes are rounded up to one of four classes per power of two, which keeps
+// the waste for the common 4 KiB block (plus trailer) reads under 25%.
+constexpr const int kMinClassShift = 8;   // 256 bytes
+constexpr const int kMaxClassShift = 20;  // Classes up to 2 MiB
+constexpr const size_t kMinClassSize = size_t{1} << kMinClassShift;
+constexpr const int kNumClasses =
+    (kMaxClassShift - kMinClassShift + 1) * 4 + 1;
+
+// Buffers larger than the largest class bypass the thread caches.
+constexpr const int kUnpooledClass = kNumClasses;
+
+// Maximum number of free buffers a thread keeps per size class.
+constexpr const int kMaxCachedPerClass = 32;
+
+#ifdef JL_LIBCFS
+// uFS reads into fs_malloc_pad() allocations in place and chooses their
+// alignment itself, so the read target must be the pointer fs_malloc_pad()
+// returned rather than an offset into it. The header of such a buffer
+// therefore follows its data, at an offset derived from the requested size.
+#else
+// Every buffer is preceded by a header of this size, which keeps the data
+// cache-line aligned relative to the start of the allocation.
+#endif
+constexpr const size_t kHeaderSize = 64;
+
+class ThreadCache;
+
+struct BufferHeader {
+  ThreadCache* owner;  // nullptr for unpooled buffers.
+  BufferHeader* next;  // Link in a free list or a remote-free queue.
+  size_t capacity;
+  int size_class;
+#ifdef JL_LIBCFS
+  int fs_tid;  // threadFsTid of the allocating thread.
+#endif
+};
+
+static_assert(sizeof(BufferHeader) <= kHeaderSize, "header does not fit");
+
+int SizeClassOf(size_t n) {
+  if (n <= kMinClassSize) return 0;
+  const int shift = 63 - __builtin_clzll(n - 1);
+  if (shift > kMaxClassShift) return kUnpooledClass;
+  const int quarter = static_cast<int>(((n - 1) >> (shift - 2)) & 3);
+  return (shift - kMinClassShift) * 4 + quarter + 1;
+}
+
+size_t ClassSize(int size_class) {
+  if (size_class == 0) return kMinClassSize;
+  const int shift = (size_class - 1) / 4 + kMinClassShift;
+  const int quarter = (size_class - 1) % 4;
+  return static_cast<size_t>(5 + quarter) << (shift - 2);
+}
+
+// Capacity of the buffer AllocateBlockBuffer(n) returns.
+size_t CapacityFor(size_t n) {
+  const int size_class = SizeClassOf(n);
+  return size_class == kUnpooledClass ? n : ClassSize(size_class);
+}
+
+#ifdef JL_LIBCFS
+// Offset of the header from the start of a buffer of the given capacity.
+size_t HeaderOffset(size_t capacity) {
+  return (capacity + kHeaderSize - 1) & ~(kHeaderSize - 1);
+}
+#endif
+
+char* DataOf(BufferHeader* header) {
+#ifdef JL_LIBCFS
+  return reinterpret_cast<char*>(header) - HeaderOffset(header->capacity);
+#else
+  return reinterpret_cast<char*>(header) + kHeaderSize;
+#endif
+}
+
+// REQUIRES: "buf" was returned by AllocateBlockBuffer(n).
+BufferHeader* HeaderOf(const char* buf, size_t n) {
+#ifdef JL_LIBCFS
+  BufferHeader* header = reinterpret_cast<BufferHeader*>(
+      const_cast<char*>(buf) + HeaderOffset(CapacityFor(n)));
+#else
+  BufferHeader* header =
+      reinterpret_cast<BufferHeader*>(const_cast<char*>(buf) - kHeaderSize);
+#endif
+  assert(header->capacity == CapacityFor(n));
+  return header;
+}
+
+void UnrefCache(ThreadCache* cache);
+
+BufferHeader* RawAllocate(size_t capacity, int size_class, ThreadCache* owner) {
+#ifdef JL_LIBCFS
+  void* mem = fs_malloc_pad(HeaderOffset(capacity) + kHeaderSize);
+#else
+  // Cache-line aligned, so that e.g. blocked bloom filters can be probed
+  // in place (see FilterPolicy::FilterAlignment()).
+  void* mem = nullptr;
+  if (posix_memalign(&mem, kHeaderSize, kHeaderSize + capacity) != 0) {
+    mem = nullptr;
+  }
+#endif
+  if (mem == nullptr) {
+#ifdef JL_LIBCFS
+    throw std::runtime_error(std::to_string(threadFsTid) +
+                             " ReadBlock cannot alloc size:" +
+                             std::to_string(capacity));
+#else
+    throw std::runtime_error("ReadBlock cannot alloc size:" +
+                             std::to_string(capacity));
+#endif
+  }
+#ifdef JL_LIBCFS
+  BufferHeader* header = reinterpret_cast<BufferHeader*>(
+      static_cast<char*>(mem) + HeaderOffset(capacity));
+#else
+  BufferHeader* header = static_cast<BufferHeader*>(mem);
+#endif
+  header->owner = owner;
+  header->next = nullptr;
+  header->capacity = capacity;
+  header->size_class = size_class;
+#ifdef JL_LIBCFS
+  header->fs_tid = threadFsTid;
+#endif
+  return header;
+}
+
+void RawFree(BufferHeader* header) {
+  ThreadCache* owner = header->owner;
+#ifdef JL_LIBCFS
+  fs_free_pad(DataOf(header), header->fs_tid);
+#else
+  std::free(header);
+#endif
+  if (owner != nullptr) {
+    UnrefCache(owner);
+  }
+}
+
+// Per-thread free lists, one per size class.
+//
+// Only the owning thread touches the free lists. Other threads push buffers
+// they free onto remote_frees_, which the owner drains in bulk. When the
+// owner exits the queue is closed, and later remote frees go straight back to
+// the underlying allocator. Every buffer allocated from a cache holds a
+// reference to it, as does its owning thread until it exits; the cache is
+// deleted when the last of these goes away.
+class ThreadCache {
+ public:
+  ThreadCache() = default;
+
+  ThreadCache(const ThreadCache&) = delete;
+  ThreadCache& operator=(const ThreadCache&) = delete;
+
+  // Returns the calling thread's cache, creating it on first use.
+  static ThreadCache* Current() {
+    thread_local Holder holder;
+    return holder.cache;
+  }
+
+  // Returns the calling thread's cache, or nullptr if it has none yet.
+  static ThreadCache* Existing() { return current_; }
+
+  char* Allocate(int size_class) {
+    FreeList& list = lists_[size_class];
+    if (list.head == nullptr) {
+      DrainRemoteFrees();
+    }
+    BufferHeader* header = list.head;
+    if (header != nullptr) {
+      list.head = header->next;
+      list.count--;
+    } else {
+      header = RawAllocate(ClassSize(size_class), size_class, this);
+      refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return DataOf(header);
+  }
+
+  // REQUIRES: Called by the owning thread.
+  void FreeLocal(BufferHeader* header) {
+    assert(header->owner == this);
+    FreeList& list = lists_[header->size_class];
+    if (list.count >= kMaxCachedPerClass) {
+      RawFree(header);
+      return;
+    }
+    header->next = list.head;
+    list.head = header;
+    list.count++;
+  }
+
+  // May be called by any thread.
+  void FreeRemote(BufferHeader* header) {
+    BufferHeader* head = remote_frees_.load(std::memory_order_relaxed);
+    do {
+      if (head == Closed()) {
+        RawFree(header);
+        return;
+      }
+      header->next = head;
+    } while (!remote_frees_.compare_exchange_weak(head, header,
+                                                  std::memory_order_release,
+                                                  std::memory_order_relaxed));
+  }
+
+  void Unref() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+
+ private:
+  struct FreeList {
+    BufferHeader* head = nullptr;
+    int count = 0;
+  };
+
+  // Owns the calling thread's reference to its cache and closes the cache
+  // when the thread exits.
+  struct Holder {
+    Holder() : cache(new ThreadCache) { current_ = cache; }
+    ~Holder() {
+      current_ = nullptr;
+      cache->Close();
+      cache->Unref();
+    }
+
+    ThreadCache* const cache;
+  };
+
+  ~ThreadCache() = default;
+
+  // Sentinel stored in remote_frees_ once the owning thread has exited.
+  static BufferHeader* Closed() {
+    static BufferHeader closed;
+    return &closed;
+  }
+
+  void DrainRemoteFrees() {
+    BufferHeader* header =
+        remote_frees_.exchange(nullptr, std::memory_order_acquire);
+    while (header != nullptr) {
+      BufferHeader* next = header->next;
+      FreeLocal(header);
+      header = next;
+    }
+  }
+
+  void Close() {
+    BufferHeader* header =
+        remote_frees_.exchange(Closed(), std::memory_order_acquire);
+    while (header != nullptr) {
+      BufferHeader* next = header->next;
+      RawFree(header);
+      header = next;
+    }
+    for (FreeList& list : lists_) {
+      while (list.head != nullptr) {
+        BufferHeader* next = list.head->next;
+        RawFree(list.head);
+        list.head = next;
+      }
+      list.count = 0;
+    }
+  }
+
+  static thread_local ThreadCache* current_;
+
+  FreeList lists_[kNumClasses];
+  std::atomic<BufferHeader*> remote_frees_{nullptr};
+  std::atomic<int> refs_{1};  // The owning thread's reference.
+};
+
+thread_local ThreadCache* ThreadCache::current_ = nullptr;
+
+void UnrefCache(ThreadCache* cache) { cache->Unref(); }
+
+}  // namespace
+
+char* AllocateBlockBuffer(size_t n) {
+  const int size_class = SizeClassOf(n);
+  if (size_class == kUnpooledClass) {
+    return DataOf(RawAllocate(n, kUnpooledClass, nullptr));
+  }
+  return ThreadCache::Current()->Allocate(size_class);
+}
+
+void FreeBlockBuffer(char* buf, size_t n) {
+  if (buf == nullptr) return;
+  BufferHeader* header = HeaderOf(buf, n);
+  if (header->owner == nullptr) {
+    RawFree(header);
+  } else if (header->owner == ThreadCache::Existing()) {
+    header->owner->FreeLocal(header);
+  } else {
+    header->owner->FreeRemote(header);
+  }
+}
+
+size_t BlockBufferCapacity(const char* buf, size_t n) {
+  return HeaderOf(buf, n)->capacity;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,38 @@
+// Copyright (c) 2020 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A size-classed pool of buffers for blocks read from table files.
+//
+// Under JL_LIBCFS the buffers are allocations of the uFS shared-memory
+// allocator (fs_malloc_pad), returned as is so that fs_allocated_pread() can
+// fill them in place; otherwise they come from malloc(). Every thread keeps
+// a small cache of free buffers per size class, so the Get() path does not
+// hit the underlying allocator once the cache is warm. Blocks are often
+// freed by a different thread than the one that read them (e.g. on block
+// cache eviction); such frees are handed back to the allocating thread
+// through a lock-free queue that it drains on its next allocation.
+
+#ifndef STORAGE_LEVELDB_UTIL_BLOCK_BUFFER_POOL_H_
+#define STORAGE_LEVELDB_UTIL_BLOCK_BUFFER_POOL_H_
+
+#include <cstddef>
+
+namespace leveldb {
+
+// Return a buffer of at least "n" bytes. Never returns nullptr; throws
+// std::runtime_error if the underlying allocator is exhausted.
+char* AllocateBlockBuffer(size_t n);
+
+// Return a buffer obtained from AllocateBlockBuffer(n) to the pool. "n" must
+// be the size it was allocated with. May be called from any thread. "buf"
+// may be nullptr.
+void FreeBlockBuffer(char* buf, size_t n);
+
+// Return the usable size of a buffer obtained from AllocateBlockBuffer(n).
+// This is the size of its class, which is at least "n".
+size_t BlockBufferCapacity(const char* buf, size_t n);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_BLOCK_BUFFER_POOL_H_
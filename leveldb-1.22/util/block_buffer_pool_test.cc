@@ -0,0 +1,116 @@
+// Copyright (c) 2020 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/block_buffer_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "util/random.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class BlockBufferPoolTest {};
+
+TEST(BlockBufferPoolTest, Empty) { FreeBlockBuffer(nullptr, 0); }
+
+TEST(BlockBufferPoolTest, Capacity) {
+  const size_t sizes[] = {1,    255,  256,   257,    4096,
+                          4101, 5120, 5121,  65536,  (1 << 21),
+                          (1 << 21) + 1};
+  for (size_t n : sizes) {
+    char* buf = AllocateBlockBuffer(n);
+    ASSERT_GE(BlockBufferCapacity(buf, n), n);
+    // Rounding up wastes at most a quarter of a size class.
+    if (n > 256) {
+      ASSERT_LE(BlockBufferCapacity(buf, n), n + n / 4);
+    }
+    std::memset(buf, 0xab, n);
+    FreeBlockBuffer(buf, n);
+  }
+}
+
+TEST(BlockBufferPoolTest, ReusesFreedBuffers) {
+  char* first = AllocateBlockBuffer(4101);
+  FreeBlockBuffer(first, 4101);
+  char* second = AllocateBlockBuffer(4101);
+  ASSERT_EQ(first, second);
+  FreeBlockBuffer(second, 4101);
+}
+
+TEST(BlockBufferPoolTest, CrossThreadFree) {
+  std::vector<char*> bufs;
+  for (int i = 0; i < 16; i++) {
+    bufs.push_back(AllocateBlockBuffer(4101));
+  }
+  std::thread freer([&bufs]() {
+    for (char* buf : bufs) {
+      FreeBlockBuffer(buf, 4101);
+    }
+  });
+  freer.join();
+
+  // The remote frees are drained back into this thread's cache.
+  for (int i = 0; i < 16; i++) {
+    char* buf = AllocateBlockBuffer(4101);
+    ASSERT_TRUE(std::find(bufs.begin(), bufs.end(), buf) != bufs.end());
+  }
+  for (char* buf : bufs) {
+    FreeBlockBuffer(buf, 4101);
+  }
+}
+
+TEST(BlockBufferPoolTest, FreeAfterOwnerExits) {
+  std::vector<char*> bufs;
+  std::thread owner([&bufs]() {
+    for (int i = 0; i < 8; i++) {
+      bufs.push_back(AllocateBlockBuffer(1000 * (i + 1)));
+    }
+  });
+  owner.join();
+  for (size_t i = 0; i < bufs.size(); i++) {
+    FreeBlockBuffer(bufs[i], 1000 * (i + 1));
+  }
+}
+
+TEST(BlockBufferPoolTest, Concurrent) {
+  constexpr int kNumThreads = 4;
+  constexpr int kNumOps = 20000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([t]() {
+      Random rnd(301 + t);
+      std::vector<std::pair<char*, size_t>> live;
+      for (int i = 0; i < kNumOps; i++) {
+        if (live.empty() || rnd.OneIn(2)) {
+          const size_t n = 1 + rnd.Uniform(16384);
+          char* buf = AllocateBlockBuffer(n);
+          buf[0] = static_cast<char>(t);
+          buf[n - 1] = static_cast<char>(t);
+          live.emplace_back(buf, n);
+        } else {
+          const size_t victim = rnd.Uniform(live.size());
+          ASSERT_EQ(static_cast<char>(t), live[victim].first[0]);
+          FreeBlockBuffer(live[victim].first, live[victim].second);
+          live[victim] = live.back();
+          live.pop_back();
+        }
+      }
+      for (const auto& buf : live) {
+        FreeBlockBuffer(buf.first, buf.second);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
@@ -4,9 +4,17 @@
 
 #include "leveldb/filter_policy.h"
 
+#include <cstring>
+
 #include "leveldb/slice.h"
+#include "port/port.h"
 #include "util/hash.h"
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define LEVELDB_BLOOM_AVX2 1
+#endif
+
 namespace leveldb {
 
 namespace {
@@ -83,10 +91,136 @@ class BloomFilterPolicy : public FilterPolicy {
   size_t bits_per_key_;
   size_t k_;
 };
+
+// A filter of the blocked policy is a run of 64-byte lines, preceded by
+// the zero padding that aligns the first line (relative to the start of
+// the string passed to CreateFilter(), i.e. of the filter block):
+//
+//    [pad (< 64 bytes)] [line 0] ... [line n-1]
+//
+// There is no trailer, so that consecutive filters stay line-aligned
+// without further padding; the number of probes is fixed by the policy
+// (and recorded in its name). A key picks its line with one hash and the
+// bits within it with another. Probe i sets bit (h2 * kProbeMultipliers[i])
+// >> 23 of the line: the top 4 bits of the product choose one of the 16
+// 32-bit words and the next 5 bits the bit in it, so that the AVX2 kernel
+// can do all the probes with one gather.
+static const size_t kLineBytes = 64;
+static const size_t kLineBits = kLineBytes * 8;
+static const int kMaxBlockedProbes = 8;
+static const uint32_t kProbeMultipliers[kMaxBlockedProbes] = {
+    0x9e3779b9, 0x85ebca6b, 0xc2b2ae35, 0x27d4eb2f,
+    0x165667b1, 0xd3a2646d, 0xfd7046c5, 0xb55a4f09};
+
+static uint32_t LineHash(const Slice& key) {
+  return Hash(key.data(), key.size(), 0x2f693b71);
+}
+
+static inline uint32_t ProbeBit(uint32_t h, int i) {
+  return (h * kProbeMultipliers[i]) >> 23;
+}
+
+// Words are little-endian, so addressing the line by bytes gives the same
+// bits as the 32-bit gathers of the AVX2 kernel, on any host.
+static bool ProbeLine(const char* line, uint32_t h, int k) {
+  for (int i = 0; i < k; i++) {
+    const uint32_t bitpos = ProbeBit(h, i);
+    if ((line[bitpos / 8] & (1 << (bitpos % 8))) == 0) return false;
+  }
+  return true;
+}
+
+#ifdef LEVELDB_BLOOM_AVX2
+__attribute__((target("avx2"))) static bool ProbeLineAVX2(const char* line,
+                                                         uint32_t h, int k) {
+  const __m256i multipliers = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(kProbeMultipliers));
+  const __m256i products =
+      _mm256_mullo_epi32(_mm256_set1_epi32(h), multipliers);
+  const __m256i words = _mm256_i32gather_epi32(
+      reinterpret_cast<const int*>(line), _mm256_srli_epi32(products, 28), 4);
+  const __m256i bits = _mm256_and_si256(_mm256_srli_epi32(products, 23),
+                                        _mm256_set1_epi32(31));
+  // Lanes at or past k do not take part in the test.
+  const __m256i active = _mm256_cmpgt_epi32(
+      _mm256_set1_epi32(k), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+  const __m256i masks = _mm256_and_si256(
+      _mm256_sllv_epi32(_mm256_set1_epi32(1), bits), active);
+  // True iff every mask bit is set in its word.
+  return _mm256_testc_si256(words, masks);
+}
+#endif
+
+class BlockedBloomFilterPolicy : public FilterPolicy {
+ public:
+  explicit BlockedBloomFilterPolicy(int bits_per_key)
+      : bits_per_key_(bits_per_key) {
+    k_ = static_cast<int>(bits_per_key * 0.69);  // 0.69 =~ ln(2)
+    if (k_ < 1) k_ = 1;
+    if (k_ > kMaxBlockedProbes) k_ = kMaxBlockedProbes;
+    name_ = "leveldb.BlockedBloomFilter" + std::to_string(k_);
+#ifdef LEVELDB_BLOOM_AVX2
+    use_avx2_ = port::HasAVX2();
+#endif
+  }
+
+  virtual const char* Name() const { return name_.c_str(); }
+
+  virtual size_t FilterAlignment() const { return kLineBytes; }
+
+  virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const {
+    size_t lines = (n * bits_per_key_ + kLineBits - 1) / kLineBits;
+    if (lines < 1) lines = 1;
+
+    const size_t init_size = (dst->size() + kLineBytes - 1) & ~(kLineBytes - 1);
+    dst->resize(init_size + lines * kLineBytes, 0);
+    char* array = &(*dst)[init_size];
+    for (int i = 0; i < n; i++) {
+      char* line = array + LineOf(BloomHash(keys[i]), lines) * kLineBytes;
+      const uint32_t h = LineHash(keys[i]);
+      for (int j = 0; j < k_; j++) {
+        const uint32_t bitpos = ProbeBit(h, j);
+        line[bitpos / 8] |= (1 << (bitpos % 8));
+      }
+    }
+  }
+
+  virtual bool KeyMayMatch(const Slice& key, const Slice& bloom_filter) const {
+    const size_t lines = bloom_filter.size() / kLineBytes;
+    if (lines == 0) return false;
+
+    // Skip the padding, and start loading the line while the second hash
+    // is computed.
+    const char* array =
+        bloom_filter.data() + bloom_filter.size() - lines * kLineBytes;
+    const char* line = array + LineOf(BloomHash(key), lines) * kLineBytes;
+    __builtin_prefetch(line);
+    const uint32_t h = LineHash(key);
+#ifdef LEVELDB_BLOOM_AVX2
+    if (use_avx2_) return ProbeLineAVX2(line, h, k_);
+#endif
+    return ProbeLine(line, h, k_);
+  }
+
+ private:
+  // Maps h uniformly onto [0, lines) without a division.
+  static size_t LineOf(uint32_t h, size_t lines) {
+    return static_cast<size_t>((static_cast<uint64_t>(h) * lines) >> 32);
+  }
+
+  size_t bits_per_key_;
+  int k_;
+  std::string name_;
+  bool use_avx2_ = false;
+};
 }  // namespace
 
 const FilterPolicy* NewBloomFilterPolicy(int bits_per_key) {
   return new BloomFilterPolicy(bits_per_key);
 }
 
+const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key) {
+  return new BlockedBloomFilterPolicy(bits_per_key);
+}
+
 }  // namespace leveldb
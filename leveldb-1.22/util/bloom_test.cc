@@ -21,6 +21,7 @@ static Slice Key(int i, char* buffer) {
 class BloomTest {
  public:
   BloomTest() : policy_(NewBloomFilterPolicy(10)) {}
+  explicit BloomTest(const FilterPolicy* policy) : policy_(policy) {}
 
   ~BloomTest() { delete policy_; }
 
@@ -31,14 +32,17 @@ class BloomTest {
 
   void Add(const Slice& s) { keys_.push_back(s.ToString()); }
 
-  void Build() {
+  // "prefix" bytes precede the filter in the string passed to the policy,
+  // as earlier filters do in a filter block.
+  void Build(size_t prefix = 0) {
     std::vector<Slice> key_slices;
     for (size_t i = 0; i < keys_.size(); i++) {
       key_slices.push_back(Slice(keys_[i]));
     }
-    filter_.clear();
+    filter_.assign(prefix, 'x');
     policy_->CreateFilter(&key_slices[0], static_cast<int>(key_slices.size()),
                           &filter_);
+    filter_.erase(0, prefix);
     keys_.clear();
     if (kVerbose >= 2) DumpFilter();
   }
@@ -149,6 +153,86 @@ TEST(BloomTest, VaryingLengths) {
   ASSERT_LE(mediocre_filters, good_filters / 5);
 }
 
+// Cache-line-blocked filters (see NewBlockedBloomFilterPolicy()).
+
+class BlockedBloomTest : public BloomTest {
+ public:
+  BlockedBloomTest() : BloomTest(NewBlockedBloomFilterPolicy(10)) {}
+};
+
+TEST(BlockedBloomTest, BlockedEmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST(BlockedBloomTest, BlockedSmall) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+  ASSERT_EQ(64, FilterSize());
+}
+
+TEST(BlockedBloomTest, BlockedPadding) {
+  // The lines are aligned relative to the start of the string, whatever
+  // precedes the filter in it.
+  char buffer[sizeof(int)];
+  for (size_t prefix = 0; prefix <= 64; prefix += 13) {
+    for (int i = 0; i < 100; i++) {
+      Add(Key(i, buffer));
+    }
+    Build(prefix);
+    ASSERT_EQ(0, (prefix + FilterSize()) % 64) << prefix;
+    ASSERT_EQ(2 * 64, FilterSize() / 64 * 64) << prefix;
+    for (int i = 0; i < 100; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer))) << prefix;
+    }
+  }
+}
+
+TEST(BlockedBloomTest, BlockedVaryingLengths) {
+  char buffer[sizeof(int)];
+
+  int mediocre_filters = 0;
+  int good_filters = 0;
+
+  for (int length = 1; length <= 10000; length = NextLength(length)) {
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+
+    ASSERT_EQ(FilterSize(), static_cast<size_t>((length * 10 + 511) / 512 * 64))
+        << length;
+
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    // Blocking costs some accuracy, and small filters are rounded up to a
+    // whole line.
+    double rate = FalsePositiveRate();
+    if (kVerbose >= 1) {
+      fprintf(stderr, "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+              rate * 100.0, length, static_cast<int>(FilterSize()));
+    }
+    ASSERT_LE(rate, 0.025);
+    if (rate > 0.015)
+      mediocre_filters++;
+    else
+      good_filters++;
+  }
+  if (kVerbose >= 1) {
+    fprintf(stderr, "Filters: %d good, %d mediocre\n", good_filters,
+            mediocre_filters);
+  }
+  ASSERT_LE(mediocre_filters, good_filters / 5);
+}
+
 // Different bits-per-byte
 
 }  // namespace leveldb
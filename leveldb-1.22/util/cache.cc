@@ -6,6 +6,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <chrono>
+
 #include "leveldb/cache.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -146,6 +148,30 @@ class HandleTable {
   }
 };
 
+// Like MutexLock, but adds the time spent waiting for the lock, if it was
+// contended, to *wait_nanos.  *wait_nanos must be guarded by *mu.
+class SCOPED_LOCKABLE TimedMutexLock {
+ public:
+  TimedMutexLock(port::Mutex* mu, uint64_t* wait_nanos)
+      EXCLUSIVE_LOCK_FUNCTION(mu)
+      : mu_(mu) {
+    if (!mu_->TryLock()) {
+      auto start = std::chrono::steady_clock::now();
+      mu_->Lock();
+      *wait_nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    }
+  }
+  ~TimedMutexLock() UNLOCK_FUNCTION() { mu_->Unlock(); }
+
+  TimedMutexLock(const TimedMutexLock&) = delete;
+  TimedMutexLock& operator=(const TimedMutexLock&) = delete;
+
+ private:
+  port::Mutex* const mu_;
+};
+
 // A single shard of sharded cache.
 class LRUCache {
  public:
@@ -167,6 +193,7 @@ class LRUCache {
     MutexLock l(&mutex_);
     return usage_;
   }
+  CacheShardStats Stats() const;
 
  private:
   void LRU_Remove(LRUHandle* e);
@@ -192,6 +219,9 @@ class LRUCache {
   LRUHandle in_use_ GUARDED_BY(mutex_);
 
   HandleTable table_ GUARDED_BY(mutex_);
+
+  // Statistics, apart from usage_.
+  CacheShardStats stats_ GUARDED_BY(mutex_);
 };
 
 LRUCache::LRUCache() : capacity_(0), usage_(0) {
@@ -250,16 +280,19 @@ void LRUCache::LRU_Append(LRUHandle* list, LRUHandle* e) {
 }
 
 Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
-  MutexLock l(&mutex_);
+  TimedMutexLock l(&mutex_, &stats_.lock_wait_nanos);
   LRUHandle* e = table_.Lookup(key, hash);
   if (e != nullptr) {
     Ref(e);
+    stats_.hits++;
+  } else {
+    stats_.misses++;
   }
   return reinterpret_cast<Cache::Handle*>(e);
 }
 
 void LRUCache::Release(Cache::Handle* handle) {
-  MutexLock l(&mutex_);
+  TimedMutexLock l(&mutex_, &stats_.lock_wait_nanos);
   Unref(reinterpret_cast<LRUHandle*>(handle));
 }
 
@@ -267,7 +300,8 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
                                 size_t charge,
                                 void (*deleter)(const Slice& key,
                                                 void* value)) {
-  MutexLock l(&mutex_);
+  TimedMutexLock l(&mutex_, &stats_.lock_wait_nanos);
+  stats_.inserts++;
 
   LRUHandle* e =
       reinterpret_cast<LRUHandle*>(malloc(sizeof(LRUHandle) - 1 + key.size()));
@@ -297,6 +331,7 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
     if (!erased) {  // to avoid unused variable when compiled NDEBUG
       assert(erased);
     }
+    stats_.evictions++;
   }
 
   return reinterpret_cast<Cache::Handle*>(e);
@@ -316,12 +351,12 @@ bool LRUCache::FinishErase(LRUHandle* e) {
 }
 
 void LRUCache::Erase(const Slice& key, uint32_t hash) {
-  MutexLock l(&mutex_);
+  TimedMutexLock l(&mutex_, &stats_.lock_wait_nanos);
   FinishErase(table_.Remove(key, hash));
 }
 
 void LRUCache::Prune() {
-  MutexLock l(&mutex_);
+  TimedMutexLock l(&mutex_, &stats_.lock_wait_nanos);
   while (lru_.next != &lru_) {
     LRUHandle* e = lru_.next;
     assert(e->refs == 1);
@@ -332,12 +367,18 @@ void LRUCache::Prune() {
   }
 }
 
-static const int kNumShardBits = 4;
-static const int kNumShards = 1 << kNumShardBits;
+CacheShardStats LRUCache::Stats() const {
+  MutexLock l(&mutex_);
+  CacheShardStats stats = stats_;
+  stats.usage = usage_;
+  return stats;
+}
 
 class ShardedLRUCache : public Cache {
  private:
-  LRUCache shard_[kNumShards];
+  LRUCache* shard_;
+  const int num_shard_bits_;
+  const int num_shards_;
   port::Mutex id_mutex_;
   uint64_t last_id_;
 
@@ -345,16 +386,22 @@ class ShardedLRUCache : public Cache {
     return Hash(s.data(), s.size(), 0);
   }
 
-  static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
+  uint32_t Shard(uint32_t hash) const {
+    return num_shard_bits_ == 0 ? 0 : hash >> (32 - num_shard_bits_);
+  }
 
  public:
-  explicit ShardedLRUCache(size_t capacity) : last_id_(0) {
-    const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
-    for (int s = 0; s < kNumShards; s++) {
+  ShardedLRUCache(size_t capacity, int num_shard_bits)
+      : num_shard_bits_(num_shard_bits),
+        num_shards_(1 << num_shard_bits),
+        last_id_(0) {
+    shard_ = new LRUCache[num_shards_];
+    const size_t per_shard = (capacity + (num_shards_ - 1)) / num_shards_;
+    for (int s = 0; s < num_shards_; s++) {
       shard_[s].SetCapacity(per_shard);
     }
   }
-  virtual ~ShardedLRUCache() {}
+  virtual ~ShardedLRUCache() { delete[] shard_; }
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) {
     const uint32_t hash = HashSlice(key);
@@ -380,21 +427,30 @@ class ShardedLRUCache : public Cache {
     return ++(last_id_);
   }
   virtual void Prune() {
-    for (int s = 0; s < kNumShards; s++) {
+    for (int s = 0; s < num_shards_; s++) {
       shard_[s].Prune();
     }
   }
   virtual size_t TotalCharge() const {
     size_t total = 0;
-    for (int s = 0; s < kNumShards; s++) {
+    for (int s = 0; s < num_shards_; s++) {
       total += shard_[s].TotalCharge();
     }
     return total;
   }
+  virtual void GetShardStats(std::vector<CacheShardStats>* stats) const {
+    for (int s = 0; s < num_shards_; s++) {
+      stats->push_back(shard_[s].Stats());
+    }
+  }
 };
 
 }  // end anonymous namespace
 
-Cache* NewLRUCache(size_t capacity) { return new ShardedLRUCache(capacity); }
+Cache* NewLRUCache(size_t capacity, int shard_bits) {
+  if (shard_bits < 0) shard_bits = 0;
+  if (shard_bits > 16) shard_bits = 16;
+  return new ShardedLRUCache(capacity, shard_bits);
+}
 
 }  // namespace leveldb
@@ -4,6 +4,9 @@
 
 #include "leveldb/cache.h"
 
+#include <atomic>
+#include <cstdio>
+#include <thread>
 #include <vector>
 #include "util/coding.h"
 #include "util/testharness.h"
@@ -23,8 +26,20 @@ static int DecodeKey(const Slice& k) {
 static void* EncodeValue(uintptr_t v) { return reinterpret_cast<void*>(v); }
 static int DecodeValue(void* v) { return reinterpret_cast<uintptr_t>(v); }
 
+// Every test runs against both cache implementations; main() runs them all
+// once with use_clock_ unset and once with it set.
 class CacheTest {
  public:
+  static Cache* NewCache(size_t capacity) {
+    return use_clock_ ? NewClockCache(capacity, 2, 1) : NewLRUCache(capacity);
+  }
+
+  // The most a cache of kCacheSize may hold once nothing is in use. LRU
+  // shards round their share of the capacity up.
+  static int MaxCharge() {
+    return use_clock_ ? kCacheSize : kCacheSize + kCacheSize / 10;
+  }
+
   static void Deleter(const Slice& key, void* v) {
     current_->deleted_keys_.push_back(DecodeKey(key));
     current_->deleted_values_.push_back(DecodeValue(v));
@@ -35,7 +50,7 @@ class CacheTest {
   std::vector<int> deleted_values_;
   Cache* cache_;
 
-  CacheTest() : cache_(NewLRUCache(kCacheSize)) { current_ = this; }
+  CacheTest() : cache_(NewCache(kCacheSize)) { current_ = this; }
 
   ~CacheTest() { delete cache_; }
 
@@ -60,9 +75,12 @@ class CacheTest {
 
   void Erase(int key) { cache_->Erase(EncodeKey(key)); }
 
+  static bool use_clock_;
   static CacheTest* current_;
 };
+bool CacheTest::use_clock_ = false;
 CacheTest* CacheTest::current_;
+const int CacheTest::kCacheSize;
 
 TEST(CacheTest, HitAndMiss) {
   ASSERT_EQ(-1, Lookup(100));
@@ -138,8 +156,9 @@ TEST(CacheTest, EvictionPolicy) {
   Cache::Handle* h = cache_->Lookup(EncodeKey(300));
 
   // Frequently used entry must be kept around,
-  // as must things that are still in use.
-  for (int i = 0; i < kCacheSize + 100; i++) {
+  // as must things that are still in use.  CLOCK evicts in slot order rather
+  // than by age, so insert enough for its hand to go all the way around.
+  for (int i = 0; i < 3 * kCacheSize; i++) {
     Insert(1000 + i, 2000 + i);
     ASSERT_EQ(2000 + i, Lookup(1000 + i));
     ASSERT_EQ(101, Lookup(100));
@@ -148,6 +167,7 @@ TEST(CacheTest, EvictionPolicy) {
   ASSERT_EQ(-1, Lookup(200));
   ASSERT_EQ(301, Lookup(300));
   cache_->Release(h);
+  ASSERT_LE(cache_->TotalCharge(), MaxCharge());
 }
 
 TEST(CacheTest, UseExceedsCacheSize) {
@@ -191,7 +211,8 @@ TEST(CacheTest, HeavyEntries) {
       ASSERT_EQ(1000 + i, r);
     }
   }
-  ASSERT_LE(cached_weight, kCacheSize + kCacheSize / 10);
+  ASSERT_LE(cached_weight, MaxCharge());
+  ASSERT_EQ(cached_weight, cache_->TotalCharge());
 }
 
 TEST(CacheTest, NewId) {
@@ -213,14 +234,92 @@ TEST(CacheTest, Prune) {
   ASSERT_EQ(-1, Lookup(2));
 }
 
+// Only the LRU cache keeps per-shard stats.
+TEST(CacheTest, ShardStats) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0);
+
+  Insert(100, 101);
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(-1, Lookup(200));
+  for (int i = 0; i < kCacheSize; i++) {
+    Insert(1000 + i, 2000 + i);
+  }
+
+  std::vector<CacheShardStats> stats;
+  cache_->GetShardStats(&stats);
+  ASSERT_EQ(1, stats.size());
+  ASSERT_EQ(1, stats[0].hits);
+  ASSERT_EQ(1, stats[0].misses);
+  ASSERT_EQ(kCacheSize + 1, stats[0].inserts);
+  ASSERT_EQ(1, stats[0].evictions);
+  ASSERT_EQ(kCacheSize, stats[0].usage);
+}
+
 TEST(CacheTest, ZeroSizeCache) {
   delete cache_;
-  cache_ = NewLRUCache(0);
+  cache_ = NewCache(0);
 
   Insert(1, 100);
   ASSERT_EQ(-1, Lookup(1));
+  ASSERT_EQ(1, deleted_keys_.size());
+}
+
+static std::atomic<int> concurrent_deleted(0);
+
+static void CountingDeleter(const Slice& key, void* v) {
+  ASSERT_EQ(DecodeKey(key), DecodeValue(v));
+  concurrent_deleted.fetch_add(1);
+}
+
+TEST(CacheTest, ConcurrentAccess) {
+  // Few keys in a small cache, so threads keep replacing, evicting and
+  // looking up the same entries.
+  const int kThreads = 4;
+  const int kKeys = 200;
+  const int kOps = 50000;
+  Cache* cache = NewCache(64);
+  concurrent_deleted.store(0);
+  std::atomic<int> inserted(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([cache, t, &inserted]() {
+      uint32_t x = 1 + t;
+      for (int i = 0; i < kOps; i++) {
+        x = x * 1103515245 + 12345;
+        const int k = (x >> 8) % kKeys;
+        Cache::Handle* h = cache->Lookup(EncodeKey(k));
+        if (h == nullptr) {
+          h = cache->Insert(EncodeKey(k), EncodeValue(k), 1, &CountingDeleter);
+          inserted.fetch_add(1);
+        }
+        ASSERT_EQ(k, DecodeValue(cache->Value(h)));
+        if ((x >> 20) % 16 == 0) {
+          cache->Erase(EncodeKey(k));
+        }
+        cache->Release(h);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_LE(cache->TotalCharge(), 64);
+  delete cache;
+  ASSERT_EQ(inserted.load(), concurrent_deleted.load());
 }
 
 }  // namespace leveldb
 
-int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
+int main(int argc, char** argv) {
+  for (bool use_clock : {false, true}) {
+    fprintf(stderr, "==== Running against the %s cache\n",
+            use_clock ? "CLOCK" : "LRU");
+    leveldb::CacheTest::use_clock_ = use_clock;
+    int result = leveldb::test::RunAllTests();
+    if (result != 0) {
+      return result;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,450 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+
+#include "leveldb/cache.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+// CLOCK cache implementation
+//
+// Each shard is an open-addressed table with a fixed number of slots.  A
+// slot's "meta" word holds its state in the top two bits and the number of
+// references held by clients in the rest:
+// - Empty:         no entry.
+// - Construction:  owned by the one thread that is filling or freeing it.
+// - Visible:       holds an entry that Lookup() can find.
+// - Invisible:     holds an entry that was erased or replaced while clients
+//                  still referenced it; freed when the last one releases it.
+//
+// Lookup() takes a reference with a fetch_add on the meta word and backs it
+// out if the slot turns out not to be Visible, so lookups and releases never
+// lock.  A slot only changes hands through a compare-and-swap from exactly
+// "Visible (or Invisible) with no references" to Construction, so an entry
+// is never freed while a reference to it, even a speculative one, exists.
+// All other state changes are fetch_adds, which keep speculative references
+// intact.
+//
+// Entries are placed by double hashing.  Every slot counts the entries that
+// probed past it ("displacements"), so that a lookup can stop at the first
+// slot with no displacements instead of scanning the whole table.
+//
+// Insert() and Erase() lock the shard.  Insert() evicts with the CLOCK
+// (second chance) policy: a hand sweeps the slots, clearing the "referenced"
+// bit that Lookup() sets, and frees unreferenced entries whose bit was
+// already clear.
+
+struct ClockSlot;
+
+// An entry is a variable length heap-allocated structure.
+struct ClockHandle {
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  ClockSlot* slot;  // nullptr if the entry was never in the cache
+  size_t charge;
+  size_t key_length;
+  uint32_t hash;     // Hash of key(); used for fast sharding and comparisons
+  char key_data[1];  // Beginning of key
+
+  Slice key() const { return Slice(key_data, key_length); }
+};
+
+struct ClockSlot {
+  std::atomic<uint32_t> meta;
+  std::atomic<uint32_t> displacements;
+  std::atomic<bool> referenced;  // Used since the clock hand last passed
+  // Written only in the Construction state.
+  ClockHandle* handle;
+};
+
+static const int kStateShift = 30;
+static const uint32_t kRefsMask = (1u << kStateShift) - 1;
+static const uint32_t kStateEmpty = 0;
+static const uint32_t kStateConstruction = 1u << kStateShift;
+static const uint32_t kStateVisible = 2u << kStateShift;
+static const uint32_t kStateInvisible = 3u << kStateShift;
+
+static inline uint32_t State(uint32_t meta) { return meta & ~kRefsMask; }
+
+// A single shard of sharded cache.
+class ClockCacheShard {
+ public:
+  ClockCacheShard();
+  ~ClockCacheShard();
+
+  // Separate from constructor so caller can easily make an array of
+  // ClockCacheShard.
+  void Init(size_t capacity, size_t estimated_entry_charge);
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                        size_t charge,
+                        void (*deleter)(const Slice& key, void* value));
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
+  void Prune();
+  size_t TotalCharge() const {
+    return usage_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  uint32_t ProbeStart(uint32_t hash) const { return hash & mask_; }
+  static uint32_t ProbeStep(uint32_t hash) { return (hash >> 15) | 1; }
+
+  // Returns the slot of a Visible entry for key with a reference taken, or
+  // nullptr.
+  ClockSlot* FindAndRef(const Slice& key, uint32_t hash);
+
+  // Drops a reference to *slot, freeing an Invisible entry that has no
+  // references left.
+  void Unref(ClockSlot* slot);
+
+  // Frees the entry of *slot and makes the slot Empty.
+  // REQUIRES: *slot is in the Construction state, owned by the caller.
+  void FreeSlot(ClockSlot* slot);
+
+  // Advances the clock hand by one slot, evicting the entry there if it is
+  // unreferenced and was not used since the hand last passed.
+  void ClockStep() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Initialized before use.
+  size_t capacity_;
+  uint32_t mask_;
+  uint32_t max_occupancy_;
+  ClockSlot* slots_;
+
+  std::atomic<size_t> usage_;
+  std::atomic<uint32_t> occupancy_;
+
+  // mutex_ serializes Insert(), Erase() and Prune(); lookups and releases
+  // do not take it.
+  port::Mutex mutex_;
+  uint32_t clock_hand_ GUARDED_BY(mutex_);
+};
+
+ClockCacheShard::ClockCacheShard()
+    : capacity_(0),
+      mask_(0),
+      max_occupancy_(0),
+      slots_(nullptr),
+      usage_(0),
+      occupancy_(0),
+      clock_hand_(0) {}
+
+ClockCacheShard::~ClockCacheShard() {
+  for (uint32_t i = 0; slots_ != nullptr && i <= mask_; i++) {
+    ClockSlot* slot = &slots_[i];
+    uint32_t meta = slot->meta.load(std::memory_order_acquire);
+    // Error if caller has an unreleased handle
+    assert(meta == kStateEmpty || meta == kStateVisible);
+    if (meta == kStateVisible) {
+      slot->meta.store(kStateConstruction, std::memory_order_relaxed);
+      FreeSlot(slot);
+    }
+  }
+  delete[] slots_;
+}
+
+void ClockCacheShard::Init(size_t capacity, size_t estimated_entry_charge) {
+  capacity_ = capacity;
+  // Keep the table at most 3/4 full when the cache holds the entries of the
+  // estimated size.
+  size_t entries = capacity / estimated_entry_charge + 1;
+  uint32_t length = 4;
+  while (length < entries + entries / 3 && length < (1u << 30)) {
+    length *= 2;
+  }
+  mask_ = length - 1;
+  max_occupancy_ = length - length / 4;
+  slots_ = new ClockSlot[length];
+  for (uint32_t i = 0; i < length; i++) {
+    slots_[i].meta.store(kStateEmpty, std::memory_order_relaxed);
+    slots_[i].displacements.store(0, std::memory_order_relaxed);
+    slots_[i].referenced.store(false, std::memory_order_relaxed);
+    slots_[i].handle = nullptr;
+  }
+}
+
+ClockSlot* ClockCacheShard::FindAndRef(const Slice& key, uint32_t hash) {
+  uint32_t index = ProbeStart(hash);
+  const uint32_t step = ProbeStep(hash);
+  for (uint32_t probes = 0; probes <= mask_; probes++) {
+    ClockSlot* slot = &slots_[index];
+    if (State(slot->meta.load(std::memory_order_relaxed)) == kStateVisible) {
+      uint32_t meta = slot->meta.fetch_add(1, std::memory_order_acquire);
+      if (State(meta) == kStateVisible) {
+        const ClockHandle* e = slot->handle;
+        if (e->hash == hash && key == e->key()) {
+          return slot;
+        }
+      }
+      Unref(slot);
+    }
+    if (slot->displacements.load(std::memory_order_relaxed) == 0) {
+      break;
+    }
+    index = (index + step) & mask_;
+  }
+  return nullptr;
+}
+
+void ClockCacheShard::Unref(ClockSlot* slot) {
+  uint32_t meta = slot->meta.fetch_sub(1, std::memory_order_acq_rel) - 1;
+  if (meta == kStateInvisible &&
+      slot->meta.compare_exchange_strong(meta, kStateConstruction,
+                                         std::memory_order_acquire)) {
+    FreeSlot(slot);
+  }
+}
+
+void ClockCacheShard::FreeSlot(ClockSlot* slot) {
+  ClockHandle* e = slot->handle;
+  // Undo the displacements of the slots that e's insertion probed past.
+  uint32_t index = ProbeStart(e->hash);
+  const uint32_t step = ProbeStep(e->hash);
+  while (&slots_[index] != slot) {
+    slots_[index].displacements.fetch_sub(1, std::memory_order_relaxed);
+    index = (index + step) & mask_;
+  }
+  usage_.fetch_sub(e->charge, std::memory_order_relaxed);
+  occupancy_.fetch_sub(1, std::memory_order_relaxed);
+  slot->handle = nullptr;
+  // Keep any speculative references that lookups are about to back out.
+  slot->meta.fetch_sub(kStateConstruction, std::memory_order_release);
+
+  (*e->deleter)(e->key(), e->value);
+  free(e);
+}
+
+void ClockCacheShard::ClockStep() {
+  ClockSlot* slot = &slots_[clock_hand_];
+  clock_hand_ = (clock_hand_ + 1) & mask_;
+  uint32_t meta = slot->meta.load(std::memory_order_relaxed);
+  if (meta != kStateVisible) {
+    // Empty, in use by clients, or already on its way out.
+    return;
+  }
+  if (slot->referenced.load(std::memory_order_relaxed)) {
+    slot->referenced.store(false, std::memory_order_relaxed);
+    return;
+  }
+  if (slot->meta.compare_exchange_strong(meta, kStateConstruction,
+                                         std::memory_order_acquire)) {
+    FreeSlot(slot);
+  }
+}
+
+Cache::Handle* ClockCacheShard::Lookup(const Slice& key, uint32_t hash) {
+  ClockSlot* slot = FindAndRef(key, hash);
+  if (slot == nullptr) {
+    return nullptr;
+  }
+  // Only write the bit when it changes, to keep hot entries' cache lines
+  // shared between the reading cores.
+  if (!slot->referenced.load(std::memory_order_relaxed)) {
+    slot->referenced.store(true, std::memory_order_relaxed);
+  }
+  return reinterpret_cast<Cache::Handle*>(slot->handle);
+}
+
+void ClockCacheShard::Release(Cache::Handle* handle) {
+  ClockHandle* e = reinterpret_cast<ClockHandle*>(handle);
+  if (e->slot == nullptr) {
+    // Never made it into the cache; the caller held the only reference.
+    (*e->deleter)(e->key(), e->value);
+    free(e);
+  } else {
+    Unref(e->slot);
+  }
+}
+
+Cache::Handle* ClockCacheShard::Insert(const Slice& key, uint32_t hash,
+                                       void* value, size_t charge,
+                                       void (*deleter)(const Slice& key,
+                                                       void* value)) {
+  MutexLock l(&mutex_);
+
+  ClockHandle* e = reinterpret_cast<ClockHandle*>(
+      malloc(sizeof(ClockHandle) - 1 + key.size()));
+  e->value = value;
+  e->deleter = deleter;
+  e->slot = nullptr;
+  e->charge = charge;
+  e->key_length = key.size();
+  e->hash = hash;
+  memcpy(e->key_data, key.data(), key.size());
+
+  if (capacity_ == 0) {
+    // don't cache. (capacity_==0 is supported and turns off caching.)
+    return reinterpret_cast<Cache::Handle*>(e);
+  }
+
+  ClockSlot* old = FindAndRef(key, hash);
+  if (old != nullptr) {
+    // Replace the old entry: hide it and drop the reference just taken.
+    uint32_t meta = old->meta.load(std::memory_order_relaxed);
+    while (State(meta) == kStateVisible &&
+           !old->meta.compare_exchange_weak(
+               meta, meta + (kStateInvisible - kStateVisible),
+               std::memory_order_relaxed)) {
+    }
+    Unref(old);
+  }
+
+  // Make room, giving up after two full sweeps if everything is in use.
+  for (uint32_t sweeps = 0; sweeps < 2 * (mask_ + 1); sweeps++) {
+    if (usage_.load(std::memory_order_relaxed) + charge <= capacity_ &&
+        occupancy_.load(std::memory_order_relaxed) < max_occupancy_) {
+      break;
+    }
+    ClockStep();
+  }
+
+  // Claim the first empty slot along the probe sequence.
+  uint32_t index = ProbeStart(hash);
+  const uint32_t step = ProbeStep(hash);
+  for (uint32_t probes = 0; probes <= mask_; probes++) {
+    ClockSlot* slot = &slots_[index];
+    uint32_t meta = slot->meta.load(std::memory_order_relaxed);
+    if (State(meta) == kStateEmpty &&
+        slot->meta.compare_exchange_strong(meta, meta + kStateConstruction,
+                                           std::memory_order_acquire)) {
+      e->slot = slot;
+      slot->handle = e;
+      slot->referenced.store(false, std::memory_order_relaxed);
+      usage_.fetch_add(charge, std::memory_order_relaxed);
+      occupancy_.fetch_add(1, std::memory_order_relaxed);
+      // Publish the entry, with a reference for the returned handle.
+      slot->meta.fetch_add(kStateVisible - kStateConstruction + 1,
+                           std::memory_order_release);
+      return reinterpret_cast<Cache::Handle*>(e);
+    }
+    slot->displacements.fetch_add(1, std::memory_order_relaxed);
+    index = (index + step) & mask_;
+  }
+
+  // Every slot is taken by entries in use: undo the displacements and hand
+  // out an entry that is not in the cache.
+  index = ProbeStart(hash);
+  for (uint32_t probes = 0; probes <= mask_; probes++) {
+    slots_[index].displacements.fetch_sub(1, std::memory_order_relaxed);
+    index = (index + step) & mask_;
+  }
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+void ClockCacheShard::Erase(const Slice& key, uint32_t hash) {
+  MutexLock l(&mutex_);
+  ClockSlot* slot = FindAndRef(key, hash);
+  if (slot != nullptr) {
+    uint32_t meta = slot->meta.load(std::memory_order_relaxed);
+    while (State(meta) == kStateVisible &&
+           !slot->meta.compare_exchange_weak(
+               meta, meta + (kStateInvisible - kStateVisible),
+               std::memory_order_relaxed)) {
+    }
+    Unref(slot);
+  }
+}
+
+void ClockCacheShard::Prune() {
+  MutexLock l(&mutex_);
+  for (uint32_t i = 0; i <= mask_; i++) {
+    ClockSlot* slot = &slots_[i];
+    uint32_t meta = kStateVisible;
+    if (slot->meta.compare_exchange_strong(meta, kStateConstruction,
+                                           std::memory_order_acquire)) {
+      FreeSlot(slot);
+    }
+  }
+}
+
+class ShardedClockCache : public Cache {
+ private:
+  ClockCacheShard* shards_;
+  const int shard_bits_;
+  port::Mutex id_mutex_;
+  uint64_t last_id_;
+
+  static inline uint32_t HashSlice(const Slice& s) {
+    return Hash(s.data(), s.size(), 0);
+  }
+
+  uint32_t Shard(uint32_t hash) const {
+    return shard_bits_ == 0 ? 0 : hash >> (32 - shard_bits_);
+  }
+
+ public:
+  ShardedClockCache(size_t capacity, int shard_bits,
+                    size_t estimated_entry_charge)
+      : shard_bits_(shard_bits), last_id_(0) {
+    const int num_shards = 1 << shard_bits_;
+    const size_t per_shard = (capacity + (num_shards - 1)) / num_shards;
+    shards_ = new ClockCacheShard[num_shards];
+    for (int s = 0; s < num_shards; s++) {
+      shards_[s].Init(per_shard, estimated_entry_charge);
+    }
+  }
+  virtual ~ShardedClockCache() { delete[] shards_; }
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value)) {
+    const uint32_t hash = HashSlice(key);
+    return shards_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+  }
+  virtual Handle* Lookup(const Slice& key) {
+    const uint32_t hash = HashSlice(key);
+    return shards_[Shard(hash)].Lookup(key, hash);
+  }
+  virtual void Release(Handle* handle) {
+    ClockHandle* h = reinterpret_cast<ClockHandle*>(handle);
+    shards_[Shard(h->hash)].Release(handle);
+  }
+  virtual void Erase(const Slice& key) {
+    const uint32_t hash = HashSlice(key);
+    shards_[Shard(hash)].Erase(key, hash);
+  }
+  virtual void* Value(Handle* handle) {
+    return reinterpret_cast<ClockHandle*>(handle)->value;
+  }
+  virtual uint64_t NewId() {
+    MutexLock l(&id_mutex_);
+    return ++(last_id_);
+  }
+  virtual void Prune() {
+    for (int s = 0; s < (1 << shard_bits_); s++) {
+      shards_[s].Prune();
+    }
+  }
+  virtual size_t TotalCharge() const {
+    size_t total = 0;
+    for (int s = 0; s < (1 << shard_bits_); s++) {
+      total += shards_[s].TotalCharge();
+    }
+    return total;
+  }
+};
+
+}  // end anonymous namespace
+
+Cache* NewClockCache(size_t capacity, int shard_bits,
+                     size_t estimated_entry_charge) {
+  if (shard_bits < 0) shard_bits = 0;
+  if (shard_bits > 16) shard_bits = 16;
+  if (estimated_entry_charge == 0) estimated_entry_charge = 1;
+  return new ShardedClockCache(capacity, shard_bits, estimated_entry_charge);
+}
+
+}  // namespace leveldb
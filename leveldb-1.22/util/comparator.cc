@@ -49,6 +49,11 @@ class BytewiseComparatorImpl : public Comparator {
     }
   }
 
+  virtual bool BytewiseOrderedPart(const Slice& key, Slice* part) const {
+    *part = key;
+    return true;
+  }
+
   virtual void FindShortSuccessor(std::string* key) const {
     // Find first character that can be incremented
     size_t n = key->size();
@@ -3,6 +3,10 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "util/crc32c.h"
+
+#include <string>
+
+#include "util/random.h"
 #include "util/testharness.h"
 
 namespace leveldb {
@@ -45,6 +49,40 @@ TEST(CRC, Extend) {
   ASSERT_EQ(Value("hello world", 11), Extend(Value("hello ", 6), "world", 5));
 }
 
+// One bit at a time, for comparison with the table-driven and hardware
+// implementations.
+static uint32_t BitwiseValue(const char* data, size_t n) {
+  uint32_t crc = 0xffffffffu;
+  for (size_t i = 0; i < n; i++) {
+    crc ^= static_cast<uint8_t>(data[i]);
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ ((crc & 1) ? 0x82f63b78u : 0);
+    }
+  }
+  return crc ^ 0xffffffffu;
+}
+
+TEST(CRC, LongAndUnaligned) {
+  // Covers both chunk sizes of the three-stream hardware kernel and the
+  // tails around them, at every alignment.
+  Random rnd(301);
+  std::string data(40000, '\0');
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<char>(rnd.Uniform(256));
+  }
+  const size_t kSizes[] = {0,    1,    7,    8,    9,     767,   768,
+                           769,  1000, 4096, 12287, 12288, 12289, 13063,
+                           25000, 39992};
+  for (size_t size : kSizes) {
+    for (size_t offset = 0; offset < 8; offset++) {
+      ASSERT_EQ(BitwiseValue(data.data() + offset, size),
+                Value(data.data() + offset, size));
+    }
+  }
+  ASSERT_EQ(BitwiseValue(data.data(), 30000),
+            Extend(Value(data.data(), 12289), data.data() + 12289, 17711));
+}
+
 TEST(CRC, Mask) {
   uint32_t crc = Value("foo", 3);
   ASSERT_NE(crc, Mask(crc));
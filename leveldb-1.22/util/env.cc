@@ -16,6 +16,18 @@ SequentialFile::~SequentialFile() {}
 
 RandomAccessFile::~RandomAccessFile() {}
 
+Status RandomAccessFile::MultiRead(ReadRequest* reqs, size_t num) const {
+  Status s;
+  for (size_t i = 0; i < num; i++) {
+    ReadRequest& req = reqs[i];
+    req.status = Read(req.offset, req.n, &req.result, req.scratch);
+    if (s.ok()) {
+      s = req.status;
+    }
+  }
+  return s;
+}
+
 WritableFile::~WritableFile() {}
 
 Logger::~Logger() {}
@@ -13,6 +13,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
 #include <cstddef>
@@ -20,21 +21,27 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <functional>
 #include <limits>
+#include <list>
 #include <queue>
 #include <set>
+#include <stdexcept>
 #include <string>
 #include <thread>
 #include <type_traits>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "leveldb/env.h"
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
+#include "util/env_posix_limits.h"
 #include "util/env_posix_test_helper.h"
+#include "util/mutexlock.h"
 #include "util/posix_logger.h"
 
 int g_appid = 0;
@@ -149,7 +156,7 @@ namespace leveldb {
 
 namespace {
 
-// Set by EnvPosixTestHelper::SetReadOnlyMMapLimit() and MaxOpenFiles().
+// Overrides MaxOpenFiles() if set by EnvPosixTestHelper::SetReadOnlyFDLimit().
 int g_open_read_only_file_limit = -1;
 
 #ifdef JL_LIBCFS
@@ -164,8 +171,20 @@ constexpr const int kDefaultMmapLimit = 0;
 // Can be set using EnvPosixTestHelper::SetReadOnlyMMapLimit.
 int g_mmap_limit = kDefaultMmapLimit;
 
+#ifndef JL_LIBCFS
+// O_DIRECT reads must be aligned, in offset, length and memory, to the
+// logical block size of the device; 4 KiB covers the common ones.
+constexpr const size_t kDirectIOAlignment = 4096;
+#endif
+
 constexpr const size_t kWritableFileBufferSize = 65536;
 
+// Upper bound on the number of live threads that may append to writable files
+// at the same time. Each of them owns one slot in every file it appends to.
+constexpr const int kMaxWriterThreads = 64;
+
+constexpr const size_t kCacheLineSize = 64;
+
 Status PosixError(const std::string& context, int error_number) {
   if (error_number == ENOENT) {
     return Status::NotFound(context, std::strerror(error_number));
@@ -174,42 +193,313 @@ Status PosixError(const std::string& context, int error_number) {
   }
 }
 
-// Helper class to limit resource usage to avoid exhaustion.
-// Currently used to limit read-only file descriptors and mmap file usage
-// so that we do not run out of file descriptors or virtual memory, or run into
-// kernel performance problems for very large databases.
-class Limiter {
+// Returns a small ordinal in [0, kMaxWriterThreads) that identifies the
+// calling thread among the live threads of this process, or -1 if that many
+// other live threads hold one already.
+//
+// Ordinals are handed back when their thread exits, so a long-running process
+// that keeps creating threads does not run out of them.
+class ThreadOrdinal {
  public:
-  // Limit maximum number of resources to |max_acquires|.
-  Limiter(int max_acquires) : acquires_allowed_(max_acquires) {}
+  static int Current() {
+    thread_local ThreadOrdinal ordinal;
+    if (ordinal.value_ < 0) {
+      ordinal.value_ = Acquire();
+    }
+    return ordinal.value_;
+  }
+
+ private:
+  ThreadOrdinal() : value_(Acquire()) {}
+  ~ThreadOrdinal();
+
+  static int Acquire() {
+    static_assert(kMaxWriterThreads <= 64, "in_use_ holds one bit per slot");
+    uint64_t used = in_use_.load(std::memory_order_relaxed);
+    while (true) {
+      if (~used == 0 || __builtin_ctzll(~used) >= kMaxWriterThreads) {
+        return -1;
+      }
+      int ordinal = __builtin_ctzll(~used);
+      if (in_use_.compare_exchange_weak(used, used | (uint64_t{1} << ordinal),
+                                        std::memory_order_acquire,
+                                        std::memory_order_relaxed)) {
+        return ordinal;
+      }
+    }
+  }
+
+  static std::atomic<uint64_t> in_use_;
+  int value_;
+};
+
+std::atomic<uint64_t> ThreadOrdinal::in_use_{0};
 
-  Limiter(const Limiter&) = delete;
-  Limiter operator=(const Limiter&) = delete;
+char* AllocateWriteBuffer(size_t size) {
+#ifdef JL_LIBCFS
+  return static_cast<char*>(fs_malloc_pad(size));
+#else
+  return static_cast<char*>(malloc(size));
+#endif
+}
+
+// |fs_tid| is the threadFsTid of the thread that allocated |buf|.
+void FreeWriteBuffer(char* buf, int fs_tid) {
+#ifdef JL_LIBCFS
+  fs_free_pad(static_cast<void*>(buf), fs_tid);
+#else
+  (void)fs_tid;
+  free(static_cast<void*>(buf));
+#endif
+}
 
-  // If another resource is available, acquire it and return true.
-  // Else return false.
-  bool Acquire() {
-    int old_acquires_allowed =
-        acquires_allowed_.fetch_sub(1, std::memory_order_relaxed);
+int CurrentFsTid() {
+#ifdef JL_LIBCFS
+  return threadFsTid;
+#else
+  return 0;
+#endif
+}
 
-    if (old_acquires_allowed > 0) return true;
+// Per-thread staging buffers of a writable file.
+//
+// uFS requires the source of fs_allocated_write() to be allocated from the
+// calling thread's shared memory, so every thread appending to a file stages
+// its data in its own buffer. Slots are indexed by ThreadOrdinal and each one
+// sits on its own cache line, so concurrent appenders neither hash nor share.
+//
+// When a thread exits, the data left in its slots is written out and its
+// buffers are freed, so that the next thread given its ordinal starts with
+// empty slots. Threads without an ordinal get no slot and must write their
+// appends out directly.
+class WriteBufferSlots {
+ public:
+  struct alignas(kCacheLineSize) Slot {
+    char* buf = nullptr;  // Allocated on the first Append() of the thread.
+    size_t pos = 0;       // buf[0, pos - 1] contains data to be written.
+    int fs_tid = 0;       // CurrentFsTid() of the thread that allocated buf.
+  };
 
-    acquires_allowed_.fetch_add(1, std::memory_order_relaxed);
-    return false;
+  // |write| writes data out to the file, unbuffered. Exiting threads call it
+  // from their own thread to flush their slots.
+  explicit WriteBufferSlots(std::function<Status(const char*, size_t)> write)
+      : write_(std::move(write)), has_exit_error_(false), exit_flushes_(0) {}
+  ~WriteBufferSlots() { ReleaseAll(); }
+
+  WriteBufferSlots(const WriteBufferSlots&) = delete;
+  WriteBufferSlots& operator=(const WriteBufferSlots&) = delete;
+
+  // Returns the calling thread's slot, or nullptr if the thread has no
+  // ordinal. The slot's buffer may still be nullptr.
+  Slot* Current() {
+    const int ordinal = ThreadOrdinal::Current();
+    return ordinal < 0 ? nullptr : &slots_[ordinal];
+  }
+
+  // Returns the calling thread's slot, allocating its buffer if needed.
+  // Returns nullptr if the thread has no ordinal or the allocation fails.
+  Slot* CurrentWithBuffer() {
+    const int ordinal = ThreadOrdinal::Current();
+    if (ordinal < 0) {
+      return nullptr;
+    }
+    Slot* slot = &slots_[ordinal];
+    if (slot->buf == nullptr) {
+      char* buf = AllocateWriteBuffer(kWritableFileBufferSize);
+      if (buf == nullptr) {
+        return nullptr;
+      }
+      Registry* registry = GetRegistry();
+      MutexLock l(&registry->mu);
+      slot->buf = buf;
+      slot->fs_tid = CurrentFsTid();
+      registry->users[ordinal].push_back(this);
+    }
+    return slot;
   }
 
-  // Release a resource acquired by a previous call to Acquire() that returned
-  // true.
-  void Release() { acquires_allowed_.fetch_add(1, std::memory_order_relaxed); }
+  // Returns the first error hit while flushing the slot of an exited thread,
+  // and forgets it.
+  Status TakeExitError() {
+    if (!has_exit_error_.load(std::memory_order_acquire)) {
+      return Status::OK();
+    }
+    MutexLock l(&GetRegistry()->mu);
+    Status status = exit_error_;
+    exit_error_ = Status::OK();
+    has_exit_error_.store(false, std::memory_order_relaxed);
+    return status;
+  }
 
- private:
-  // The number of available resources.
+  // Appends |data| for a thread that has no slot. Such a thread has nothing
+  // buffered, so its data is written out right away. |filename| is only used
+  // in the returned Status.
+  Status AppendWithoutSlot(const std::string& filename, const char* data,
+                           size_t size) {
+#ifdef JL_LIBCFS
+    // The data still has to be staged through the thread's shared memory.
+    Slot staging;
+    staging.buf = AllocateWriteBuffer(kWritableFileBufferSize);
+    if (staging.buf == nullptr) {
+      return Status::IOError(filename, "cannot allocate write buffer");
+    }
+    Status status = WriteStaged(&staging, data, size);
+    if (status.ok() && staging.pos > 0) {
+      status = write_(staging.buf, staging.pos);
+    }
+    FreeWriteBuffer(staging.buf, CurrentFsTid());
+    return status;
+#else
+    (void)filename;
+    return write_(data, size);
+#endif
+  }
+
+  // Writes |data| out through |slot|'s buffer, one buffer-sized chunk at a
+  // time. uFS only accepts write sources that live in the calling thread's
+  // shared memory, so large appends cannot be handed over in place; staging
+  // them chunk by chunk avoids allocating a scratch copy of the whole payload.
+  // The tail that does not fill a chunk is left buffered.
   //
-  // This is a counter and is not tied to the invariants of any other class, so
-  // it can be operated on safely using std::memory_order_relaxed.
-  std::atomic<int> acquires_allowed_;
+  // REQUIRES: |slot| belongs to the calling thread and is empty.
+  Status WriteStaged(Slot* slot, const char* data, size_t size) {
+    assert(slot->pos == 0);
+    while (size >= kWritableFileBufferSize) {
+      std::memcpy(slot->buf, data, kWritableFileBufferSize);
+      Status status = write_(slot->buf, kWritableFileBufferSize);
+      if (!status.ok()) {
+        return status;
+      }
+      data += kWritableFileBufferSize;
+      size -= kWritableFileBufferSize;
+    }
+    std::memcpy(slot->buf, data, size);
+    slot->pos = size;
+    return Status::OK();
+  }
+
+  // Frees all the buffers, dropping what is left in them. Waits for exiting
+  // threads that are still writing out their slots; after this, exiting
+  // threads no longer call |write|.
+  //
+  // REQUIRES: No thread is appending.
+  void ReleaseAll() {
+    Registry* registry = GetRegistry();
+    MutexLock l(&registry->mu);
+    while (exit_flushes_ > 0) {
+      registry->cv.Wait();
+    }
+    for (int i = 0; i < kMaxWriterThreads; i++) {
+      Slot& slot = slots_[i];
+      if (slot.buf == nullptr) {
+        continue;
+      }
+      std::vector<WriteBufferSlots*>& users = registry->users[i];
+      users.erase(std::find(users.begin(), users.end(), this));
+      FreeWriteBuffer(slot.buf, slot.fs_tid);
+      slot.buf = nullptr;
+      slot.pos = 0;
+    }
+  }
+
+  // Writes out and frees the calling thread's slots in every file. Called
+  // when the thread with |ordinal| exits.
+  //
+  // The slots are only taken out under the registry mutex; the writes, which
+  // under uFS are round trips to the server, happen after it is released.
+  // Until they are done, ReleaseAll() on their files waits.
+  static void ReleaseThread(int ordinal) {
+    struct Pending {
+      WriteBufferSlots* slots;
+      char* buf;
+      size_t pos;
+      int fs_tid;
+    };
+    std::vector<Pending> pending;
+    Registry* registry = GetRegistry();
+    registry->mu.Lock();
+    for (WriteBufferSlots* slots : registry->users[ordinal]) {
+      Slot& slot = slots->slots_[ordinal];
+      pending.push_back(Pending{slots, slot.buf, slot.pos, slot.fs_tid});
+      slots->exit_flushes_++;
+      slot.buf = nullptr;
+      slot.pos = 0;
+    }
+    registry->users[ordinal].clear();
+    registry->mu.Unlock();
+
+    std::vector<Status> statuses(pending.size());
+    for (size_t i = 0; i < pending.size(); i++) {
+      const Pending& p = pending[i];
+      if (p.pos > 0) {
+        statuses[i] = p.slots->write_(p.buf, p.pos);
+      }
+      FreeWriteBuffer(p.buf, p.fs_tid);
+    }
+
+    MutexLock l(&registry->mu);
+    for (size_t i = 0; i < pending.size(); i++) {
+      WriteBufferSlots* slots = pending[i].slots;
+      if (!statuses[i].ok() && slots->exit_error_.ok()) {
+        slots->exit_error_ = statuses[i];
+        slots->has_exit_error_.store(true, std::memory_order_release);
+      }
+      slots->exit_flushes_--;
+    }
+    if (!pending.empty()) {
+      registry->cv.SignalAll();
+    }
+  }
+
+ private:
+  // The files in which each ordinal has a buffer. Never deleted, since
+  // threads may exit during static destruction.
+  struct Registry {
+    Registry() : cv(&mu) {}
+
+    port::Mutex mu;
+    port::CondVar cv;  // Signalled when exit_flushes_ of a file drops.
+    std::vector<WriteBufferSlots*> users[kMaxWriterThreads] GUARDED_BY(mu);
+  };
+
+  static Registry* GetRegistry() {
+    static Registry* registry = new Registry;
+    return registry;
+  }
+
+  const std::function<Status(const char*, size_t)> write_;
+  std::atomic<bool> has_exit_error_;
+  Status exit_error_;  // Guarded by GetRegistry()->mu.
+  // Number of exiting threads writing out a slot taken from this file.
+  // Guarded by GetRegistry()->mu.
+  int exit_flushes_;
+  Slot slots_[kMaxWriterThreads];
 };
 
+ThreadOrdinal::~ThreadOrdinal() {
+  if (value_ >= 0) {
+    WriteBufferSlots::ReleaseThread(value_);
+    in_use_.fetch_and(~(uint64_t{1} << value_), std::memory_order_release);
+  }
+}
+
+int OpenReadOnly(const std::string& filename, bool direct) {
+#ifdef JL_LIBCFS
+  (void)direct;  // uFS never goes through the kernel's page cache.
+  return fs_open2(filename.c_str(), O_RDONLY);
+#else
+  return ::open(filename.c_str(), direct ? O_RDONLY | O_DIRECT : O_RDONLY);
+#endif
+}
+
+void CloseReadOnly(int fd) {
+#ifdef JL_LIBCFS
+  fs_close(fd);
+#else
+  ::close(fd);
+#endif
+}
+
 // Implements sequential read access in a file using read().
 //
 // Instances of this class are thread-friendly but not thread-safe, as required
@@ -265,20 +555,27 @@ class PosixSequentialFile final : public SequentialFile {
 // functions.
 class PosixRandomAccessFile final : public RandomAccessFile {
  public:
-  // The new instance takes ownership of |fd|. |fd_limiter| must outlive this
-  // instance, and will be used to determine if .
-  PosixRandomAccessFile(std::string filename, int fd, Limiter* fd_limiter)
+  // The new instance takes ownership of |fd|. |fd_limiter| and |fd_cache| must
+  // outlive this instance. |fd_limiter| is used to determine if the instance
+  // keeps |fd| open; otherwise reads borrow a descriptor from |fd_cache|.
+  // |direct| tells that |fd|, and the descriptors of |fd_cache|, were opened
+  // with O_DIRECT.
+  PosixRandomAccessFile(std::string filename, int fd, Limiter* fd_limiter,
+                        ReadOnlyFdCache* fd_cache, bool direct)
       : has_permanent_fd_(fd_limiter->Acquire()),
+        direct_(direct),
         fd_(has_permanent_fd_ ? fd : -1),
         fd_limiter_(fd_limiter),
+        fd_cache_(fd_cache),
         filename_(std::move(filename)) {
     if (!has_permanent_fd_) {
       assert(fd_ == -1);
 #ifdef JL_LIBCFS
-      fs_close(fd);  // The file will be opened on every read.
+      fs_close(fd);  // The file will be opened through fd_cache_.
 #else
-      ::close(fd);  // The file will be opened on every read.
+      ::close(fd);  // The file will be opened through fd_cache_.
 #endif
+      fd_cache_->Register(filename_);
     }
   }
 
@@ -291,6 +588,21 @@ class PosixRandomAccessFile final : public RandomAccessFile {
       ::close(fd_);
 #endif
       fd_limiter_->Release();
+    } else {
+      fd_cache_->Unregister(filename_);
+    }
+  }
+
+  // Files with a permanent descriptor have nothing to pin.
+  void Pin() override {
+    if (!has_permanent_fd_) {
+      fd_cache_->Pin(filename_);
+    }
+  }
+
+  void Unpin() override {
+    if (!has_permanent_fd_) {
+      fd_cache_->Unpin(filename_);
     }
   }
 
@@ -298,11 +610,7 @@ class PosixRandomAccessFile final : public RandomAccessFile {
               char* scratch) const override {
     int fd = fd_;
     if (!has_permanent_fd_) {
-#ifdef JL_LIBCFS
-      fd = fs_open2(filename_.c_str(), O_RDONLY);
-#else
-      fd = ::open(filename_.c_str(), O_RDONLY);
-#endif
+      fd = fd_cache_->Acquire(filename_);
       if (fd < 0) {
         return PosixError(filename_, errno);
       }
@@ -328,7 +636,9 @@ class PosixRandomAccessFile final : public RandomAccessFile {
     // fprintf(stdout, "fs_pread(fd:%d n=%ld offset:%lu) ret:%ld\n", fd, n,
     // offset, read_size);
 #else
-    ssize_t read_size = ::pread(fd, scratch, n, static_cast<off_t>(offset));
+    ssize_t read_size =
+        direct_ ? DirectPread(fd, scratch, n, offset)
+                : ::pread(fd, scratch, n, static_cast<off_t>(offset));
     // dump_pread_result(scratch, filename_.c_str(),fd, offset, n, read_size);
 #endif
     *result = Slice(scratch, (read_size < 0) ? 0 : read_size);
@@ -342,13 +652,9 @@ class PosixRandomAccessFile final : public RandomAccessFile {
       status = PosixError(filename_, errno);
     }
     if (!has_permanent_fd_) {
-      // Close the temporary file descriptor opened earlier.
+      // Hand the borrowed descriptor back to the cache.
       assert(fd != fd_);
-#ifdef JL_LIBCFS
-      fs_close(fd);
-#else
-      ::close(fd);
-#endif
+      fd_cache_->Release(filename_);
     }
     if (!status.ok()) {
       fprintf(stderr, "env_posix.cc: Read() return error\n");
@@ -357,9 +663,58 @@ class PosixRandomAccessFile final : public RandomAccessFile {
   }
 
  private:
-  const bool has_permanent_fd_;  // If false, the file is opened on every read.
+#ifndef JL_LIBCFS
+  // Behaves like pread() on a descriptor opened with O_DIRECT, for any
+  // |offset| and |n|: the aligned range around them is read into a
+  // thread-local aligned buffer, and the requested bytes copied to |scratch|.
+  static ssize_t DirectPread(int fd, char* scratch, size_t n,
+                             uint64_t offset) {
+    struct AlignedBuffer {
+      ~AlignedBuffer() { std::free(data); }
+
+      char* data = nullptr;
+      size_t size = 0;
+    };
+    thread_local AlignedBuffer buffer;
+
+    constexpr uint64_t kMask = kDirectIOAlignment - 1;
+    const uint64_t begin = offset & ~kMask;
+    const size_t size =
+        static_cast<size_t>(((offset + n + kMask) & ~kMask) - begin);
+    if (buffer.size < size) {
+      std::free(buffer.data);
+      buffer.data = nullptr;
+      buffer.size = 0;
+      void* mem = nullptr;
+      if (posix_memalign(&mem, kDirectIOAlignment, size) != 0) {
+        errno = ENOMEM;
+        return -1;
+      }
+      buffer.data = static_cast<char*>(mem);
+      buffer.size = size;
+    }
+
+    ssize_t read_size =
+        ::pread(fd, buffer.data, size, static_cast<off_t>(begin));
+    if (read_size < 0) {
+      return read_size;
+    }
+    const size_t skip = static_cast<size_t>(offset - begin);
+    if (static_cast<size_t>(read_size) <= skip) {
+      return 0;  // |offset| is at or past the end of the file.
+    }
+    const size_t available =
+        std::min(n, static_cast<size_t>(read_size) - skip);
+    std::memcpy(scratch, buffer.data + skip, available);
+    return static_cast<ssize_t>(available);
+  }
+#endif
+
+  const bool has_permanent_fd_;  // If false, reads go through fd_cache_.
+  const bool direct_;            // If true, reads go through DirectPread().
   const int fd_;                 // -1 if has_permanent_fd_ is false.
   Limiter* const fd_limiter_;
+  ReadOnlyFdCache* const fd_cache_;
   const std::string filename_;
 };
 
@@ -409,20 +764,24 @@ class PosixMmapReadableFile final : public RandomAccessFile {
 
 class FSPRandomAccessFile final : public RandomAccessFile {
  public:
-  // The new instance takes ownership of |fd|. |fd_limiter| must outlive this
-  // instance, and will be used to determine if .
-  FSPRandomAccessFile(std::string filename, int fd, Limiter* fd_limiter)
+  // The new instance takes ownership of |fd|. |fd_limiter| and |fd_cache| must
+  // outlive this instance. |fd_limiter| is used to determine if the instance
+  // keeps |fd| open; otherwise reads borrow a descriptor from |fd_cache|.
+  FSPRandomAccessFile(std::string filename, int fd, Limiter* fd_limiter,
+                        ReadOnlyFdCache* fd_cache)
       : has_permanent_fd_(fd_limiter->Acquire()),
         fd_(has_permanent_fd_ ? fd : -1),
         fd_limiter_(fd_limiter),
+        fd_cache_(fd_cache),
         filename_(std::move(filename)) {
     if (!has_permanent_fd_) {
       assert(fd_ == -1);
 #ifdef JL_LIBCFS
-      fs_close(fd);  // The file will be opened on every read.
+      fs_close(fd);  // The file will be opened through fd_cache_.
 #else
-      ::close(fd);  // The file will be opened on every read.
+      ::close(fd);  // The file will be opened through fd_cache_.
 #endif
+      fd_cache_->Register(filename_);
     }
   }
 
@@ -435,23 +794,84 @@ class FSPRandomAccessFile final : public RandomAccessFile {
       ::close(fd_);
 #endif
       fd_limiter_->Release();
+    } else {
+      fd_cache_->Unregister(filename_);
+    }
+  }
+
+  // Files with a permanent descriptor have nothing to pin.
+  void Pin() override {
+    if (!has_permanent_fd_) {
+      fd_cache_->Pin(filename_);
+    }
+  }
+
+  void Unpin() override {
+    if (!has_permanent_fd_) {
+      fd_cache_->Unpin(filename_);
     }
   }
 
   Status Read(uint64_t offset, size_t n, Slice* result,
               char* scratch) const override {
-    int fd = fd_;
-    if (!has_permanent_fd_) {
-#ifdef JL_LIBCFS
-      fd = fs_open2(filename_.c_str(), O_RDONLY);
-#else
-      fd = ::open(filename_.c_str(), O_RDONLY);
-#endif
-      if (fd < 0) {
-        return PosixError(filename_, errno);
+    int fd = AcquireFd();
+    if (fd < 0) {
+      return PosixError(filename_, errno);
+    }
+    Status status = ReadAt(fd, offset, n, result, scratch);
+    ReleaseFd(fd);
+    if (!status.ok()) {
+      fprintf(stderr, "env_posix.cc: Read() return error\n");
+    }
+    return status;
+  }
+
+  // uFS has no vectored read, so the reads still go out one at a time, but
+  // they share one descriptor from fd_cache_ and are issued in offset order.
+  Status MultiRead(ReadRequest* reqs, size_t num) const override {
+    int fd = AcquireFd();
+    if (fd < 0) {
+      return PosixError(filename_, errno);
+    }
+    std::vector<ReadRequest*> order(num);
+    for (size_t i = 0; i < num; i++) {
+      order[i] = &reqs[i];
+    }
+    std::sort(order.begin(), order.end(),
+              [](const ReadRequest* a, const ReadRequest* b) {
+                return a->offset < b->offset;
+              });
+    Status status;
+    for (ReadRequest* req : order) {
+      req->status = ReadAt(fd, req->offset, req->n, &req->result, req->scratch);
+      if (status.ok()) {
+        status = req->status;
       }
     }
+    ReleaseFd(fd);
+    return status;
+  }
+
+ private:
+  // Returns the descriptor to read through, borrowing one from fd_cache_
+  // unless the file keeps its own, or -1 with errno set on failure.
+  int AcquireFd() const {
+    if (has_permanent_fd_) {
+      return fd_;
+    }
+    return fd_cache_->Acquire(filename_);
+  }
 
+  void ReleaseFd(int fd) const {
+    if (!has_permanent_fd_) {
+      // Hand the borrowed descriptor back to the cache.
+      assert(fd != fd_);
+      fd_cache_->Release(filename_);
+    }
+  }
+
+  Status ReadAt(int fd, uint64_t offset, size_t n, Slice* result,
+                char* scratch) const {
     assert(fd != -1);
 
     Status status;
@@ -482,25 +902,13 @@ class FSPRandomAccessFile final : public RandomAccessFile {
       throw std::runtime_error("pread error");
       status = PosixError(filename_, errno);
     }
-    if (!has_permanent_fd_) {
-      // Close the temporary file descriptor opened earlier.
-      assert(fd != fd_);
-#ifdef JL_LIBCFS
-      fs_close(fd);
-#else
-      ::close(fd);
-#endif
-    }
-    if (!status.ok()) {
-      fprintf(stderr, "env_posix.cc: Read() return error\n");
-    }
     return status;
   }
 
- private:
-  const bool has_permanent_fd_;  // If false, the file is opened on every read.
+  const bool has_permanent_fd_;  // If false, reads go through fd_cache_.
   const int fd_;                 // -1 if has_permanent_fd_ is false.
   Limiter* const fd_limiter_;
+  ReadOnlyFdCache* const fd_cache_;
   const std::string filename_;
 };
 
@@ -508,7 +916,10 @@ class FSPRandomAccessFile final : public RandomAccessFile {
 class PosixWritableFile final : public WritableFile {
  public:
   PosixWritableFile(std::string filename, int fd)
-      : fd_(fd),
+      : bufs_([this](const char* data, size_t size) {
+          return WriteUnbuffered(data, size);
+        }),
+        fd_(fd),
         is_manifest_(IsManifest(filename)),
         filename_(std::move(filename)),
         dirname_(Dirname(filename_)) {
@@ -530,31 +941,24 @@ class PosixWritableFile final : public WritableFile {
     // if (curTid != tid_) {
     //  fprintf(stderr, "start_tid:%lu end_tid:%lu\n", tid_, curTid);
     //}
-    auto tid = std::this_thread::get_id();
-    auto it = buf_map_.find(tid);
-    assert(it != buf_map_.end());
-#ifdef JL_LIBCFS
-    fs_free((void*)(it->second));
-#else
-    free((void*)(it->second));
-#endif
   }
 
   Status Append(const Slice& data) override {
     size_t write_size = data.size();
     const char* write_data = data.data();
 
-    char* cur_buf = GetCurThreadBuf();
+    WriteBufferSlots::Slot* slot = bufs_.CurrentWithBuffer();
+    if (slot == nullptr) {
+      return bufs_.AppendWithoutSlot(filename_, write_data, write_size);
+    }
 
     // Fit as much as possible into buffer.
     size_t copy_size =
-        std::min(write_size, kWritableFileBufferSize - pos_map_[cur_buf]);
-    assert(cur_buf != nullptr);
-    std::memcpy(cur_buf + pos_map_[cur_buf], write_data, copy_size);
+        std::min(write_size, kWritableFileBufferSize - slot->pos);
+    std::memcpy(slot->buf + slot->pos, write_data, copy_size);
     write_data += copy_size;
     write_size -= copy_size;
-    // pos_ += copy_size;
-    pos_map_[cur_buf] += copy_size;
+    slot->pos += copy_size;
     if (write_size == 0) {
       return Status::OK();
     }
@@ -567,20 +971,12 @@ class PosixWritableFile final : public WritableFile {
 
     // Small writes go to buffer, large writes are written directly.
     if (write_size < kWritableFileBufferSize) {
-      // std::memcpy(buf_, write_data, write_size);
-      std::memcpy(cur_buf, write_data, write_size);
-      // pos_ = write_size;
-      pos_map_[cur_buf] = write_size;
+      std::memcpy(slot->buf, write_data, write_size);
+      slot->pos = write_size;
       return Status::OK();
     }
-    // return WriteUnbuffered(write_data, write_size);
 #ifdef JL_LIBCFS
-    fprintf(stderr, "WARN: Call WriteUnbuffered with extra copy");
-    char* write_data_buf = (char*)fs_malloc(write_size);
-    Status s = WriteUnbuffered(write_data_buf, write_size);
-    fs_free((void*)write_data_buf);
-    throw std::runtime_error("writeUnbuffered with extra copy");
-    return s;
+    return bufs_.WriteStaged(slot, write_data, write_size);
 #else
     return WriteUnbuffered(write_data, write_size);
 #endif
@@ -588,6 +984,11 @@ class PosixWritableFile final : public WritableFile {
 
   Status Close() override {
     Status status = FlushBuffer();
+    bufs_.ReleaseAll();
+    if (status.ok()) {
+      // Exiting threads may have written out their slots in the meantime.
+      status = bufs_.TakeExitError();
+    }
 #ifdef JL_LIBCFS
     const int close_result = fs_close(fd_);
 #else
@@ -623,29 +1024,17 @@ class PosixWritableFile final : public WritableFile {
   }
 
  private:
-  char* GetCurThreadBuf() {
-    auto cur_id = std::this_thread::get_id();
-    auto it = buf_map_.find(cur_id);
-    if (it == buf_map_.end()) {
-      char* cur_buf = nullptr;
-#ifdef JL_LIBCFS
-      cur_buf = static_cast<char*>(fs_malloc(kWritableFileBufferSize));
-#else
-      cur_buf = static_cast<char*>(malloc(kWritableFileBufferSize));
-#endif
-      buf_map_.emplace(cur_id, cur_buf);
-      pos_map_.emplace(cur_buf, 0);
-      return cur_buf;
-    } else {
-      return it->second;
-    }
-  }
+  // Writes out the calling thread's buffer. Data buffered by other threads
+  // stays in their slots until they flush it themselves.
   Status FlushBuffer() {
-    char* cur_buf = GetCurThreadBuf();
-    Status status = WriteUnbuffered(GetCurThreadBuf(), pos_map_[cur_buf]);
-    pos_map_[cur_buf] = 0;
-    // pos_ = 0;
-    return status;
+    Status status = bufs_.TakeExitError();
+    WriteBufferSlots::Slot* slot = bufs_.Current();
+    if (slot == nullptr || slot->pos == 0) {
+      return status;
+    }
+    Status write_status = WriteUnbuffered(slot->buf, slot->pos);
+    slot->pos = 0;
+    return status.ok() ? write_status : status;
   }
 
   Status WriteUnbuffered(const char* data, size_t size) {
@@ -787,12 +1176,7 @@ class PosixWritableFile final : public WritableFile {
     return Basename(filename).starts_with("MANIFEST");
   }
 
-  // buf_[0, pos_ - 1] contains data to be written to fd_.
-  // char buf_[kWritableFileBufferSize];
-  // char* buf_{nullptr};
-  std::unordered_map<std::thread::id, char*> buf_map_;
-  std::unordered_map<char*, size_t> pos_map_;
-  // size_t pos_;
+  WriteBufferSlots bufs_;
   int fd_;
   uint64_t tid_;
 
@@ -804,7 +1188,10 @@ class PosixWritableFile final : public WritableFile {
 class FSPWritableFile final : public WritableFile {
  public:
   FSPWritableFile(std::string filename, int fd)
-      : fd_(fd),
+      : bufs_([this](const char* data, size_t size) {
+          return WriteUnbuffered(data, size);
+        }),
+        fd_(fd),
         is_manifest_(IsManifest(filename)),
         filename_(std::move(filename)),
         dirname_(Dirname(filename_)) {
@@ -826,31 +1213,24 @@ class FSPWritableFile final : public WritableFile {
     // if (curTid != tid_) {
     //  fprintf(stderr, "start_tid:%lu end_tid:%lu\n", tid_, curTid);
     //}
-    auto tid = std::this_thread::get_id();
-    auto it = buf_map_.find(tid);
-    assert(it != buf_map_.end());
-#ifdef JL_LIBCFS
-    fs_free((void*)(it->second));
-#else
-    free((void*)(it->second));
-#endif
   }
 
   Status Append(const Slice& data) override {
     size_t write_size = data.size();
     const char* write_data = data.data();
 
-    char* cur_buf = GetCurThreadBuf();
+    WriteBufferSlots::Slot* slot = bufs_.CurrentWithBuffer();
+    if (slot == nullptr) {
+      return bufs_.AppendWithoutSlot(filename_, write_data, write_size);
+    }
 
     // Fit as much as possible into buffer.
     size_t copy_size =
-        std::min(write_size, kWritableFileBufferSize - pos_map_[cur_buf]);
-    assert(cur_buf != nullptr);
-    std::memcpy(cur_buf + pos_map_[cur_buf], write_data, copy_size);
+        std::min(write_size, kWritableFileBufferSize - slot->pos);
+    std::memcpy(slot->buf + slot->pos, write_data, copy_size);
     write_data += copy_size;
     write_size -= copy_size;
-    // pos_ += copy_size;
-    pos_map_[cur_buf] += copy_size;
+    slot->pos += copy_size;
     if (write_size == 0) {
       return Status::OK();
     }
@@ -863,20 +1243,12 @@ class FSPWritableFile final : public WritableFile {
 
     // Small writes go to buffer, large writes are written directly.
     if (write_size < kWritableFileBufferSize) {
-      // std::memcpy(buf_, write_data, write_size);
-      std::memcpy(cur_buf, write_data, write_size);
-      // pos_ = write_size;
-      pos_map_[cur_buf] = write_size;
+      std::memcpy(slot->buf, write_data, write_size);
+      slot->pos = write_size;
       return Status::OK();
     }
-    // return WriteUnbuffered(write_data, write_size);
 #ifdef JL_LIBCFS
-    fprintf(stderr, "WARN: Call WriteUnbuffered with extra copy");
-    char* write_data_buf = (char*)fs_malloc(write_size);
-    Status s = WriteUnbuffered(write_data_buf, write_size);
-    fs_free((void*)write_data_buf);
-    throw std::runtime_error("writeUnbuffered with extra copy");
-    return s;
+    return bufs_.WriteStaged(slot, write_data, write_size);
 #else
     return WriteUnbuffered(write_data, write_size);
 #endif
@@ -884,6 +1256,11 @@ class FSPWritableFile final : public WritableFile {
 
   Status Close() override {
     Status status = FlushBuffer();
+    bufs_.ReleaseAll();
+    if (status.ok()) {
+      // Exiting threads may have written out their slots in the meantime.
+      status = bufs_.TakeExitError();
+    }
 #ifdef JL_LIBCFS
     const int close_result = fs_close_ldb(fd_);
 #else
@@ -919,29 +1296,17 @@ class FSPWritableFile final : public WritableFile {
   }
 
  protected:
-  char* GetCurThreadBuf() {
-    auto cur_id = std::this_thread::get_id();
-    auto it = buf_map_.find(cur_id);
-    if (it == buf_map_.end()) {
-      char* cur_buf = nullptr;
-#ifdef JL_LIBCFS
-      cur_buf = static_cast<char*>(fs_malloc(kWritableFileBufferSize));
-#else
-      cur_buf = static_cast<char*>(malloc(kWritableFileBufferSize));
-#endif
-      buf_map_.emplace(cur_id, cur_buf);
-      pos_map_.emplace(cur_buf, 0);
-      return cur_buf;
-    } else {
-      return it->second;
-    }
-  }
+  // Writes out the calling thread's buffer. Data buffered by other threads
+  // stays in their slots until they flush it themselves.
   Status FlushBuffer() {
-    char* cur_buf = GetCurThreadBuf();
-    Status status = WriteUnbuffered(GetCurThreadBuf(), pos_map_[cur_buf]);
-    pos_map_[cur_buf] = 0;
-    // pos_ = 0;
-    return status;
+    Status status = bufs_.TakeExitError();
+    WriteBufferSlots::Slot* slot = bufs_.Current();
+    if (slot == nullptr || slot->pos == 0) {
+      return status;
+    }
+    Status write_status = WriteUnbuffered(slot->buf, slot->pos);
+    slot->pos = 0;
+    return status.ok() ? write_status : status;
   }
 
   Status WriteUnbuffered(const char* data, size_t size) {
@@ -1083,12 +1448,7 @@ class FSPWritableFile final : public WritableFile {
     return Basename(filename).starts_with("MANIFEST");
   }
 
-  // buf_[0, pos_ - 1] contains data to be written to fd_.
-  // char buf_[kWritableFileBufferSize];
-  // char* buf_{nullptr};
-  std::unordered_map<std::thread::id, char*> buf_map_;
-  std::unordered_map<char*, size_t> pos_map_;
-  // size_t pos_;
+  WriteBufferSlots bufs_;
   int fd_;
   uint64_t tid_;
 
@@ -1181,6 +1541,21 @@ class PosixEnv : public Env {
   Status NewRandomAccessFile(const std::string& filename,
                              RandomAccessFile** result) override {
     *result = nullptr;
+#ifndef JL_LIBCFS
+    if (use_direct_reads_.load(std::memory_order_relaxed)) {
+      // Direct reads skip mmap(), which would go through the page cache.
+      int fd = OpenReadOnly(filename, /*direct=*/true);
+      if (fd >= 0) {
+        *result = new PosixRandomAccessFile(filename, fd, &fd_limiter_,
+                                            &direct_fd_cache_, /*direct=*/true);
+        return Status::OK();
+      }
+      if (errno != EINVAL) {
+        return PosixError(filename, errno);
+      }
+      // The file system does not support O_DIRECT; read it as usual.
+    }
+#endif
 #ifdef JL_LIBCFS
     int fd = fs_open2(filename.c_str(), O_RDONLY);
 #else
@@ -1191,7 +1566,8 @@ class PosixEnv : public Env {
     }
 
     if (!mmap_limiter_.Acquire()) {
-      *result = new PosixRandomAccessFile(filename, fd, &fd_limiter_);
+      *result = new PosixRandomAccessFile(filename, fd, &fd_limiter_,
+                                          &fd_cache_, /*direct=*/false);
       return Status::OK();
     }
 
@@ -1232,7 +1608,7 @@ class PosixEnv : public Env {
     }
 
     if (!mmap_limiter_.Acquire()) {
-      *result = new FSPRandomAccessFile(filename, fd, &fd_limiter_);
+      *result = new FSPRandomAccessFile(filename, fd, &fd_limiter_, &fd_cache_);
       return Status::OK();
     }
 
@@ -1452,6 +1828,12 @@ class PosixEnv : public Env {
   void Schedule(void (*background_work_function)(void* background_work_arg),
                 void* background_work_arg) override;
 
+  void ScheduleFlush(
+      void (*background_work_function)(void* background_work_arg),
+      void* background_work_arg) override;
+
+  void SetBackgroundThreads(int num) override;
+
   void StartThread(void (*thread_main)(void* thread_main_arg),
                    void* thread_main_arg) override;
 
@@ -1492,13 +1874,32 @@ class PosixEnv : public Env {
 
   void SleepForMicroseconds(int micros) override { ::usleep(micros); }
 
+  void SetReadOnlyFdCacheSize(int size) override {
+    fd_cache_.SetCapacity(size);
+    direct_fd_cache_.SetCapacity(size);
+  }
+
+  // Ignored under JL_LIBCFS, as uFS reads bypass the kernel anyway.
+  void SetUseDirectReads(bool use) override {
+    use_direct_reads_.store(use, std::memory_order_relaxed);
+  }
+
  private:
-  void BackgroundThreadMain();
+  struct WorkLane;
 
-  static void BackgroundThreadEntryPoint(PosixEnv* env) {
-    env->BackgroundThreadMain();
+  void BackgroundThreadMain(WorkLane* lane, int index);
+
+  static void BackgroundThreadEntryPoint(PosixEnv* env, WorkLane* lane,
+                                         int index) {
+    env->BackgroundThreadMain(lane, index);
   }
 
+  void Enqueue(WorkLane* lane, void (*background_work_function)(void*),
+               void* background_work_arg)
+      EXCLUSIVE_LOCKS_REQUIRED(background_work_mutex_);
+  void StartLaneThreads(WorkLane* lane)
+      EXCLUSIVE_LOCKS_REQUIRED(background_work_mutex_);
+
   // Stores the work item data in a Schedule() call.
   //
   // Instances are constructed on the thread calling Schedule() and used on the
@@ -1513,71 +1914,264 @@ class PosixEnv : public Env {
     void* const arg;
   };
 
-  port::Mutex background_work_mutex_;
-  port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
-  bool started_background_thread_ GUARDED_BY(background_work_mutex_);
+  // A queue of background work and the threads that run it. Threads are
+  // started lazily, on the first Schedule*() call after the lane grows.
+  struct WorkLane {
+    WorkLane(port::Mutex* mu, int max_threads)
+        : cv(mu), started_threads(0), max_threads(max_threads) {}
 
-  std::queue<BackgroundWorkItem> background_work_queue_
-      GUARDED_BY(background_work_mutex_);
+    port::CondVar cv;
+    std::queue<BackgroundWorkItem> queue;
+    int started_threads;
+    int max_threads;
+  };
+
+  port::Mutex background_work_mutex_;
+  // Schedule()d work, typically compactions.
+  WorkLane compaction_lane_ GUARDED_BY(background_work_mutex_);
+  // ScheduleFlush()ed work; always a single thread, so flushes never wait
+  // behind a compaction.
+  WorkLane flush_lane_ GUARDED_BY(background_work_mutex_);
 
   PosixLockTable locks_;  // Thread-safe.
   Limiter mmap_limiter_;  // Thread-safe.
   Limiter fd_limiter_;    // Thread-safe.
+  ReadOnlyFdCache fd_cache_;  // Thread-safe.
+  // The descriptors of the files opened while direct reads were on.
+  ReadOnlyFdCache direct_fd_cache_;  // Thread-safe.
+  std::atomic<bool> use_direct_reads_{false};
 };
 
+// Each app owns cores kFirstAppCore + 2 * (g_appid - 1) and the one after:
+// its foreground thread and first compaction thread. The flush threads take
+// one core per app from the block past the first kMaxPinnedApps pairs, so a
+// flush never waits for a compaction to give up the CPU. If a core does not
+// exist the pin fails and the scheduler places the thread. Cores are 1-based,
+// as pin_to_cpu_core() takes them.
+constexpr int kFirstAppCore = 21;
+constexpr int kMaxPinnedApps = 10;
+
+int AppForegroundCore() { return kFirstAppCore + 2 * (g_appid - 1); }
+
+int AppCompactionCore() { return AppForegroundCore() + 1; }
+
+int FlushLaneCore() {
+  return kFirstAppCore + 2 * kMaxPinnedApps + (g_appid - 1);
+}
+
 // Return the maximum number of concurrent mmaps.
 int MaxMmaps() { return g_mmap_limit; }
 
-// Return the maximum number of read-only files to keep open.
+}  // namespace
+
+// Every Env that calls this takes its share of the current RLIMIT_NOFILE, so
+// the result is not cached.
 int MaxOpenFiles() {
   if (g_open_read_only_file_limit >= 0) {
     return g_open_read_only_file_limit;
   }
+  int limit;
   struct ::rlimit rlim;
   if (::getrlimit(RLIMIT_NOFILE, &rlim)) {
     // getrlimit failed, fallback to hard-coded default.
-    g_open_read_only_file_limit = 50;
+    limit = 50;
   } else if (rlim.rlim_cur == RLIM_INFINITY) {
-    g_open_read_only_file_limit = std::numeric_limits<int>::max();
+    limit = std::numeric_limits<int>::max();
   } else {
     // Allow use of 20% of available file descriptors for read-only files.
-    g_open_read_only_file_limit = rlim.rlim_cur / 5;
+    limit = static_cast<int>(std::min<rlim_t>(
+        rlim.rlim_cur / 5, std::numeric_limits<int>::max()));
   }
-  fprintf(stdout, "g_open_read_only_file_limit:%d\n",
-          g_open_read_only_file_limit);
-  return g_open_read_only_file_limit;
+  fprintf(stdout, "g_open_read_only_file_limit:%d\n", limit);
+  return limit;
 }
 
-}  // namespace
+void ReadOnlyFdCache::Register(const std::string& filename) {
+  MutexLock lock(&mu_);
+  entries_[filename].owners++;
+}
+
+void ReadOnlyFdCache::Unregister(const std::string& filename) {
+  int fd = -1;
+  {
+    MutexLock lock(&mu_);
+    auto it = entries_.find(filename);
+    assert(it != entries_.end());
+    Entry& entry = it->second;
+    if (--entry.owners > 0) {
+      return;
+    }
+    assert(entry.refs == 0);
+    if (entry.pin == kPinned) {
+      pinned_--;
+    }
+    if (entry.fd >= 0) {
+      lru_.erase(entry.lru_pos);
+      open_--;
+      fd = entry.fd;
+    }
+    entries_.erase(it);
+  }
+  if (fd >= 0) {
+    CloseReadOnly(fd);
+  }
+}
+
+int ReadOnlyFdCache::Acquire(const std::string& filename) {
+  std::vector<int> victims;
+  mu_.Lock();
+  Entry* entry = &entries_[filename];
+  if (entry->fd < 0) {
+    // Open without holding the lock, as this is a round trip to the file
+    // system. Another thread may open the same file in the meantime.
+    mu_.Unlock();
+    int fd = OpenReadOnly(filename, direct_);
+    if (fd < 0) {
+      return -1;
+    }
+    mu_.Lock();
+    entry = &entries_[filename];
+    if (entry->fd < 0) {
+      entry->fd = fd;
+      lru_.push_front(filename);
+      entry->lru_pos = lru_.begin();
+      open_++;
+    } else {
+      victims.push_back(fd);
+    }
+  }
+  lru_.splice(lru_.begin(), lru_, entry->lru_pos);
+  entry->refs++;
+  int fd = entry->fd;
+  EvictIfNeeded(&victims);
+  mu_.Unlock();
+  CloseAll(victims);
+  return fd;
+}
+
+void ReadOnlyFdCache::Release(const std::string& filename) {
+  std::vector<int> victims;
+  {
+    MutexLock lock(&mu_);
+    Entry& entry = entries_[filename];
+    assert(entry.refs > 0);
+    entry.refs--;
+    EvictIfNeeded(&victims);
+  }
+  CloseAll(victims);
+}
+
+void ReadOnlyFdCache::Pin(const std::string& filename) {
+  MutexLock lock(&mu_);
+  Entry& entry = entries_[filename];
+  if (entry.pin == kUnpinned) {
+    if (pinned_ >= capacity_) {
+      entry.pin = kPinRefused;
+    } else {
+      entry.pin = kPinned;
+      pinned_++;
+    }
+  }
+}
+
+void ReadOnlyFdCache::Unpin(const std::string& filename) {
+  std::vector<int> victims;
+  {
+    MutexLock lock(&mu_);
+    Entry& entry = entries_[filename];
+    if (entry.pin == kPinned) {
+      pinned_--;
+      EvictIfNeeded(&victims);
+    }
+    entry.pin = kUnpinned;
+  }
+  CloseAll(victims);
+}
+
+void ReadOnlyFdCache::SetCapacity(int capacity) {
+  std::vector<int> victims;
+  {
+    MutexLock lock(&mu_);
+    capacity_ = capacity;
+    EvictIfNeeded(&victims);
+  }
+  CloseAll(victims);
+}
+
+void ReadOnlyFdCache::EvictIfNeeded(std::vector<int>* victims) {
+  auto it = lru_.end();
+  while (open_ > capacity_ && it != lru_.begin()) {
+    --it;
+    Entry& entry = entries_[*it];
+    if (entry.refs > 0 || entry.pin == kPinned) {
+      continue;
+    }
+    victims->push_back(entry.fd);
+    entry.fd = -1;
+    open_--;
+    it = lru_.erase(it);
+  }
+}
+
+void ReadOnlyFdCache::CloseAll(const std::vector<int>& fds) {
+  for (int fd : fds) {
+    CloseReadOnly(fd);
+  }
+}
 
 PosixEnv::PosixEnv()
-    : background_work_cv_(&background_work_mutex_),
-      started_background_thread_(false),
+    : compaction_lane_(&background_work_mutex_, 1),
+      flush_lane_(&background_work_mutex_, 1),
       mmap_limiter_(MaxMmaps()),
-      fd_limiter_(MaxOpenFiles()) {}
+      fd_limiter_(MaxOpenFiles()),
+      fd_cache_(kDefaultReadOnlyFdCacheSize, /*direct=*/false),
+      direct_fd_cache_(kDefaultReadOnlyFdCacheSize, /*direct=*/true) {}
 
 void PosixEnv::Schedule(
     void (*background_work_function)(void* background_work_arg),
     void* background_work_arg) {
-  background_work_mutex_.Lock();
+  MutexLock lock(&background_work_mutex_);
+  Enqueue(&compaction_lane_, background_work_function, background_work_arg);
+}
 
-  // Start the background thread, if we haven't done so already.
-  if (!started_background_thread_) {
-    started_background_thread_ = true;
-    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this);
-    background_thread.detach();
-  }
+void PosixEnv::ScheduleFlush(
+    void (*background_work_function)(void* background_work_arg),
+    void* background_work_arg) {
+  MutexLock lock(&background_work_mutex_);
+  Enqueue(&flush_lane_, background_work_function, background_work_arg);
+}
 
-  // If the queue is empty, the background thread may be waiting for work.
-  if (background_work_queue_.empty()) {
-    background_work_cv_.Signal();
+void PosixEnv::SetBackgroundThreads(int num) {
+  MutexLock lock(&background_work_mutex_);
+  if (num > compaction_lane_.max_threads) {
+    compaction_lane_.max_threads = num;
+    // Grow right away if the lane is already in use.
+    if (compaction_lane_.started_threads > 0) {
+      StartLaneThreads(&compaction_lane_);
+    }
   }
+}
 
-  background_work_queue_.emplace(background_work_function, background_work_arg);
-  background_work_mutex_.Unlock();
+void PosixEnv::Enqueue(WorkLane* lane,
+                       void (*background_work_function)(void*),
+                       void* background_work_arg) {
+  StartLaneThreads(lane);
+
+  // Threads may be waiting for work; wake one for the new item.
+  lane->queue.emplace(background_work_function, background_work_arg);
+  lane->cv.Signal();
 }
 
-void PosixEnv::BackgroundThreadMain() {
+void PosixEnv::StartLaneThreads(WorkLane* lane) {
+  while (lane->started_threads < lane->max_threads) {
+    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this,
+                                  lane, lane->started_threads);
+    background_thread.detach();
+    lane->started_threads++;
+  }
+}
+
+void PosixEnv::BackgroundThreadMain(WorkLane* lane, int index) {
 #ifdef JL_LIBCFS
   fs_init_thread_local_mem();
   printf("bg thread local mem init success\n");
@@ -1589,19 +2183,36 @@ void PosixEnv::BackgroundThreadMain() {
   // int target = g_appid - 1;
   // fs_admin_thread_reassign(0, target % g_num_workers, FS_REASSIGN_FUTURE);
 #endif
-  pin_to_cpu_core(21 + g_appid * 2 - 1);
+  if (lane == &flush_lane_ || index == 0) {
+    const bool flush = lane == &flush_lane_;
+    const int core = flush ? FlushLaneCore() : AppCompactionCore();
+    if (pin_to_cpu_core(core) != 0) {
+      fprintf(stderr,
+              "cannot pin the %s thread to core %d; leaving it unpinned\n",
+              flush ? "flush" : "compaction", core);
+    }
+  } else {
+    // Threads beyond the first would only contend for the app's background
+    // core, so let the scheduler place them.
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      CPU_SET(cpu, &cpuset);
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+  }
   while (true) {
     background_work_mutex_.Lock();
 
     // Wait until there is work to be done.
-    while (background_work_queue_.empty()) {
-      background_work_cv_.Wait();
+    while (lane->queue.empty()) {
+      lane->cv.Wait();
     }
 
-    assert(!background_work_queue_.empty());
-    auto background_work_function = background_work_queue_.front().function;
-    void* background_work_arg = background_work_queue_.front().arg;
-    background_work_queue_.pop();
+    assert(!lane->queue.empty());
+    auto background_work_function = lane->queue.front().function;
+    void* background_work_arg = lane->queue.front().arg;
+    lane->queue.pop();
 
     background_work_mutex_.Unlock();
     background_work_function(background_work_arg);
@@ -1637,7 +2248,7 @@ class SingletonEnv {
     init_fsp_access();
 #endif
     g_appid = atoi(strtok(getenv("FSP_KEY_LISTS"), ","));
-    pin_to_cpu_core(21 + g_appid * 2 - 2);
+    pin_to_cpu_core(AppForegroundCore());
     new (&env_storage_) EnvType();
   }
   ~SingletonEnv() = default;
@@ -1686,6 +2297,10 @@ void EnvPosixTestHelper::SetReadOnlyMMapLimit(int limit) {
   g_mmap_limit = limit;
 }
 
+int EnvPosixTestHelper::DefaultReadOnlyFdCacheSize() {
+  return kDefaultReadOnlyFdCacheSize;
+}
+
 Env* Env::Default() {
   static PosixDefaultEnv env_container;
   return env_container.env();
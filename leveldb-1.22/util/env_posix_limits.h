@@ -0,0 +1,145 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Limits on the read-only file descriptors kept open, shared by the POSIX
+// Env and the Envs built on top of it. Implemented in env_posix.cc.
+
+#ifndef STORAGE_LEVELDB_UTIL_ENV_POSIX_LIMITS_H_
+#define STORAGE_LEVELDB_UTIL_ENV_POSIX_LIMITS_H_
+
+#include <atomic>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
+namespace leveldb {
+
+// Number of descriptors kept open for random access files beyond the ones
+// granted by MaxOpenFiles(). Can be changed with Env::SetReadOnlyFdCacheSize.
+constexpr const int kDefaultReadOnlyFdCacheSize = 64;
+
+// Helper class to limit resource usage to avoid exhaustion.
+// Currently used to limit read-only file descriptors and mmap file usage
+// so that we do not run out of file descriptors or virtual memory, or run into
+// kernel performance problems for very large databases.
+class Limiter {
+ public:
+  // Limit maximum number of resources to |max_acquires|.
+  explicit Limiter(int max_acquires) : acquires_allowed_(max_acquires) {}
+
+  Limiter(const Limiter&) = delete;
+  Limiter& operator=(const Limiter&) = delete;
+
+  // If another resource is available, acquire it and return true.
+  // Else return false.
+  bool Acquire() {
+    int old_acquires_allowed =
+        acquires_allowed_.fetch_sub(1, std::memory_order_relaxed);
+
+    if (old_acquires_allowed > 0) return true;
+
+    acquires_allowed_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  // Release a resource acquired by a previous call to Acquire() that returned
+  // true.
+  void Release() { acquires_allowed_.fetch_add(1, std::memory_order_relaxed); }
+
+ private:
+  // The number of available resources.
+  //
+  // This is a counter and is not tied to the invariants of any other class, so
+  // it can be operated on safely using std::memory_order_relaxed.
+  std::atomic<int> acquires_allowed_;
+};
+
+// Return the maximum number of read-only files to keep open: 20% of the
+// available file descriptors, unless overridden by EnvPosixTestHelper.
+int MaxOpenFiles();
+
+// Caches read-only file descriptors for the random access files that did not
+// get a permanent descriptor from the fd limiter, so that they do not pay an
+// open and a close (two uFS round trips) on every Read().
+//
+// Descriptors are keyed by file name and evicted in LRU order once more than
+// |capacity| of them are open. Descriptors that are in use by a Read(), or
+// whose file is pinned, are not evicted. At most |capacity| files are pinned
+// at a time; the pin state of every file lives here, under the mutex, so
+// that concurrent Pin() and Unpin() calls on one file cannot leak a pin.
+// Descriptors are closed after the mutex is released, as under uFS every
+// close is a round trip.
+//
+// Instances are thread-safe because all member data is guarded by a mutex.
+class ReadOnlyFdCache {
+ public:
+  // If |direct| is true, files are opened with O_DIRECT.
+  ReadOnlyFdCache(int capacity, bool direct)
+      : direct_(direct), capacity_(capacity) {}
+
+  ReadOnlyFdCache(const ReadOnlyFdCache&) = delete;
+  ReadOnlyFdCache& operator=(const ReadOnlyFdCache&) = delete;
+
+  // Registers a file whose reads go through the cache.
+  void Register(const std::string& filename) LOCKS_EXCLUDED(mu_);
+
+  // Drops a registration made by Register(). The file's descriptor is closed
+  // once the last registration is gone.
+  void Unregister(const std::string& filename) LOCKS_EXCLUDED(mu_);
+
+  // Returns an open descriptor for |filename|, or -1 with errno set if the
+  // file cannot be opened. A descriptor returned by this method is not closed
+  // until the matching Release() call.
+  //
+  // REQUIRES: |filename| is registered.
+  int Acquire(const std::string& filename) LOCKS_EXCLUDED(mu_);
+
+  void Release(const std::string& filename) LOCKS_EXCLUDED(mu_);
+
+  // Pinned files keep their descriptor until they are unpinned or
+  // unregistered. If |capacity| files are pinned already, the file is not
+  // pinned, and further Pin() calls are ignored until it is unpinned.
+  //
+  // REQUIRES: |filename| is registered.
+  void Pin(const std::string& filename) LOCKS_EXCLUDED(mu_);
+
+  // REQUIRES: |filename| is registered.
+  void Unpin(const std::string& filename) LOCKS_EXCLUDED(mu_);
+
+  void SetCapacity(int capacity) LOCKS_EXCLUDED(mu_);
+
+ private:
+  // The states of a file's pin (see RandomAccessFile::Pin()).
+  enum PinState { kUnpinned, kPinned, kPinRefused };
+
+  struct Entry {
+    int fd = -1;      // -1 if the file is not open.
+    int owners = 0;   // Number of Register() calls not yet unregistered.
+    int refs = 0;     // Number of Acquire() calls not yet released.
+    PinState pin = kUnpinned;
+    std::list<std::string>::iterator lru_pos;  // Valid iff fd >= 0.
+  };
+
+  // Takes descriptors out of the cache until at most |capacity_| are open,
+  // appending them to |*victims| for the caller to close.
+  void EvictIfNeeded(std::vector<int>* victims) EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  static void CloseAll(const std::vector<int>& fds);
+
+  const bool direct_;
+  port::Mutex mu_;
+  int capacity_ GUARDED_BY(mu_);
+  int open_ GUARDED_BY(mu_) = 0;    // Number of entries with fd >= 0.
+  int pinned_ GUARDED_BY(mu_) = 0;  // Number of entries with kPinned.
+  std::unordered_map<std::string, Entry> entries_ GUARDED_BY(mu_);
+  std::list<std::string> lru_ GUARDED_BY(mu_);  // Open files, MRU first.
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_ENV_POSIX_LIMITS_H_
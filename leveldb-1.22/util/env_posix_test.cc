@@ -3,8 +3,18 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "leveldb/env.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "port/port.h"
 #include "util/env_posix_test_helper.h"
+#include "util/mutexlock.h"
 #include "util/testharness.h"
 
 namespace leveldb {
@@ -19,6 +29,41 @@ class EnvPosixTest {
     EnvPosixTestHelper::SetReadOnlyMMapLimit(mmap_limit);
   }
 
+  static int DefaultReadOnlyFdCacheSize() {
+    return EnvPosixTestHelper::DefaultReadOnlyFdCacheSize();
+  }
+
+  // Returns the number of descriptors open in this process.
+  static int CountOpenFds() {
+    std::vector<std::string> fds;
+    Env::Default()->GetChildren("/proc/self/fd", &fds);
+    return static_cast<int>(fds.size());
+  }
+
+  // Returns false if the file system of |filename| rejects O_DIRECT, in
+  // which case the Env quietly falls back to buffered reads.
+  static bool SupportsDirectReads(const std::string& filename) {
+    int fd = ::open(filename.c_str(), O_RDONLY | O_DIRECT);
+    if (fd < 0) {
+      return false;
+    }
+    ::close(fd);
+    return true;
+  }
+
+  // Puts back the settings of Env::Default() that a test changes when it
+  // goes out of scope, however the test ends.
+  class SettingsRestorer {
+   public:
+    SettingsRestorer() = default;
+    SettingsRestorer(const SettingsRestorer&) = delete;
+    SettingsRestorer& operator=(const SettingsRestorer&) = delete;
+    ~SettingsRestorer() {
+      Env::Default()->SetReadOnlyFdCacheSize(DefaultReadOnlyFdCacheSize());
+      Env::Default()->SetUseDirectReads(false);
+    }
+  };
+
   EnvPosixTest() : env_(Env::Default()) {}
 
   Env* env_;
@@ -55,6 +100,193 @@ TEST(EnvPosixTest, TestOpenOnRead) {
   ASSERT_OK(env_->DeleteFile(test_file));
 }
 
+TEST(EnvPosixTest, TestWriterThreads) {
+  std::string test_dir;
+  ASSERT_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/writer_threads.txt";
+
+  WritableFile* file;
+  ASSERT_OK(env_->NewWritableFile(test_file, &file));
+
+  // More threads than there are buffer slots, all alive at once. Each leaves
+  // its record buffered when it exits, or writes it out directly if it got
+  // no slot.
+  const int kNumThreads = 70;
+  port::Mutex mu;
+  port::CondVar cv(&mu);
+  int appended = 0;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; i++) {
+    threads.emplace_back([&, i]() {
+      ASSERT_OK(file->Append("<" + std::to_string(i) + ">"));
+      MutexLock l(&mu);
+      appended++;
+      cv.SignalAll();
+      while (appended < kNumThreads) {
+        cv.Wait();
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  ASSERT_OK(file->Close());
+  delete file;
+
+  std::string data;
+  ASSERT_OK(ReadFileToString(env_, test_file, &data));
+  for (int i = 0; i < kNumThreads; i++) {
+    ASSERT_NE(std::string::npos, data.find("<" + std::to_string(i) + ">"));
+  }
+  ASSERT_OK(env_->DeleteFile(test_file));
+}
+
+TEST(EnvPosixTest, TestFdCache) {
+  std::string test_dir;
+  ASSERT_OK(env_->GetTestDirectory(&test_dir));
+
+  // More files than the fd limiter grants, so that most of them read through
+  // the descriptor cache.
+  const int kNumFiles = kReadOnlyFileLimit + 6;
+  std::string test_files[kNumFiles];
+  for (int i = 0; i < kNumFiles; i++) {
+    test_files[i] = test_dir + "/fd_cache_" + std::to_string(i) + ".txt";
+    FILE* f = fopen(test_files[i].c_str(), "w");
+    ASSERT_TRUE(f != nullptr);
+    fputc('a' + i, f);
+    fclose(f);
+  }
+
+  const int kNumFdsBefore = CountOpenFds();
+  SettingsRestorer restorer;
+  env_->SetReadOnlyFdCacheSize(2);
+  leveldb::RandomAccessFile* files[kNumFiles] = {0};
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_OK(env_->NewRandomAccessFile(test_files[i], &files[i]));
+  }
+  files[kNumFiles - 1]->Pin();
+
+  char scratch;
+  Slice read_result;
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < kNumFiles; i++) {
+      ASSERT_OK(files[i]->Read(0, 1, &read_result, &scratch));
+      ASSERT_EQ('a' + i, read_result[0]);
+    }
+    // Permanent descriptors, two cached ones and the pinned one.
+    ASSERT_LE(CountOpenFds(), kNumFdsBefore + kReadOnlyFileLimit + 2 + 1);
+  }
+
+  // Unpinned, the file's descriptor may be evicted like any other.
+  files[kNumFiles - 1]->Unpin();
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_OK(files[i]->Read(0, 1, &read_result, &scratch));
+  }
+  ASSERT_LE(CountOpenFds(), kNumFdsBefore + kReadOnlyFileLimit + 2);
+
+  // No more files are pinned than the cache holds.
+  for (int i = 0; i < kNumFiles; i++) {
+    files[i]->Pin();
+    ASSERT_OK(files[i]->Read(0, 1, &read_result, &scratch));
+  }
+  ASSERT_LE(CountOpenFds(), kNumFdsBefore + kReadOnlyFileLimit + 2);
+
+  // Racing Pin() and Unpin() calls leave no pin behind once the last
+  // Unpin() returns, so every descriptor can be evicted again.
+  for (int i = 0; i < kNumFiles; i++) {
+    files[i]->Unpin();
+  }
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&files, t]() {
+      for (int round = 0; round < 10000; round++) {
+        RandomAccessFile* file = files[kNumFiles - 1 - (round + t) % 3];
+        if ((round + t) % 2 == 0) {
+          file->Pin();
+        } else {
+          file->Unpin();
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (int i = 0; i < kNumFiles; i++) {
+    files[i]->Unpin();
+  }
+  env_->SetReadOnlyFdCacheSize(0);
+  ASSERT_EQ(kNumFdsBefore + kReadOnlyFileLimit, CountOpenFds());
+
+  for (int i = 0; i < kNumFiles; i++) {
+    delete files[i];
+    ASSERT_OK(env_->DeleteFile(test_files[i]));
+  }
+  ASSERT_EQ(kNumFdsBefore, CountOpenFds());
+}
+
+TEST(EnvPosixTest, TestDirectReads) {
+  std::string test_dir;
+  ASSERT_OK(env_->GetTestDirectory(&test_dir));
+
+  const size_t kFileSize = 20000;  // Not a multiple of the I/O alignment.
+  std::string data(kFileSize, '\0');
+  for (size_t i = 0; i < kFileSize; i++) {
+    data[i] = static_cast<char>(i * 31 + i / 251);
+  }
+  // More files than the fd limiter grants, so that the last ones read through
+  // the descriptor cache.
+  const int kNumFiles = kReadOnlyFileLimit + 2;
+  std::string test_files[kNumFiles];
+  for (int i = 0; i < kNumFiles; i++) {
+    test_files[i] = test_dir + "/direct_" + std::to_string(i) + ".txt";
+    ASSERT_OK(WriteStringToFile(env_, data, test_files[i]));
+  }
+  if (!SupportsDirectReads(test_files[0])) {
+    fprintf(stderr,
+            "skipping test because %s does not support O_DIRECT reads\n",
+            test_dir.c_str());
+    for (int i = 0; i < kNumFiles; i++) {
+      ASSERT_OK(env_->DeleteFile(test_files[i]));
+    }
+    return;
+  }
+
+  SettingsRestorer restorer;
+  env_->SetUseDirectReads(true);
+  leveldb::RandomAccessFile* files[kNumFiles] = {0};
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_OK(env_->NewRandomAccessFile(test_files[i], &files[i]));
+  }
+  env_->SetUseDirectReads(false);
+
+  const struct {
+    uint64_t offset;
+    size_t n;
+  } kReads[] = {{0, 1},     {0, 4096},    {1, 4096}, {4095, 2},
+                {5000, 9000}, {19990, 100}, {20000, 1}, {25000, 10}};
+  std::string scratch(10000, '\0');
+  for (int i = 0; i < kNumFiles; i++) {
+    for (const auto& read : kReads) {
+      Slice result;
+      ASSERT_OK(files[i]->Read(read.offset, read.n, &result, &scratch[0]));
+      const size_t expected_size =
+          read.offset >= kFileSize
+              ? 0
+              : std::min<size_t>(read.n, kFileSize - read.offset);
+      ASSERT_EQ(expected_size, result.size());
+      ASSERT_EQ(data.substr(std::min<uint64_t>(read.offset, kFileSize),
+                            expected_size),
+                result.ToString());
+    }
+  }
+
+  for (int i = 0; i < kNumFiles; i++) {
+    delete files[i];
+    ASSERT_OK(env_->DeleteFile(test_files[i]));
+  }
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -21,6 +21,10 @@ class EnvPosixTestHelper {
   // Set the maximum number of read-only files that will be mapped via mmap.
   // Must be called before creating an Env.
   static void SetReadOnlyMMapLimit(int limit);
+
+  // The size of the read-only descriptor cache of a new Env (see
+  // Env::SetReadOnlyFdCacheSize()).
+  static int DefaultReadOnlyFdCacheSize();
 };
 
 }  // namespace leveldb